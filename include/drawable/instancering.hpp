@@ -0,0 +1,53 @@
+#ifndef INSTANCERING_HPP
+#define INSTANCERING_HPP
+
+#include <cstddef>
+#include <vector>
+
+/*
+ * Instance buffer shared by the draws of one frame, the CPU writes straight into a persistently mapped buffer.
+ * The buffer is split into RING_FRAMES sections, each frame writes the next one while the GPU may still read the others.
+ * A fence per section makes the CPU wait in the rare case it catches up with the GPU.
+ * Without ARB_buffer_storage the frame is written to memory and uploaded with glBufferSubData by endFrame.
+ * Main thread only.
+ */
+class InstanceRing {
+public:
+    static const int RING_FRAMES = 3;
+
+    explicit InstanceRing(size_t elementSize);
+    ~InstanceRing();
+    InstanceRing(const InstanceRing &) = delete;
+    InstanceRing &operator=(const InstanceRing &) = delete;
+
+    /*
+     * Fences the section of the last frame and returns the next one, with room for count elements.
+     * A larger count replaces the buffer, which changes getGeneration.
+     */
+    void *beginFrame(int count);
+    /* Makes the elements written since beginFrame visible to the GPU */
+    void endFrame();
+    /* Index of the first element of the current frame, as the base instance of the draws */
+    int getFrameBase();
+    unsigned int getBuffer();
+    /* Changes whenever the buffer is replaced, vertex arrays have to point to the new one then */
+    int getGeneration();
+    bool isPersistent();
+
+private:
+    size_t elementSize_;
+    int capacity_ = 0; // Elements per section
+    int section_ = 0;
+    int count_ = 0; // Elements of the current frame
+    int generation_ = 0;
+    bool persistent_;
+    bool frameStarted_ = false;
+    unsigned int buffer_ = 0;
+    char *mapped_ = nullptr;
+    std::vector<char> staging_; // Without persistent mapping
+    void *fences_[RING_FRAMES] = {}; // GLsync of the last frame that used each section
+
+    void waitForSection(int section);
+    void resize(int capacity);
+};
+#endif
@@ -11,20 +11,31 @@
 class Mesh {
   private:
     std::vector<Texture> textures_;
-    VertexData *vertexData_;
+    VertexData *vertexData_ = nullptr;
     bool isInstanced_ = false;
     bool incomplete_ = true;
     unsigned int drawInstances_ = 0;
+    unsigned int baseInstance_ = 0;
+    int instanceAttributeIndex_ = -1; // First attribute of a shared instance buffer
     int drawMode_;
-    unsigned int vao_, vbo_, ebo_, ibo_, abo_;
+    unsigned int vao_, vbo_, ebo_, ibo_ = 0, abo_ = 0;
     int vertexAttributeIndex_ = 0;
     void initMesh();
 
   public:
     Mesh();
     Mesh(VertexData *vertexData, std::vector<Texture> textures = std::vector<Texture>(0));
+    /* Owns the vertex data. Deletes the GL objects if initMesh ran, so main thread only then */
+    ~Mesh();
     void updateMesh();
     void updateInstances(std::vector<glm::mat4> *instanceMatrices, VertexAttributeData *attribData = nullptr);
+    /*
+     * Takes the instances from a buffer shared with other meshes, like InstanceRing, one attribute per layout entry.
+     * Call it again after the buffer was replaced. Main thread only
+     */
+    void setInstanceBuffer(unsigned int buffer, size_t stride, const std::vector<InstanceAttributeLayout> &layout);
+    /* Draws the instances [first, first + count) of the shared buffer */
+    void setInstanceRange(int first, int count);
     void optimize();
     void addTexture(Texture tex);
     std::vector<Texture> &getTextures();
@@ -32,6 +43,7 @@ class Mesh {
     unsigned int getVao();
     unsigned int getIndicesSize();
     unsigned int getInstanceSize();
+    unsigned int getBaseInstance();
     bool &isInstanced();
     bool incomplete();
     unsigned int getTriangleCount();
@@ -13,6 +13,13 @@ struct VertexAttributeData {
     void *data;
 };
 
+/* One attribute of an instance struct in a shared instance buffer, floats unless isInteger */
+struct InstanceAttributeLayout {
+    int numElements;
+    bool isInteger;
+    size_t offset;
+};
+
 struct Vertex {
     glm::vec3 position;
     glm::vec3 normal;
@@ -22,6 +22,8 @@ class Engine {
     GLFWwindow *getWindow();
     void addScene(Scene *scene);
     void render();
+    /* Milliseconds per frame for the jobs on g_glJobQueue */
+    void setGlJobBudget(float milliseconds);
 
   private:
     Scene *scene_;
@@ -2,6 +2,7 @@
 #define GLOBAL_H
 
 #include "threadpool.hpp"
+#include "gljobqueue.hpp"
 
 extern float g_deltaTime;
 extern float g_currentFrameTime;
@@ -9,5 +10,6 @@ extern unsigned int g_triangleCount;
 extern bool g_debugPolygonMode;
 
 extern ThreadPool *g_threadPool;
+extern GlJobQueue *g_glJobQueue;
 
 #endif
\ No newline at end of file
@@ -37,6 +37,7 @@ class Shader {
     void uniform(const std::string &name, glm::vec4 value);
     void uniform(const std::string &name, int value);
     void uniform(const std::string &name, float value);
+    void uniform(const std::string &name, const float *values, int count);
     virtual void setSceneUniforms(SceneRenderData &sceneData, void *data) = 0;
     virtual void setDrawableUniforms(SceneRenderData &sceneData, Drawable *drawable, void *data) = 0;
 
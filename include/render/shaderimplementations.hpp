@@ -1,11 +1,13 @@
 #ifndef SHADERIMPLEMENTATIONS_HPP
 #define SHADERIMPLEMENTATIONS_HPP
 
+#include <algorithm>
 #include "shader.hpp"
 #include "scenerenderdata.hpp"
 #include "drawable.hpp"
 #include "light.hpp"
 #include "global.hpp"
+#include "terraindatatypes.hpp"
 
 class TerrainInstanceShader : public Shader {
 public:
@@ -20,6 +22,15 @@ public:
         uniform("heightMapDimension", 256.0f);
         uniform("meshDimension", 16.0f);
         uniform("gridOrigin", glm::vec3(0,0,0));
+
+        /* The instances only carry position, scale, lod level and cube side, see CdlodTree */
+        TerrainObjectAttributes *attributes = static_cast<TerrainObjectAttributes *>(data);
+        if (!attributes)
+            return;
+        uniform("bodyOrigin", attributes->bodyOrigin);
+        uniform("bodyRadius", attributes->bodyRadius);
+        if (attributes->lodRanges)
+            uniform("lodRanges", attributes->lodRanges->data(), std::min((int)attributes->lodRanges->size(), MAX_TERRAIN_LOD_LEVELS));
     }
     void setDrawableUniforms(SceneRenderData &sceneData, Drawable *drawable, void *data) override {
         ;
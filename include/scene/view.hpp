@@ -4,6 +4,7 @@
 #include <functional>
 #include <glm/glm.hpp>
 #include "mathutils.hpp"
+#include "frustum.hpp"
 
 struct GLFWwindow;
 
@@ -36,6 +37,8 @@ class View {
     // std::function<void(GLFWwindow*, double, double)> sCb;
     void (*mCb)(GLFWwindow *, double, double);
     void (*sCb)(GLFWwindow *, double, double);
+    /* Updated with the camera, in world space */
+    Frustum &getFrustum();
     bool isInsideFrustum(BoundingBox &bBox);
 
   private:
@@ -69,14 +72,6 @@ class View {
     float pitch_;
     float nearPlaneDistance_;
     float farPlaneDistance_;
-    Plane nearPlane_;
-    Plane farPlane_;
-    Plane leftPlane_;
-    Plane rightPlane_;
-    Plane topPlane_;
-    Plane bottomPlane_;
-    std::vector<Plane *> frustumPlanes_;
-
-    bool isInsidePlane(Plane *plane, glm::vec3 &max, glm::vec3 &min);
+    Frustum frustum_;
 };
 #endif
\ No newline at end of file
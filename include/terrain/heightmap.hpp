@@ -2,28 +2,64 @@
 #define HEIGHTMAP_HPP
 
 #include "terraingenerator.hpp"
+#include "heightpyramid.hpp"
+
+/*
+ * Heightmaps with more samples per side are generated with a larger sample spacing.
+ */
+const int MAX_HEIGHTMAP_SAMPLES = 512;
 
 class HeightMap {
 public:
-    HeightMap(TerrainGenerator *terrainGen, glm::vec2 cornerPos, glm::vec3 axis, int dimension, int index);
+    /*
+     * dimension is the covered area in world units, sampled every sampleSpacing units.
+     * With keepLowFrequency the coarse octaves are kept, so finer heightmaps can be refined from this one.
+     * The constructors only generate the data and make no GL calls, so they can run on the thread pool.
+     */
+    HeightMap(TerrainGenerator *terrainGen, glm::vec2 cornerPos, glm::vec3 axis, int dimension, int index, int sampleSpacing = 1,
+              bool keepLowFrequency = false);
+    /*
+     * Refines the area at cornerPos inside of parent with the same number of samples.
+     * Only the octaves that are new at the finer spacing are evaluated, see TerrainGenerator::generateTerrainHeightMap.
+     */
+    HeightMap(TerrainGenerator *terrainGen, HeightMap *parent, glm::vec2 cornerPos, int dimension, int index);
+    ~HeightMap();
+    /*
+     * Creates the textures from the generated data, or overwrites them after regenerate. Main thread only.
+     * The data is freed unless keepData is set, which regenerate needs to run without allocations.
+     */
+    void uploadTextures(bool keepData = false);
+    /* Generates the same area size at cornerPos again, into the existing buffers. No GL calls, see uploadTextures */
+    void regenerate(TerrainGenerator *terrainGen, glm::vec2 cornerPos);
     int getIndex();
+    int getDimension();
+    int getSampleSpacing();
+    /* Bytes of textures and CPU side data, counted against the terrain memory budget */
+    size_t getMemoryUsage();
     unsigned int getHeightTexture();
     unsigned int getNormalTexture();
     glm::vec3 &getAxis();
-    void cleanUpMapData();
     void getMaxMinValuesFromArea(glm::vec2 &pos, int dimension, float *nodeMinHeight_, float *nodeMaxHeight_);
+    /* Largest angle in radians between a sampled normal and up, only tracked on spheres */
+    float getMaxTiltFromArea(glm::vec2 &pos, int dimension);
 private:
     glm::vec2 cornerPos_;
     glm::vec3 axis_;
     int index_;
     int dimension_;
+    int sampleSpacing_;
+    int sampleCount_; // Samples per side
+    float residualAmplitude_; // Height the skipped octaves could add
     float lowerNoiseBound_;
     float upperNoiseBound_;
-    unsigned int heightTextureId_;
-    unsigned int normalTextureId_;
-    std::vector<unsigned char> *heightData_ = nullptr;
-    std::vector<unsigned char> *normalData_ = nullptr;
+    unsigned int heightTextureId_ = 0;
+    unsigned int normalTextureId_ = 0;
+    HeightPyramid heightPyramid_; // Node bounds, the height data itself is freed after the upload
+    std::vector<unsigned char> heightData_; // Until uploadTextures, unless kept
+    std::vector<unsigned char> normalData_;
+    LowFrequencyField *lowFrequencyData_ = nullptr;
 
-    float getOriginalHeight(float inVal);
+    void generate(TerrainGenerator *terrainGen, const LowFrequencyField *parentLowFrequencyData);
+    void getSampleArea(glm::vec2 &pos, int dimension, int *x0, int *y0, int *x1, int *y1);
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,43 @@
+#ifndef HEIGHTPYRAMID_HPP
+#define HEIGHTPYRAMID_HPP
+
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+/*
+ * Min/max mip pyramid over a quantized heightmap.
+ * Cell (x, y) spans the samples x..x+1 and y..y+1, so neighbouring cells share their border samples
+ * like neighbouring terrain nodes share their border vertices.
+ * Level k holds the min/max of blocks of 2^k * 2^k cells with 16 bit precision.
+ * Building is O(N^2), a query touches at most 2x2 entries of a single level.
+ */
+class HeightPyramid {
+public:
+    /*
+     * heights has dimension * dimension samples, 0 maps to lowerBound and 255 to upperBound.
+     * tilts is optional, see GenerationAttributes::tiltData.
+     */
+    void build(const unsigned char *heights, int dimension, float lowerBound, float upperBound, const unsigned char *tilts = nullptr);
+    /* Min and max height of the cells [x0, x1) x [y0, y1), clamped to the map */
+    void getMinMax(int x0, int y0, int x1, int y1, float *minHeight, float *maxHeight);
+    /* Largest angle between normal and up in radians, 90 degrees if the pyramid has no tilts */
+    float getMaxTilt(int x0, int y0, int x1, int y1);
+    int getDimension();
+    /* Bytes held by the levels */
+    size_t getMemoryUsage();
+
+private:
+    struct Level {
+        int dimension;
+        std::vector<glm::u16vec2> values; // (min, max)
+        std::vector<unsigned char> tilts;
+    };
+
+    std::vector<Level> levels_;
+    float lowerBound_ = 0.0f;
+    float scale_ = 0.0f; // World units per 16 bit step
+
+    int getQueryLevel(int &x0, int &y0, int &x1, int &y1);
+};
+#endif
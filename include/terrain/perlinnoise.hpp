@@ -20,6 +20,38 @@ class PerlinNoise {
 
     float getNoise2d(int x, int y);
     float getNoise3d(int x, int y, int z);
+    /*
+     * Value plus the analytic gradient of the fBm sum in input units,
+     * the octave derivatives are summed up with the chain rule.
+     * The value is identical to getNoise2d / getNoise3d.
+     */
+    float getNoise2dDeriv(int x, int y, float *dx, float *dy);
+    float getNoise3dDeriv(int x, int y, int z, float *dx, float *dy, float *dz);
+    /*
+     * Batch versions of getNoise2d / getNoise3d.
+     * Evaluate a whole row or list of samples per call with SSE4.1 or AVX2 kernels,
+     * picked at runtime. Results are bit-identical to the scalar functions.
+     * If derivative outputs are provided, the gradient is written as well.
+     * Only the octaves [firstOctave, octaves) are summed up, octaves = -1 goes up to the last one.
+     * The height offset is part of the first octave.
+     */
+    void getNoise2dRow(int x0, int y, int count, float *out, float *dx = nullptr, float *dy = nullptr, int octaves = -1,
+                       int firstOctave = 0);
+    void getNoise2dBatch(const float *xs, const float *ys, int n, float *out, float *dx = nullptr, float *dy = nullptr,
+                         int octaves = -1, int firstOctave = 0);
+    void getNoise3dBatch(const float *xs, const float *ys, const float *zs, int n, float *out, float *dx = nullptr,
+                         float *dy = nullptr, float *dz = nullptr, int octaves = -1, int firstOctave = 0);
+    /*
+     * Number of octaves with a wavelength not shorter than the sample spacing.
+     * Finer octaves can't be represented at that spacing, they only add aliasing.
+     */
+    int getOctavesForSpacing(float sampleSpacing);
+    /*
+     * Largest height the octaves from firstSkipped on can add or remove.
+     * Used to keep min/max bounds conservative when they are skipped.
+     */
+    float getResidualAmplitude(int firstSkipped);
+    int getOctaves();
     float getAmplitude();
     float getLowerBound();
     float getUpperBound();
@@ -32,17 +64,30 @@ class PerlinNoise {
     float upperBound_;
     float roughness_;
     unsigned int seed_;
+    std::vector<float> octaveFrequencies_;
+    std::vector<float> octaveAmplitudes_;
 
     std::vector<int> generateRandomPerm();
+    void initOctaves();
+    int clampOctaves(int octaves);
+    float fbm2d(float x, float y, int firstOctave, int octaves);
+    float fbm3d(float x, float y, float z, int firstOctave, int octaves);
+    float fbm2dDeriv(float x, float y, int firstOctave, int octaves, float *dx, float *dy);
+    float fbm3dDeriv(float x, float y, float z, int firstOctave, int octaves, float *dx, float *dy, float *dz);
     float noise2d(float x, float y);
     float noise3d(float x, float y, float z);
+    float noise2dDeriv(float x, float y, float *dx, float *dy);
+    float noise3dDeriv(float x, float y, float z, float *dx, float *dy, float *dz);
 
     float fade(float t);
+    float fadeDeriv(float t);
 
     float lerp(float t, float a, float b);
 
     float grad(int hash, float x, float y);
     float grad(int hash, float x, float y, float z);
+    void gradDeriv(int hash, float *gx, float *gy);
+    void gradDeriv(int hash, float *gx, float *gy, float *gz);
     std::vector<int> p;
     std::vector<int> perm_ = {
         151, 160, 137, 91,  90,  15, // permutation vector
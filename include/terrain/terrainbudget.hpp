@@ -0,0 +1,52 @@
+#ifndef TERRAINBUDGET_HPP
+#define TERRAINBUDGET_HPP
+
+#include <vector>
+
+/*
+ * Scales the lod ranges of one terrain object so the triangles it draws stay within a budget.
+ * The triangle count grows with the square of the ranges. The scale moves in discrete steps, down once the count
+ * was over budget for a few frames, up once it stayed clearly below for a while and one step up would still fit.
+ * In between nothing changes, so the lod does not flicker and the selection is only rebuilt on a step.
+ */
+class LodRangeController {
+public:
+    /* 0 turns the controller off, the scale returns to 1 */
+    void setBudget(int triangles);
+    int getBudget();
+    /* Takes the triangles drawn this frame, true if the scale changed */
+    bool update(int triangles);
+    float getRangeScale();
+    /*
+     * Scaled copy of baseRanges. The last range is the view distance and stays,
+     * the others are kept below half of the next one so the morph areas never vanish.
+     */
+    void scaleRanges(const std::vector<float> &baseRanges, std::vector<float> &ranges);
+
+private:
+    int budget_ = 0;
+    int step_ = 0;
+    int overBudgetFrames_ = 0;
+    int underBudgetFrames_ = 0;
+};
+
+/*
+ * Triangle budget shared by all terrain objects of a TerrainManager. With a frame time budget the triangle budget
+ * shrinks while frames take too long and recovers slowly once they are fast enough again.
+ */
+class TerrainBudget {
+public:
+    /* triangles 0 turns the budget off, frameTime 0 only limits the triangles. Seconds */
+    void setBudget(int triangles, float frameTime);
+    /* Takes the duration of the last frame in seconds and returns the triangles for the next one */
+    int update(float frameTime);
+    /* Splits triangles proportionally to the screen sizes of the objects */
+    static void split(int triangles, const std::vector<float> &screenSizes, std::vector<int> &budgets);
+
+private:
+    int triangles_ = 0;
+    float frameTime_ = 0.0f;
+    float smoothedFrameTime_ = 0.0f;
+    float factor_ = 1.0f; // Of triangles_ that frame time allows
+};
+#endif
@@ -7,7 +7,6 @@
 
 class Drawable;
 class Texture;
-class TerrainNode_;
 
 typedef std::vector<Drawable *> DrawableList;
 typedef std::vector<Texture> TextureList;
@@ -16,6 +15,9 @@ typedef std::unordered_map<int, std::vector<Texture>> IndexedTextureListMap;
 
 enum class TerrainType {DEFAULT, SPHERE, PLANE, CDLOD};
 
+/* Heightmaps, their textures and quad trees per terrain object. Streamed detail beyond this is evicted */
+const size_t DEFAULT_TERRAIN_MEMORY_BUDGET = 256 << 20;
+
 struct TerrainObjectAttributes {
     glm::vec3 bodyOrigin;
     float bodyRadius;
@@ -24,8 +26,14 @@ struct TerrainObjectAttributes {
     float atmosphereHeight;
     ShaderType waterShaderType;
     ShaderType landShaderType;
+    size_t memoryBudget = DEFAULT_TERRAIN_MEMORY_BUDGET; // Bytes
+    std::vector<float> *lodRanges = nullptr; // Morph range per lod level, CDLOD terrain looks them up in the shader
+    float maxPixelError = 0.0f; // Screen space error lod, nodes refine while their error projects to more pixels. 0 for distance only
 };
 
+/* Lod levels the terrain shader has ranges for */
+const int MAX_TERRAIN_LOD_LEVELS = 16;
+
 /*
  * Object contains all data for a single frame
  * GlobalTextureList contains textures which remain the same for all terrain draw calls this frame
@@ -50,6 +58,15 @@ struct TerrainObjectRenderData {
 
 typedef std::vector<TerrainObjectRenderData> TerrainRenderDataVector;
 
-typedef std::unordered_map<int, std::vector<TerrainNode_ *>> IndexedTerrainNodeListMap;
+/* A node picked by the lod selection, or a node that needs a more detailed heightmap */
+struct TerrainNodeInfo {
+    int heightMapIndex;
+    glm::vec2 position;
+    int size;
+    int lodLevel;
+    float range;
+};
+
+typedef std::unordered_map<int, std::vector<TerrainNodeInfo>> IndexedTerrainNodeListMap;
 
 #endif
\ No newline at end of file
@@ -9,16 +9,44 @@
 class TerrainMeshData;
 enum class GenerationType {PLANE_FLAT, PLANE, SPHERE_FLAT, SPHERE};
 
+/*
+ * Octaves with at least this many samples per wavelength are kept in the LowFrequencyField,
+ * they are smooth enough to be upsampled bicubically.
+ */
+const int LOW_FREQUENCY_SAMPLES_PER_WAVELENGTH = 8;
+/*
+ * Extra samples around the heightmap, so a child covering a quarter of it
+ * has the full bicubic stencil available, down to its own border.
+ */
+const int LOW_FREQUENCY_BORDER = 5;
+
+/*
+ * Sum of the low frequency octaves of a heightmap: height and world space gradient per sample.
+ * A finer heightmap inside the same area upsamples this field and only evaluates the octaves
+ * that are new at its spacing.
+ */
+struct LowFrequencyField {
+    glm::vec2 position; // Corner of the heightmap, without the border
+    int dimension = 0; // Samples per side, with the border
+    int sampleSpacing = 1;
+    int octaves = 0; // Octaves [0, octaves) are contained
+    std::vector<glm::vec4> samples;
+};
+
 struct GenerationAttributes {
     glm::vec2 position;
     glm::vec3 axis;
     int dimension;
     int lod;
+    int sampleSpacing = 1; // Distance between two heightmap samples, finer octaves are skipped
     GenerationType genType;
     bool isFlat = false;
     VertexType vertexType = VertexType::VERTEX_DEFAULT;
     std::vector<unsigned char> *heightData = nullptr;
     std::vector<unsigned char> *normalData = nullptr;
+    std::vector<unsigned char> *tiltData = nullptr; // Angle between normal and up, 0 to 255 for 0 to 90 degrees, rounded up
+    LowFrequencyField *lowFrequencyData = nullptr; // Filled if set, for later refinement
+    const LowFrequencyField *parentLowFrequencyData = nullptr; // Upsampled instead of evaluating its octaves again
 };
 
 class TerrainGenerator {
@@ -44,10 +72,16 @@ class TerrainGenerator {
     int sphereRadius_ = 0;
     glm::vec3 sphereOrigin_ = glm::vec3(0,0,0);
 
-    void generateTerrainHeightMapData(TerrainMeshData &meshData, glm::vec2 &pos, int numVertsPerLine, int skipIncrement, glm::vec3 &axis, bool isFlat);
     void generateTerrainMeshData(TerrainMeshData &meshData, glm::vec2 &pos, int dimension, int lod, glm::vec3 &axis, bool flat);
     glm::vec3 getVertexPosition(glm::vec3 vertPos, float height);
     glm::vec3 getAxisPos(glm::vec3 &axis, int x, int y);
     float getHeightValue(glm::vec3 &pos);
+    void getRowPositions(glm::vec3 &axis, int x0, int y, int count, int spacing, std::vector<glm::vec3> &positions);
+    void getRowNoise(std::vector<glm::vec3> &positions, int count, int firstOctave, int octaves, std::vector<glm::vec4> &noise);
+    glm::vec3 getNoiseNormal(glm::vec3 &position, glm::vec4 &noise);
+    void generateLowFrequencyField(GenerationAttributes *attr, const LowFrequencyField *parent, LowFrequencyField *field);
+    void getCatmullRomStencil(int parentDimension, float coord, glm::ivec4 &indices, glm::vec4 &weights);
+    void upsampleLowFrequencyField(const LowFrequencyField *parent, LowFrequencyField *field, int x0, int y0);
+    unsigned char mapRangeToUnsignedByte(float inVal, float lowerBound, float upperBound);
 };
 #endif
\ No newline at end of file
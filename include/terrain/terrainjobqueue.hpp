@@ -0,0 +1,52 @@
+#ifndef TERRAINJOBQUEUE_HPP
+#define TERRAINJOBQUEUE_HPP
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+
+class ThreadPool;
+
+/*
+ * Terrain generation jobs waiting for the thread pool, most important first.
+ * The pool knows nothing about priorities, so jobs are only handed over while fewer than maxInFlight of them run.
+ * The rest waits here, where the owner recomputes the priorities every frame and drops jobs nobody needs anymore.
+ * Speculative jobs, like prefetches, only start after all others and never take more than maxSpeculative slots.
+ * Main thread only, the jobs themselves run on the pool.
+ */
+class TerrainJobQueue {
+public:
+    /* Priority of the job with id, higher runs first. A negative priority cancels the job */
+    typedef std::function<float(int id, bool &speculative)> PriorityFunction;
+
+    /* Without a pool, dispatch runs the jobs inline */
+    TerrainJobQueue(ThreadPool *pool, int maxInFlight, int maxSpeculative);
+    void push(int id, float priority, bool speculative, std::function<void()> job);
+    /* Recomputes the priorities of all queued jobs and removes the cancelled ones, their ids are appended to cancelled */
+    void update(const PriorityFunction &getPriority, std::vector<int> &cancelled);
+    /* Removes the queued job with id. False if it is unknown or was already started */
+    bool cancel(int id);
+    /* Starts the most important jobs until maxInFlight run */
+    void dispatch();
+    void setMaxInFlight(int maxInFlight, int maxSpeculative);
+    int getQueuedCount();
+    int getInFlightCount();
+    int getSpeculativeInFlightCount();
+
+private:
+    struct QueuedJob {
+        int id;
+        float priority;
+        bool speculative;
+        std::function<void()> job;
+    };
+
+    ThreadPool *pool_;
+    int maxInFlight_;
+    int maxSpeculative_;
+    std::vector<QueuedJob> jobs_;
+    std::shared_ptr<std::atomic<int>> inFlight_; // Started jobs may finish after the queue is gone
+    std::shared_ptr<std::atomic<int>> speculativeInFlight_;
+};
+#endif
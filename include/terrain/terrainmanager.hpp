@@ -6,6 +6,19 @@
 #include "view.hpp"
 #include "terraindatatypes.hpp"
 
+#include <set>
+#include <tuple>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <functional>
+#include "mpscqueue.hpp"
+#include "slotarray.hpp"
+#include "framearena.hpp"
+#include "instancering.hpp"
+#include "terrainjobqueue.hpp"
+#include "terrainbudget.hpp"
+
 class BaseDrawData : public TerrainDrawData {
 public:
     BaseDrawData() {
@@ -33,7 +46,16 @@ class TerrainObject {
 public:
     //TODO: Refactor, should be called something like provideFrameRenderData
   virtual ~TerrainObject() {}
+  /*
+   * Thread safe part of the frame update, each job may run on any thread.
+   * update is called after all jobs of all terrain objects finished.
+   */
+  virtual void addSelectionJobs(View *view, std::vector<std::function<void()>> &jobs) {}
   virtual void update(View *view, TerrainObjectRenderData *terrainObjectRenderData) = 0;
+  /* Triangles the object should draw per frame, 0 for fixed lod ranges */
+  virtual void setTriangleBudget(int triangles) {}
+  /* Fraction of the screen height the object covers, its share of the triangle budget. 0 takes no share */
+  virtual float getScreenSize(View *view) { return 0.0f; }
 };
 
 class TerrainManager {
@@ -43,6 +65,11 @@ public:
     ~TerrainManager();
 
     void addTerrainObject(TerrainObject *obj);
+    /*
+     * Triangles all terrain objects may draw per frame, split by their screen size. 0 keeps the lod ranges fixed.
+     * With a frame time in seconds the budget shrinks while frames take longer.
+     */
+    void setTriangleBudget(int triangles, float frameTime = 0.0f);
     void update(View *view);
     TerrainRenderDataVector &getTerrainRenderData();
     TerrainType getType();
@@ -51,6 +78,10 @@ private:
     TerrainType type_;
     std::vector<TerrainObject *> terrainObjectList_;
     TerrainRenderDataVector terrainObjectRenderDataVector_;
+    std::vector<std::function<void()>> selectionJobs_; // Reused every frame
+    TerrainBudget budget_;
+    std::vector<float> screenSizes_; // Parallel to terrainObjectList_
+    std::vector<int> objectBudgets_;
 };
 
 class TerrainChunkTree : public TerrainObject {
@@ -85,58 +116,38 @@ public:
   TextureList globalTextureList;
 };
 
-struct MeshInstanceData {
-    IndexedDrawableListMap baseMeshListMap;
-    std::unordered_map<int, std::vector<glm::vec3>> instanceAttribListMap;
-    std::unordered_map<int, VertexAttributeData> instanceAttributeDataMap;
-    std::vector<glm::vec3>::iterator attribIt;
-    std::vector<glm::vec3> *currAttribVec;
-    Drawable *currBaseMesh;
-
-    void createNewInstance(int mapIndex) {
-        if (baseMeshListMap.find(mapIndex) == baseMeshListMap.end()) {
-            fprintf(stdout, "[MESHINSTANCEDATA::createNewInstance] Error: New instance has no base mesh\n");
-            return;
-        }
-
-        instanceAttribListMap[mapIndex];
-        instanceAttributeDataMap[mapIndex];
-    }
-
-    void updateInstanceSize(int mapIndex, int size) {
-        baseMeshListMap[mapIndex][0]->updateInstanceSize(size);
-        instanceAttribListMap[mapIndex].resize(size);
-        VertexAttributeData *instanceAttribs = &instanceAttributeDataMap[mapIndex];
-        instanceAttribs->size = size;
-        instanceAttribs->numElements = 3;
-        instanceAttribs->sizeOfDataType = sizeof(glm::vec3);
-
-        currBaseMesh = baseMeshListMap[mapIndex][0];
-        currAttribVec = &instanceAttribListMap[mapIndex];
-        //attribIt = currAttribVec->begin();
-    }
-
-    void insertModelMatrix(int instanceIndex, glm::vec3 *scale, glm::vec3 *translate, glm::vec3 *rotate, float degree) {
-        currBaseMesh->transform(instanceIndex, scale, translate, rotate, degree);
-    }
-
-    void insertAttribute(int instanceIndex, float x, float y, float z) {
-        //currAttribVec->emplace(attribIt, x, y, z);
-        //++attribIt;
-        (*currAttribVec)[instanceIndex] = glm::vec3(x,y,z);
-    }
+/*
+ * One selected node as the terrain shader sees it. The shader builds the model matrix from the cube side
+ * and looks up the morph ranges by lod level, so 16 bytes per node are enough.
+ */
+struct TerrainInstance {
+    glm::vec2 position; // Node corner on its cube side, or on the plane
+    float scale; // Node size in base mesh sizes
+    unsigned int lodFace; // Lod level in the low byte, cube side (0 to 5 for +x, -x, +y, -y, +z, -z) above
+};
 
-    void finishInstance(int mapIndex) {
-        instanceAttributeDataMap[mapIndex].data = static_cast<void *>(currAttribVec->data());
-        currBaseMesh->updateMeshInstances(&instanceAttributeDataMap[mapIndex]);
+/* All slot arrays are indexed by heightmap index */
+struct MeshInstanceData {
+    SlotArray<DrawableList> baseMeshListMap;
+    SlotArray<std::vector<TerrainInstance>> instanceListMap; // Parallel to the tree's selection
+    SlotArray<int> ringGenerationMap; // Of the instance ring the base meshes point to, 0 for none yet
+
+    /* Deletes the base meshes and the instance data of mapIndex */
+    void removeInstance(int mapIndex) {
+        for (Drawable *d : baseMeshListMap[mapIndex])
+            delete d;
+        baseMeshListMap.erase(mapIndex);
+        instanceListMap.erase(mapIndex);
+        ringGenerationMap.erase(mapIndex);
     }
 };
 
+/* Slot arrays are indexed by heightmap index */
 struct CdlodTreeData {
-    std::vector<TerrainNode_ *> *rootNodes;
-    std::unordered_map<int, HeightMap *> *heightMaps;
-    IndexedTextureListMap *heightMapTextures;
-    IndexedDrawableListMap *baseMeshListMap;
+    std::vector<TerrainQuadTree *> *rootNodes;
+    SlotArray<HeightMap *> *heightMaps;
+    SlotArray<TextureList> *heightMapTextures;
+    SlotArray<DrawableList> *baseMeshListMap;
     TextureList *globalTextureList;
     std::vector<float> *ranges;
     int *heightMapIndex;
@@ -152,78 +163,198 @@ class CdlodTreeImplementation {
 public:
     /* Fill CdlodTreeData */
     virtual void createTree(CdlodTreeData &treeData) = 0;
-    /* Called when a child requires a new heightmap */
-    virtual void updateRootNodes(CdlodTreeData &treeData, std::vector<TerrainNode_ *> &heightMapDemandList) = 0;
+    /*
+     * Called on the thread pool when a leaf on the heightmap parent needs more detail. Generates the heightmap
+     * refining the leaf and a quad tree over it. No GL calls, the textures are uploaded on the main thread.
+     */
+    virtual TerrainQuadTree *createChildNode(CdlodTreeData &treeData, HeightMap *parent, TerrainNodeInfo &leaf, int index,
+                                             HeightMap **heightMap) = 0;
+    /* Writes the position each root node should have for cameraPosition into targets, in root node order. Roots stay by default */
+    virtual void getRootNodeTargets(const glm::vec3 &cameraPosition, std::vector<glm::vec2> &targets) {}
+    /*
+     * Called on the thread pool once the root at the old position lost all its children.
+     * Regenerates heightMap and tree at pos in place, the textures are overwritten on the main thread.
+     */
+    virtual void moveRootNode(CdlodTreeData &treeData, HeightMap *heightMap, TerrainQuadTree *tree, glm::vec2 pos) {}
 };
 
 class PlanetCdlodImplementation : public CdlodTreeImplementation {
 public:
     PlanetCdlodImplementation(TerrainGenerator *terrainGen, TerrainObjectAttributes *terrainAttribs);
     void createTree(CdlodTreeData &treeData);
-    void updateRootNodes(CdlodTreeData &treeData, std::vector<TerrainNode_ *> &heightMapDemandList);
+    TerrainQuadTree *createChildNode(CdlodTreeData &treeData, HeightMap *parent, TerrainNodeInfo &leaf, int index, HeightMap **heightMap);
 private:
     int rootNodeDimension_;
     TerrainObjectAttributes *planetAttributes_;
     TerrainGenerator *terrainGen_;
 
     void createRootNode(CdlodTreeData &treeData, glm::vec2 &cornerPos, glm::vec3 &axis);
+    void setSphere(TerrainQuadTree *tree, HeightMap *heightMap);
     glm::vec2 vec3ToVec2CubeSide(glm::vec3 &pos, glm::vec3 &axis);
 };
 
+/*
+ * Ring of ringSize * ringSize root nodes around the camera. A root the camera left behind wraps around to the
+ * opposite edge, root (x, y) always covers the cell that is congruent to (x, y) modulo ringSize.
+ * Its heightmap is regenerated into the same buffers and textures, so the plane never ends and never grows.
+ */
 class PlaneCdlodImplementation : public CdlodTreeImplementation {
 public:
     PlaneCdlodImplementation(TerrainGenerator *terrainGen, TerrainObjectAttributes *terrainAttribs);
     void createTree(CdlodTreeData &treeData);
-    /* TODO: Make changes in treeData thread safe. Need mutex for treeData.rootNodes */
-    void updateRootNodes(CdlodTreeData &treeData, std::vector<TerrainNode_ *> &heightMapDemandList);
+    TerrainQuadTree *createChildNode(CdlodTreeData &treeData, HeightMap *parent, TerrainNodeInfo &leaf, int index, HeightMap **heightMap);
+    void getRootNodeTargets(const glm::vec3 &cameraPosition, std::vector<glm::vec2> &targets);
+    void moveRootNode(CdlodTreeData &treeData, HeightMap *heightMap, TerrainQuadTree *tree, glm::vec2 pos);
 private:
     int rootNodeDimension_;
+    int ringRadius_; // Root nodes between the camera's and the ring's edge
+    int ringSize_;
     TerrainGenerator *terrainGen_;
     TerrainObjectAttributes *planeAttributes_;
-    void createRootNode(CdlodTreeData &treeData, glm::vec2 pos);
+    void createRootNode(CdlodTreeData &treeData, HeightMap *heightMap, glm::vec2 pos);
+    glm::ivec2 getRingCell(glm::ivec2 cameraCell, int x, int y);
 };
 
 /*
- * Needs a background thread as garbage collector:
- * Need to remove instances in MeshInstanceData if the corresponding heightmap and drawable have been deleted
- * during a call to ->updateRootNodes();
+ * Root heightmaps are created up front, finer child heightmaps are streamed in on the thread pool.
+ * Children that were not drawn for a while are evicted again once the memory budget is exceeded.
+ * Roots the implementation moves are regenerated on the pool as well, after their children were evicted.
  */
 class CdlodTree : public TerrainObject {
 public:
   CdlodTree(CdlodTreeImplementation *imple, TerrainObjectAttributes *attribs);
   ~CdlodTree() override;
 
+  /* One job per root node, each selects into its own buffer. update merges them in root node order */
+  void addSelectionJobs(View *view, std::vector<std::function<void()>> &jobs) override;
   void update(View *view, TerrainObjectRenderData *terrainObjectRenderData) override;
+  void setTriangleBudget(int triangles) override;
+  float getScreenSize(View *view) override;
   
 private:
+    struct TreeSelection {
+        TerrainQuadTree *tree;
+        bool changed;
+        int first; // Changed range of the tree's selection
+        int end;
+    };
+
+    /* Output of one root node's selection job */
+    struct RootSelection {
+        std::vector<TreeSelection> trees; // The root and its active children, depth first
+        std::vector<TerrainNodeInfo> creationList;
+        std::vector<TerrainNodeInfo> prefetchList; // Leaves refined at the predicted camera positions
+        IndexedTerrainNodeListMap prefetchNodes; // Unused output of the speculative selection
+    };
+
+    /* A generated child heightmap and its quad tree, waiting for the main thread */
+    struct StreamedNode {
+        int parentIndex; // -1 - root node index for moved root nodes
+        glm::vec2 leafPosition;
+        HeightMap *heightMap;
+        TerrainQuadTree *tree;
+        Drawable *plane; // Base mesh of a child, nullptr for moved roots
+    };
+
+    /* A streamed child tree. Roots are never evicted */
+    struct StreamedTree {
+        int parentIndex = -1; // -1 for slots without a streamed tree
+        glm::vec2 leafPosition;
+        size_t memoryUsage;
+        int lastUsedFrame;
+        int childCount; // Attached children, only childless trees are evicted
+    };
+
+    /* Arguments of one root node's selection job, they live in the frame arena */
+    struct SelectionJob {
+        int rootIndex;
+        glm::vec3 cameraPosition;
+        const Frustum *frustum;
+    };
+
+    /* Shared with the generation jobs and their uploads, which may outlive a frame */
+    struct StreamingState {
+        MpscQueue<StreamedNode> completed; // Uploaded
+        std::atomic<bool> cancelled{false};
+        std::atomic<int> running{0}; // Jobs between their cancellation check and the push
+    };
+
     int leafNodeSize_;
-    int heightMapIndex_;
+    int heightMapIndex_ = 0;
     int lodLevelCount_;
-    std::vector<float> ranges_;
-    std::vector<TerrainNode_ *> rootNodeList_; // List of root nodes
-    std::unordered_map<int, HeightMap *> heightMaps_; // List of heightmaps
-    IndexedTextureListMap heightMapTextures_; // Map of Texture lists with heightmap + normalmap
+    std::vector<float> ranges_; // baseRanges_ scaled by the range controller
+    std::vector<float> baseRanges_; // As the implementation created them
+    LodRangeController rangeController_;
+    float rangeScale_ = 1.0f; // Applied to ranges_
+    int triangleCount_ = 0; // Drawn last frame
+    float errorToRange_ = 0.0f; // Of the current selection, see TerrainQuadTree::getErrorToRange
+    bool refineRangesDirty_ = true; // Trees, ranges or errorToRange_ changed since updateRefineRanges
+    std::unordered_map<long long, TerrainQuadTree *> rootCells_; // Plane roots by cell, for updateRefineRanges
+    std::vector<TerrainQuadTree *> rootNodeList_; // One quad tree per root heightmap
+    SlotArray<HeightMap *> heightMaps_; // List of heightmaps
+    SlotArray<TextureList> heightMapTextures_; // Texture lists with heightmap + normalmap
+    std::vector<int> freeHeightMapIndices_; // Of evicted or cancelled children, reused before new ones
     CdlodDrawData landDrawData_; // out draw data for land
     CdlodDrawData waterDrawData_; // out draw data for water
-    IndexedTerrainNodeListMap selectedNodes_; // Map filled each frame with TerrainNodes in range
     MeshInstanceData meshInstanceData_; // Data structures for mesh instances
+    InstanceRing instanceRing_; // Instances of all trees drawn this frame, in draw order
     CdlodTreeData publicTreeData_; // struct to pass the relevant tree data to the implementing class
-    std::vector<TerrainNode_ *> heightMapCreationList_; // List filled by node->lodSelect, heightMaps that need to be created
+    std::vector<TerrainNodeInfo> heightMapCreationList_; // Leaves that asked for a child heightmap this frame
     TerrainObjectAttributes *terrainAttributes_; // Attributes provided by Constructor
     CdlodTreeImplementation *treeImplementation_;
+    std::vector<RootSelection> rootSelections_; // Parallel to rootNodeList_
+    bool selectionScheduled_ = false;
+    std::vector<std::function<void()>> selectionJobs_; // Only without TerrainManager
+    FrameArena frameArena_; // Reset when the selection of a new frame starts
+    SlotArray<TerrainQuadTree *> quadTrees_; // Root and child trees by heightmap index
+    std::vector<TerrainQuadTree *> activeTrees_; // Trees drawn last frame, in draw order
+    std::vector<TerrainQuadTree *> nextActiveTrees_;
+    std::shared_ptr<StreamingState> streaming_;
+    std::set<std::tuple<int, int, int>> requestedLeaves_; // Heightmap index and position of leaves being refined
+    std::unordered_map<int, TerrainNodeInfo> requestedNodes_; // Requested leaves by the index of their child heightmap
+    TerrainJobQueue jobQueue_;
+    std::vector<int> cancelledRequests_;
+    SlotArray<StreamedTree> streamedTrees_; // By heightmap index
+    size_t memoryUsage_ = 0;
+    int frame_ = 0;
+    bool hasCameraPosition_ = false;
+    glm::vec3 lastCameraPosition_;
+    glm::vec3 cameraVelocity_ = glm::vec3(0.0f); // Smoothed, world units per second
+    std::vector<glm::vec3> predictedPositions_; // Empty while the camera is too slow to prefetch
+    SlotArray<int> rootIndices_; // Root node index by heightmap index
+    std::vector<glm::vec2> rootPositions_; // Parallel to rootNodeList_, where the root's textures are
+    std::vector<glm::vec2> rootTargets_; // Where the implementation wants the root, differs while it moves
+    std::vector<bool> movingRoots_; // Regenerating on the pool, not selected until the upload
 
     void init();
-    void handleRootNodeUpdate(std::vector<TerrainNode_ *> creationList);
-    glm::vec3 vec2ToVec3CubeSide(glm::vec2 &pos, glm::vec3 &axis);
-    glm::vec3 getRotationAxis(glm::vec3 &axis, float *degree);
-    float getPrevRange(int lodLevel);
+    void selectRootNode(int index, glm::vec3 cameraPosition, const Frustum *frustum);
+    void selectTree(TerrainQuadTree *tree, RootSelection &selection, const glm::vec3 &cameraPosition, const Frustum *frustum);
+    static void postUpload(std::shared_ptr<StreamingState> streaming, StreamedNode node);
+    void finishStreamedNodes();
+    void requestChildNodes(const glm::vec3 &cameraPosition);
+    void moveRootNodes(const glm::vec3 &cameraPosition);
+    bool clearRootNode(int heightMapIndex);
+    int getRootIndex(int heightMapIndex);
+    void predictCamera(const glm::vec3 &cameraPosition);
+    float getRequestPriority(TerrainNodeInfo &leaf, const glm::vec3 &cameraPosition, bool &speculative);
+    bool hasPendingRequests(int heightMapIndex);
+    void evictHeightMaps();
+    void evictTree(int heightMapIndex);
+    void writeInstances();
+    void applyRangeScale();
+    void updateRefineRanges();
+    float getOuterRefineRange(TerrainQuadTree *root, int lodLevel, const glm::vec2 &pos);
+    unsigned int getTerrainFace(const glm::vec3 &axis);
 };
 
 class Planet : public TerrainObject {
 public:
-    Planet(TerrainGenerator *terrainGen);
+    Planet(TerrainGenerator *terrainGen, size_t memoryBudget = DEFAULT_TERRAIN_MEMORY_BUDGET, float maxPixelError = 0.0f);
     ~Planet() override;
+    void addSelectionJobs(View *view, std::vector<std::function<void()>> &jobs) override;
     void update(View *view, TerrainObjectRenderData *terrainObjectRenderData) override;
+    void setTriangleBudget(int triangles) override;
+    float getScreenSize(View *view) override;
 
 private:
     CdlodTree *lodTree_;
@@ -235,9 +366,12 @@ private:
 
 class EndlessPlane : public TerrainObject {
 public:
-    EndlessPlane(TerrainGenerator *terrainGen);
+    EndlessPlane(TerrainGenerator *terrainGen, size_t memoryBudget = DEFAULT_TERRAIN_MEMORY_BUDGET, float maxPixelError = 0.0f);
     ~EndlessPlane() override;
+    void addSelectionJobs(View *view, std::vector<std::function<void()>> &jobs) override;
     void update(View *view, TerrainObjectRenderData *terrainObjectRenderData) override;
+    void setTriangleBudget(int triangles) override;
+    float getScreenSize(View *view) override;
 
 private:
     CdlodTree *lodTree_;
@@ -2,9 +2,15 @@
 #define TERRAINNODE_H
 
 #include <array>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <glm/glm.hpp>
 #include "terraintile.hpp"
 #include "heightmap.hpp"
 #include "terraindatatypes.hpp"
+#include "mathutils.hpp"
+#include "frustum.hpp"
 
 /*
  * Terrainchunk used in the Quad tree.
@@ -50,33 +56,184 @@ class TerrainNode {
     TerrainTile *water_;
 };
 
-class View;
-
-class TerrainNode_ {
+/*
+ * Implicit CDLOD quad tree over a single heightmap.
+ * There are no node objects: each lod level is one row major array of 16 bit min/max heights,
+ * the children of node (x, y) on a level are (2x..2x+1, 2y..2y+1) on the level below.
+ * Node positions and sizes follow from the index, the only flag is one bit per leaf.
+ */
+class TerrainQuadTree {
 public:
-    TerrainNode_(HeightMap *heightMap, int nodeDimension, int lod, glm::vec2 pos);
-    ~TerrainNode_();
-    bool lodSelect(std::vector<float> &ranges, int lodLevel, View *view, IndexedTerrainNodeListMap &nodeMap, std::vector<TerrainNode_ *> &creationList);
-    float getNodeMaxHeight();
-    float getNodeMinHeight();
+    /* Node indices are ints, so a tree can't be deeper */
+    static const int MAX_LEVELS = 30;
+    /* Levels above the cached blocks, the tree has at most 4^BLOCK_DEPTH blocks */
+    static const int BLOCK_DEPTH = 3;
+
+    typedef std::function<void(glm::vec2 &pos, int dimension, float *minHeight, float *maxHeight)> BoundsFunction;
+    typedef std::function<float(glm::vec2 &pos, int dimension)> TiltFunction;
+    typedef std::function<float(int lodLevel, const glm::vec2 &pos)> RefineRangeFunction;
+
+    /*
+     * The root at pos covers dimension world units with lod level lodLevelCount - 1.
+     * Leaves have leafLodLevel, if that is above 0 they are put on the creation list once selection wants to go deeper.
+     * getBounds is called once per node, see HeightMap::getMaxMinValuesFromArea.
+     * With a meshSize, the quads per side of the mesh drawn for a node, each node also gets a geometric error
+     * for the screen space error selection. That calls getBounds once per quad of every node.
+     */
+    TerrainQuadTree(int heightMapIndex, glm::vec2 pos, int dimension, int lodLevelCount, BoundsFunction getBounds,
+                    int leafLodLevel = 0, int meshSize = 0);
+    /*
+     * Appends the selected nodes to nodeMap[heightMapIndex], in the same order as a depth first recursion.
+     * Active children append to their own index afterwards. Without a frustum nothing is culled.
+     * A node is refined while the camera is within the range of the next lod level,
+     * or with screen space error within its own refine range, see updateRefineRanges.
+     */
+    void lodSelect(std::vector<float> &ranges, const glm::vec3 &cameraPosition, const Frustum *frustum, IndexedTerrainNodeListMap &nodeMap,
+                   std::vector<TerrainNodeInfo> &creationList);
+    /*
+     * Frame coherent version of lodSelect, the result is kept in getSelection().
+     * Subtrees below the top BLOCK_DEPTH levels cache their selection together with the distance the camera may move
+     * before any of their range or horizon decisions can flip. Only blocks the camera moved out of,
+     * or that intersect a changed frustum, are selected again. Returns false if the selection did not change,
+     * otherwise [first, end) is the range of entries that differ from the last call.
+     */
+    bool updateSelection(std::vector<float> &ranges, const glm::vec3 &cameraPosition, const Frustum *frustum,
+                         std::vector<TerrainNodeInfo> &creationList, int *first, int *end);
+    /*
+     * Factor from geometric error to the distance at which it projects to maxPixelError pixels,
+     * for a viewport screenHeight pixels high. projectionScale is element [1][1] of the projection matrix.
+     */
+    static float getErrorToRange(float projectionScale, int screenHeight, float maxPixelError);
+    /*
+     * Screen space error: each node on lodLevel refines within its geometric error times errorToRange,
+     * at most within the range of the next level, so nodes whose error projects to few pixels stay coarse.
+     * The range is raised until the node refines wherever a touching node one level finer does,
+     * which keeps neighbours within one lod level. Those finer nodes come from this tree and its children,
+     * outside the tree from getOuterRange, negative where there are none. Levels have to be updated from the finest up,
+     * over all trees that touch. The selection is invalidated if a range changed.
+     */
+    void updateRefineRanges(int lodLevel, const std::vector<float> &ranges, float errorToRange, const RefineRangeFunction &getOuterRange);
+    /* All levels of a tree without neighbours. An errorToRange of 0 goes back to the distance ranges */
+    void updateRefineRanges(const std::vector<float> &ranges, float errorToRange);
+    /* Of the node on lodLevel at pos, looked up in the children below the leaves. Negative if there is none */
+    float getRefineRange(int lodLevel, const glm::vec2 &pos);
+    std::vector<TerrainNodeInfo> &getSelection();
+    /* Child trees that cover leaves in the last selection, in selection order. They select their own nodes */
+    std::vector<TerrainQuadTree *> &getActiveChildren();
+    /*
+     * child refines the leaf at leafPosition with a more detailed heightmap. Once the selection wants to go
+     * below that leaf, the leaf is left out and the child becomes active instead. The tree does not own child.
+     */
+    void attachChild(const glm::vec2 &leafPosition, TerrainQuadTree *child);
+    /* Removes the child at leafPosition again, the leaf asks for a new one once it wants more detail */
+    void detachChild(const glm::vec2 &leafPosition);
+    /* The leaf at leafPosition goes on the creation list again the next time it wants more detail */
+    void unscheduleLeaf(const glm::vec2 &leafPosition);
+    /* Distance from cameraPosition to the box of the leaf at leafPosition, measured like the selection does */
+    float getLeafDistance(const glm::vec2 &leafPosition, const glm::vec3 &cameraPosition);
+    /* Forces the next updateSelection to select everything again, e.g. after the ranges changed */
+    void invalidateSelection();
+    /*
+     * Moves the tree to pos and reads all bounds again, once its heightmap was regenerated there.
+     * Keeps the allocations. Children have to be detached before, sphere tilts are not read again.
+     */
+    void moveTo(const glm::vec2 &pos);
+    /*
+     * Marks the tree as a cube side of a planet, positions map to the sphere like TerrainGenerator::getAxisPos.
+     * Selection then skips nodes behind the horizon of a sphere with occluderRadius, which no terrain pokes below,
+     * and nodes whose surface faces away from the camera. getMaxTilt is called once per node, see HeightMap::getMaxTiltFromArea.
+     */
+    void setSphere(const glm::vec3 &axis, const glm::vec3 &origin, float radius, float occluderRadius, TiltFunction getMaxTilt);
+    int getHeightMapIndex();
     glm::vec2 &getPosition();
-    float getRange();
     int getSize();
-    int getLodLevel();
-    
+    int getNodeCount();
+    /* Bytes held by the nodes and the cached selection */
+    size_t getMemoryUsage();
+    float getMinHeight();
+    float getMaxHeight();
+    /* Geometric error of the node at nodePosition on tree level level, 0 without a mesh size */
+    float getNodeError(int level, const glm::vec2 &nodePosition);
+
 private:
-    glm::vec2 nodePos_;
-    int nodeDimension_;
-    int lodLevel_;
-    float nodeMaxHeight_ = 0;
-    float nodeMinHeight_ = 0;
-    int heightMapIndex_; // We need a mutex for this
-    std::array<TerrainNode_ *, 4> children_{nullptr};
-    void createChildren(HeightMap *heightMap, int dim, int lod);
-    void insertNode(IndexedTerrainNodeListMap &nodeMap, TerrainNode_ *node);
-    float currentLodRange_;
-
-    bool childrenCreationScheduled_ = false;
-    bool childrenCreated_ = false; // We need a mutex for this
+    struct NodeBounds {
+        unsigned short minHeight;
+        unsigned short maxHeight;
+    };
+
+    struct Level {
+        int nodesPerSide;
+        float nodeSize;
+        std::vector<NodeBounds> nodes; // Row major
+        std::vector<unsigned char> maxTilts; // Per node, 0 to 255 for 0 to 90 degrees, only on spheres
+        std::vector<unsigned short> errors; // Per node, quantized like the heights, only with a mesh size
+        std::vector<float> refineRanges; // Per node, only with screen space error
+    };
+
+    struct StackEntry {
+        int level;
+        int x;
+        int y;
+        unsigned char planeMask; // Frustum planes the node intersects
+    };
+
+    /* Cached selection of the subtree below one node on blockLevel_ */
+    struct Block {
+        bool valid = false;
+        glm::vec3 cameraPosition;
+        float slack; // The camera may move this far from cameraPosition without changing nodes
+        unsigned char planeMask; // Of the block root when it was selected
+        std::vector<TerrainNodeInfo> nodes;
+        std::vector<TerrainQuadTree *> children;
+    };
+
+    struct SelectionContext {
+        std::vector<float> *ranges;
+        glm::vec3 cameraPosition;
+        const Frustum *frustum;
+        std::vector<TerrainNodeInfo> *creationList;
+        bool frustumChanged;
+        float slack; // Smallest slack of everything selected this frame, relative to cameraPosition
+    };
+
+    int heightMapIndex_;
+    glm::vec2 position_;
+    int dimension_;
+    BoundsFunction getBounds_;
+    int leafLodLevel_;
+    int meshSize_;
+    float heightOffset_; // Height of the quantized value 0
+    float heightScale_; // World units per quantization step
+    std::vector<Level> levels_; // levels_[i] has lod level leafLodLevel_ + i
+    std::vector<bool> leafScheduled_; // Leaves already on the creation list
+    std::unordered_map<int, TerrainQuadTree *> children_; // By leaf index
+    bool coversParentLeaf_ = false; // The root is never skipped, the parent tree relies on it
+    int rootCullPlane_ = 0; // Plane that culled the root last time, tested first
+    glm::vec3 sphereAxis_;
+    glm::vec3 sphereOrigin_;
+    float sphereRadius_ = 0.0f; // 0 for flat terrain
+    float occluderRadius_ = 0.0f;
+    int blockLevel_;
+    std::vector<Block> blocks_; // Row major on blockLevel_
+    std::vector<TerrainNodeInfo> selection_;
+    std::vector<TerrainNodeInfo> nextSelection_;
+    std::vector<TerrainQuadTree *> activeChildren_;
+    std::vector<TerrainQuadTree *> nextActiveChildren_;
+    bool selectionValid_ = false;
+    glm::vec3 selectionCamera_;
+    float selectionSlack_ = 0.0f;
+    bool selectionHadFrustum_ = false;
+    Frustum selectionFrustum_;
+
+    void getNodeBox(StackEntry &node, glm::vec3 &min, glm::vec3 &max);
+    bool getLeaf(const glm::vec2 &leafPosition, StackEntry &leaf);
+    void readBounds();
+    void readErrors();
+    glm::vec3 getSphereDirection(float x, float y);
+    bool isHidden(StackEntry &node, float minHeight, float maxHeight, const glm::vec3 &cameraPosition, float *slack);
+    void selectNodes(StackEntry start, int blockLevel, SelectionContext &context, std::vector<TerrainNodeInfo> &selected,
+                     std::vector<TerrainQuadTree *> &children, float *slack);
+    void selectBlock(StackEntry &node, SelectionContext &context, std::vector<TerrainNodeInfo> &selected,
+                     std::vector<TerrainQuadTree *> &children);
 };
 #endif
\ No newline at end of file
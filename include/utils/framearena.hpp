@@ -0,0 +1,52 @@
+#ifndef FRAMEARENA_HPP
+#define FRAMEARENA_HPP
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+#include <type_traits>
+
+/*
+ * Linear allocator for data that only lives until the next frame starts.
+ * allocate bumps a pointer, reset frees everything at once. Running out of space adds a block,
+ * the next reset replaces all blocks by one that holds the whole frame, so after a few frames the heap is not touched anymore.
+ * Destructors are never called. Not thread safe.
+ */
+class FrameArena {
+public:
+    explicit FrameArena(size_t capacity = 16 << 10);
+    ~FrameArena();
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    void *allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+    /* Everything allocated since the last reset becomes invalid */
+    void reset();
+    /* Bytes allocated since the last reset */
+    size_t getUsed();
+    size_t getCapacity();
+
+    template <typename T>
+    T *allocate(int count) {
+        static_assert(std::is_trivially_destructible<T>::value, "FrameArena never calls destructors");
+        return static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    template <typename T, typename... Args>
+    T *create(Args &&... args) {
+        static_assert(std::is_trivially_destructible<T>::value, "FrameArena never calls destructors");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+private:
+    struct Block {
+        char *data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks_; // The last one is allocated from
+    size_t offset_ = 0; // In the last block
+    size_t used_ = 0; // By the full blocks before the last one
+};
+#endif
@@ -0,0 +1,34 @@
+#ifndef FRUSTUM_HPP
+#define FRUSTUM_HPP
+
+#include <glm/glm.hpp>
+
+/*
+ * Box tests return the planes the box still intersects as bits, so children of a box
+ * only need to test those. 0 means fully inside, FRUSTUM_OUTSIDE means culled.
+ */
+const unsigned char FRUSTUM_ALL_PLANES = 0x3f;
+const unsigned char FRUSTUM_OUTSIDE = 0x80;
+
+class Frustum {
+public:
+    /* Accepts everything until the planes are extracted */
+    Frustum();
+    /* Gribb/Hartmann extraction from an OpenGL projection * view matrix, the planes are in world space */
+    void extractPlanes(const glm::mat4 &viewProjection);
+    /*
+     * Tests the planes in planeMask. If coherentPlane is given, that plane is tested first
+     * and set to the plane that culled the box, so a box culled last frame is usually rejected with one test.
+     */
+    unsigned char testBox(const glm::vec3 &min, const glm::vec3 &max, unsigned char planeMask = FRUSTUM_ALL_PLANES,
+                          int *coherentPlane = nullptr) const;
+    /* Same as testBox for count boxes in SoA layout, four at a time with SSE */
+    void testBoxes(const float *minX, const float *minY, const float *minZ, const float *maxX, const float *maxY, const float *maxZ,
+                   int count, unsigned char planeMask, unsigned char *results) const;
+    /* xyz is the normal pointing inside, w the distance. Left, right, bottom, top, near, far */
+    const glm::vec4 &getPlane(int i) const;
+
+private:
+    glm::vec4 planes_[6];
+};
+#endif
@@ -0,0 +1,36 @@
+#ifndef GLJOBQUEUE_HPP
+#define GLJOBQUEUE_HPP
+
+#include <deque>
+#include <functional>
+#include "mpscqueue.hpp"
+
+/*
+ * Jobs that need the OpenGL context, like texture uploads, buffer data and VAO setup.
+ * Any thread posts them, the main thread runs them once per frame in Engine::render_, before the scene updates.
+ * run stops once its time budget is spent and leaves the rest for the next frames, so uploads neither land
+ * in the middle of a draw loop nor all in one frame. Available globally through global.hpp
+ */
+class GlJobQueue {
+public:
+    GlJobQueue(float budgetMilliseconds = 2.0f);
+    GlJobQueue(const GlJobQueue &) = delete;
+    GlJobQueue &operator=(const GlJobQueue &) = delete;
+
+    /* Any thread */
+    void post(std::function<void()> job);
+    /* Main thread only. Runs jobs in post order until the budget is spent, at least one. Returns the number run */
+    int run();
+    void setBudget(float milliseconds);
+    float getBudget();
+    /* Main thread only. Posted and not run yet */
+    int getPendingCount();
+
+private:
+    MpscQueue<std::function<void()>> posted_;
+    std::deque<std::function<void()>> pending_; // Taken from posted_, left over from earlier frames first
+    float budget_;
+
+    void takePosted();
+};
+#endif
@@ -1,11 +1,6 @@
 #ifndef MATHUTILS_HPP
 #define MATHUTILS_HPP
 
-struct Plane {
-    glm::vec3 point;
-    glm::vec3 normal;
-};
-
 struct BoundingBox {
     glm::vec3 min;
     glm::vec3 max;
@@ -0,0 +1,67 @@
+#ifndef MPSCQUEUE_HPP
+#define MPSCQUEUE_HPP
+
+#include <atomic>
+#include <utility>
+
+/*
+ * Lock-free multi producer, single consumer queue.
+ * Producers push onto an atomic list head, the consumer takes the whole list with one exchange
+ * and hands the values out in push order. Meant for finished background work that the main thread picks up once per frame.
+ */
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue() {}
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    ~MpscQueue() {
+        drain([](T &) {});
+    }
+
+    /* Any thread */
+    void push(T value) {
+        Node *node = new Node{std::move(value), head_.load(std::memory_order_relaxed)};
+        while (!head_.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+            ;
+    }
+
+    /* Consumer thread only. Calls consume(T &) for every value pushed so far, returns the number of values */
+    template <typename F>
+    int drain(F consume) {
+        Node *node = head_.exchange(nullptr, std::memory_order_acquire);
+
+        /* The list is newest first */
+        Node *ordered = nullptr;
+        while (node) {
+            Node *next = node->next;
+            node->next = ordered;
+            ordered = node;
+            node = next;
+        }
+
+        int count = 0;
+        while (ordered) {
+            Node *next = ordered->next;
+            consume(ordered->value);
+            delete ordered;
+            ordered = next;
+            ++count;
+        }
+        return count;
+    }
+
+    bool empty() const {
+        return head_.load(std::memory_order_acquire) == nullptr;
+    }
+
+private:
+    struct Node {
+        T value;
+        Node *next;
+    };
+
+    std::atomic<Node *> head_{nullptr};
+};
+#endif
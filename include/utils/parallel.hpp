@@ -0,0 +1,42 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+class ThreadPool;
+
+/*
+ * Runs fn(chunkBegin, chunkEnd) for chunks covering [begin, end) on pool and returns once all of them finished.
+ * Chunks shrink while the range is used up, each one takes its share of what is left but at least grain items.
+ * The calling thread takes chunks as well and only ever waits for chunks another thread is running,
+ * so nested calls from inside pool jobs can't deadlock. Without a pool, or with fewer than 2 * grain items, fn runs right here.
+ * Chunk boundaries only depend on the range, grain and the pool's thread count.
+ */
+void parallelFor(ThreadPool *pool, int begin, int end, int grain, const std::function<void(int, int)> &fn);
+
+/*
+ * map(chunkBegin, chunkEnd) reduces a chunk, combine(a, b) two partial results. The partial results are combined
+ * in range order, starting with identity, so combine only has to be associative and the result is reproducible.
+ */
+template <typename T, typename Map, typename Combine>
+T parallelReduce(ThreadPool *pool, int begin, int end, int grain, T identity, Map map, Combine combine) {
+    std::mutex mutex;
+    std::vector<std::pair<int, T>> partials;
+    parallelFor(pool, begin, end, grain, [&](int chunkBegin, int chunkEnd) {
+        T partial = map(chunkBegin, chunkEnd);
+        std::lock_guard<std::mutex> lock(mutex);
+        partials.emplace_back(chunkBegin, std::move(partial));
+    });
+
+    std::sort(partials.begin(), partials.end(),
+              [](const std::pair<int, T> &a, const std::pair<int, T> &b) { return a.first < b.first; });
+    T result = std::move(identity);
+    for (std::pair<int, T> &partial : partials)
+        result = combine(std::move(result), std::move(partial.second));
+    return result;
+}
+#endif
@@ -0,0 +1,33 @@
+#ifndef SLOTARRAY_HPP
+#define SLOTARRAY_HPP
+
+#include <deque>
+
+/*
+ * Dense replacement for std::unordered_map<int, T> with small, recycled ids like heightmap indices.
+ * operator[] grows the array like the map's operator[] inserts. References stay valid while it grows,
+ * so they can be handed out like pointers into a map. The array is as large as the largest id ever used.
+ */
+template <typename T>
+class SlotArray {
+public:
+    T &operator[](int index) {
+        if (index >= (int)slots_.size())
+            slots_.resize(index + 1);
+        return slots_[index];
+    }
+
+    /* Resets the slot to T() */
+    void erase(int index) {
+        if (index < (int)slots_.size())
+            slots_[index] = T();
+    }
+
+    int size() const {
+        return slots_.size();
+    }
+
+private:
+    std::deque<T> slots_;
+};
+#endif
@@ -0,0 +1,83 @@
+#ifndef TASK_HPP
+#define TASK_HPP
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+
+class ThreadPool;
+
+/*
+ * Handle to a job started with ThreadPool::submit. Copies refer to the same job.
+ * then adds a job that starts once this one finished, whenAll a task that finishes with the last of the given ones.
+ * The worker that finishes a task runs one of the jobs that became ready right away, the others go to the pool.
+ * Results are passed through the captures of the jobs, like with addJob.
+ */
+class Task {
+public:
+    /* Invalid until assigned, like a default constructed std::future */
+    Task();
+    bool valid();
+    bool isDone();
+    /* Blocks until the job finished. Not from a job of the same pool, the job waited for might need the worker */
+    void wait();
+    /* Runs job on this task's pool after this task finished. tag as with ThreadPool::addJob */
+    Task then(std::function<void()> job, const char *tag = nullptr);
+    /* Finishes once all tasks finished, right away for none. Runs nothing itself */
+    static Task whenAll(const std::vector<Task> &tasks);
+
+private:
+    friend class ThreadPool;
+    friend class TaskGraph;
+
+    struct State {
+        ThreadPool *pool;
+        std::function<void()> job; // Empty for joins
+        const char *tag;
+        std::atomic<int> pending; // Unfinished predecessors, the job is ready at 0
+        std::mutex mutex;
+        std::condition_variable finished;
+        bool done = false; // Guarded by mutex, like successors
+        std::vector<std::shared_ptr<State>> successors;
+
+        State(ThreadPool *p, std::function<void()> j, int predecessors, const char *t = nullptr)
+            : pool(p), job(std::move(j)), tag(t), pending(predecessors) {}
+    };
+
+    std::shared_ptr<State> state_;
+
+    explicit Task(std::shared_ptr<State> state);
+    /* successor waits for predecessor, or is one step closer to ready if that finished already */
+    static void attach(const std::shared_ptr<State> &predecessor, const std::shared_ptr<State> &successor);
+    /* successor lost a predecessor, starts it if that was the last */
+    static void release(const std::shared_ptr<State> &successor);
+    static void start(std::shared_ptr<State> state);
+    static void run(std::shared_ptr<State> state);
+};
+
+/*
+ * Builds a multi stage pipeline before anything runs, like generate heightmap, then min/max and normals, then upload.
+ * Nodes may only depend on nodes added before them, so the graph never has a cycle.
+ * Not thread safe, build it on one thread and submit it once.
+ */
+class TaskGraph {
+public:
+    /* Returns the id of the node, -1 if a dependency is not an earlier node */
+    int add(std::function<void()> job, const std::vector<int> &dependencies = std::vector<int>(), const char *tag = nullptr);
+    /* Starts the nodes without dependencies on pool and returns a task that finishes with the last node. Empties the graph */
+    Task submit(ThreadPool *pool);
+    int getNodeCount();
+
+private:
+    struct Node {
+        std::function<void()> job;
+        std::vector<int> dependencies;
+        const char *tag;
+    };
+
+    std::vector<Node> nodes_;
+};
+#endif
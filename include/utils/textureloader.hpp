@@ -12,6 +12,8 @@ class TextureLoader {
     static Texture loadTextureFromFile(const char *path, std::string name);
     static unsigned int loadTextureFromFile(const char *path);
     static unsigned int createTextureFromArray(unsigned char *data, int width, int height, int size);
+    /* Overwrites a texture from createTextureFromArray with data of the same dimensions */
+    static void updateTextureFromArray(unsigned int texId, unsigned char *data, int width, int height, int size);
 
     static Texture loadCubeMap(std::vector<std::string> textures, std::string name);
     static unsigned int loadCubeMap(std::vector<std::string> textures);
@@ -1,10 +1,19 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
 #include <vector>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <functional>
 #include <condition_variable>
-#include <queue>
+#include <chrono>
 #include <cstdio>
+#include "workstealingdeque.hpp"
+#include "task.hpp"
+#include "threadpoolmetrics.hpp"
 
 /*
  * Thread Pool
@@ -12,65 +21,74 @@
  * Initialized in Engine()
  * Call threadPool.addJob(function) to add jobs.
  * Use std::bind if arguments are required
+ *
+ * Work stealing: every worker has its own deque, jobs added by a job go there and are run newest first.
+ * Jobs from other threads go to a shared injection queue, an idle worker takes a share of it into its deque.
+ * Workers without work steal the oldest job of a random other worker, and sleep once nobody has any.
+ * Jobs no longer run in the order they were added.
+ *
+ * submit returns a Task to wait for the job or chain more jobs to it, see task.hpp.
+ *
+ * Built with THREADPOOL_METRICS, the workers count latencies, run times by job tag, steals and busy time
+ * in their own counters, getMetrics adds them up. Without it there is no extra work at all.
  */
 class ThreadPool {
 public:
-    ThreadPool(int numThreads) {
-        for (int i = 0; i < numThreads; i++) {
-            pool_.push_back(new std::thread(&ThreadPool::workerFunction, this));
-            //pool_.push_back(new std::thread([this]{workerFunction();}));
-        }
-    }
-
-    ~ThreadPool() {
-        if (!closed_)
-            closePool();
-    }
-
-    void workerFunction() {
-        std::function<void()> job;
-        while(true) {
-            {
-                std::unique_lock<std::mutex> lock(queueMutex_);
-
-                cond_.wait(lock, [this]{ return !queue_.empty() || shutdown_;});
-                if (shutdown_ && queue_.empty())
-                    return;
-
-                job = queue_.front();
-                queue_.pop();
-            }
-            job();
-        }
-    }
+    ThreadPool(int numThreads);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
 
-    void addJob(std::function<void()> job) {
-        {
-            std::unique_lock<std::mutex> lock(queueMutex_);
-            queue_.push(job);
-        }
-        cond_.notify_one();
-    }
+    /* Any thread. tag groups the run times in the metrics, it has to outlive the pool, like a string literal */
+    void addJob(std::function<void()> job, const char *tag = nullptr);
+    Task submit(std::function<void()> job, const char *tag = nullptr);
+    int getThreadCount();
+    /* True on the workers of this pool */
+    bool isWorkerThread();
+    /* Runs all jobs that were added and joins the workers */
+    void closePool();
+    /* Main thread only. Everything since the last call, or since the pool started */
+    ThreadPoolMetrics getMetrics();
 
-    void closePool() {
-        shutdown_ = true;
-        cond_.notify_all();
-
-        for (std::thread *t : pool_)
-            t->join();
-
-        for (std::thread *t : pool_)
-            delete t;
+private:
+    struct Job {
+        std::function<void()> run;
+#ifdef THREADPOOL_METRICS
+        const char *tag;
+        std::chrono::steady_clock::time_point added;
+#endif
+    };
 
-        pool_.clear();
-        closed_ = true;
-    }
+    struct Worker {
+        WorkStealingDeque<Job> deque;
+        std::thread *thread = nullptr;
+        unsigned int random; // xorshift state for picking victims
+#ifdef THREADPOOL_METRICS
+        WorkerMetrics metrics;
+#endif
+    };
 
-private:
-    std::vector<std::thread *> pool_;
-    std::mutex queueMutex_; 
-    std::condition_variable cond_;
-    bool shutdown_ = false;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::mutex injectionMutex_;
+    std::deque<Job *> injection_;
+    std::atomic<int> injectedCount_{0}; // Size of injection_, read without the lock
+    std::atomic<int> queuedJobs_{0}; // Added and not taken yet, anywhere
+    std::atomic<int> sleepingWorkers_{0};
+    std::mutex sleepMutex_;
+    std::condition_variable wakeUp_;
+    bool shutdown_ = false; // Guarded by sleepMutex_
     bool closed_ = false;
-    std::queue<std::function<void()>> queue_;
-};
\ No newline at end of file
+#ifdef THREADPOOL_METRICS
+    std::atomic<int> maxQueuedJobs_{0}; // Since the last getMetrics
+    ThreadPoolMetrics metricsTotals_; // Of the last getMetrics, the next one returns the difference
+    std::vector<uint64_t> busyTotals_;
+    std::chrono::steady_clock::time_point metricsTime_ = std::chrono::steady_clock::now();
+#endif
+
+    void workerFunction(int index);
+    Job *findJob(Worker &worker);
+    Job *takeInjected(Worker &worker);
+    Job *steal(Worker &worker);
+    void run(Worker &worker, Job *job);
+};
+#endif
@@ -0,0 +1,79 @@
+#ifndef THREADPOOLMETRICS_HPP
+#define THREADPOOLMETRICS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+/* Bucket 0 counts values below 1 us, bucket i values in [2^(i-1), 2^i) us, the last one also everything above */
+const int METRICS_HISTOGRAM_BUCKETS = 20;
+/* Job tags a worker keeps apart, jobs with further tags are counted as "other" */
+const int METRICS_MAX_TAGS = 16;
+
+struct MetricsHistogram {
+    uint64_t counts[METRICS_HISTOGRAM_BUCKETS] = {};
+    uint64_t totalNanoseconds = 0;
+
+    void add(const MetricsHistogram &other);
+    void subtract(const MetricsHistogram &other);
+    uint64_t getCount() const;
+    double getMeanMicroseconds() const;
+    /* Upper bound of the bucket below which the fraction p of the values lies */
+    double getPercentileMicroseconds(float p) const;
+};
+
+/*
+ * Snapshot of a ThreadPool, see ThreadPool::getMetrics.
+ * All zero unless the engine was built with THREADPOOL_METRICS.
+ */
+struct ThreadPoolMetrics {
+    double seconds = 0.0; // Time covered
+    int queuedJobs = 0; // When the snapshot was taken
+    int maxQueuedJobs = 0;
+    uint64_t steals = 0;
+    uint64_t injectedTakes = 0; // Shares workers took from the injection queue
+    std::vector<double> busy; // Per worker, fraction of the time spent in jobs. The rest is idle
+    MetricsHistogram latency; // From addJob until a worker starts the job
+    std::map<std::string, MetricsHistogram> runTimes; // By job tag
+
+    uint64_t getJobCount() const;
+    /* A few lines, like the FPS print */
+    void print(FILE *file) const;
+};
+
+/*
+ * Counters of one worker. Only that worker writes them, so relaxed loads and stores are enough and nothing is shared.
+ * Any thread may collect them while the worker runs.
+ */
+class WorkerMetrics {
+public:
+    void addJob(const char *tag, uint64_t latencyNanoseconds, uint64_t runNanoseconds);
+    void addSteal();
+    void addInjectedTake();
+    /* Adds the totals since the worker started */
+    void collect(ThreadPoolMetrics &metrics, uint64_t &busyNanoseconds);
+
+private:
+    struct Histogram {
+        std::atomic<uint64_t> counts[METRICS_HISTOGRAM_BUCKETS]{};
+        std::atomic<uint64_t> totalNanoseconds{0};
+
+        void add(uint64_t nanoseconds);
+        void read(MetricsHistogram &histogram);
+    };
+
+    struct Tag {
+        std::atomic<const char *> name{nullptr};
+        Histogram runTimes;
+    };
+
+    Histogram latency_;
+    Tag tags_[METRICS_MAX_TAGS];
+    std::atomic<uint64_t> busyNanoseconds_{0};
+    std::atomic<uint64_t> steals_{0};
+    std::atomic<uint64_t> injectedTakes_{0};
+};
+#endif
@@ -0,0 +1,122 @@
+#ifndef WORKSTEALINGDEQUE_HPP
+#define WORKSTEALINGDEQUE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Chase-Lev work stealing deque of pointers, with the memory orders of Le et al., "Correct and Efficient
+ * Work-Stealing for Weak Memory Models". The owner pushes and pops at the bottom without locking,
+ * any other thread steals from the top, a CAS on top only decides the race for the last element.
+ * A full array is replaced by one twice the size. Stealers may still read the old one, so it is kept until destruction.
+ */
+template <typename T>
+class WorkStealingDeque {
+public:
+    /* capacity is a power of two */
+    explicit WorkStealingDeque(int64_t capacity = 256) {
+        arrays_.push_back(new Array(capacity));
+        array_.store(arrays_.back(), std::memory_order_relaxed);
+    }
+
+    ~WorkStealingDeque() {
+        for (Array *array : arrays_)
+            delete array;
+    }
+
+    WorkStealingDeque(const WorkStealingDeque &) = delete;
+    WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+    /* Owner thread only */
+    void push(T *value) {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        Array *array = array_.load(std::memory_order_relaxed);
+        if (b - t > array->capacity - 1) {
+            array = array->grow(b, t);
+            arrays_.push_back(array);
+            array_.store(array, std::memory_order_release);
+        }
+        array->put(b, value);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+
+    /* Owner thread only, newest first. nullptr if empty */
+    T *pop() {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        Array *array = array_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        T *value = array->get(b);
+        if (t == b) {
+            /* The last element, a stealer may take it first */
+            if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                value = nullptr;
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        return value;
+    }
+
+    /* Any thread, oldest first. nullptr if empty or another thread won the race */
+    T *steal() {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b)
+            return nullptr;
+
+        Array *array = array_.load(std::memory_order_acquire);
+        T *value = array->get(t);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr;
+        return value;
+    }
+
+    /* Any thread, only a hint while others push or pop */
+    bool empty() {
+        return top_.load(std::memory_order_relaxed) >= bottom_.load(std::memory_order_relaxed);
+    }
+
+private:
+    /* Ring buffer indexed with the unbounded top and bottom */
+    struct Array {
+        int64_t capacity;
+        std::atomic<T *> *values;
+
+        explicit Array(int64_t c) : capacity(c), values(new std::atomic<T *>[c]) {}
+        ~Array() {
+            delete[] values;
+        }
+
+        T *get(int64_t i) {
+            return values[i & (capacity - 1)].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t i, T *value) {
+            values[i & (capacity - 1)].store(value, std::memory_order_relaxed);
+        }
+
+        Array *grow(int64_t bottom, int64_t top) {
+            Array *array = new Array(capacity * 2);
+            for (int64_t i = top; i < bottom; ++i)
+                array->put(i, get(i));
+            return array;
+        }
+    };
+
+    /* On separate cache lines, the owner writes bottom and the stealers top */
+    alignas(64) std::atomic<int64_t> top_{0};
+    alignas(64) std::atomic<int64_t> bottom_{0};
+    std::atomic<Array *> array_;
+    std::vector<Array *> arrays_; // Owner only, all arrays ever used
+};
+#endif
@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <cstdio>
+#include "instancering.hpp"
+#include "oglheader.hpp"
+
+namespace {
+/* Nanoseconds per glClientWaitSync call, waiting is repeated until the section is free */
+const GLuint64 FENCE_TIMEOUT = 1000000;
+/* Elements per section of a new ring */
+const int INITIAL_CAPACITY = 4096;
+} // namespace
+
+InstanceRing::InstanceRing(size_t elementSize) : elementSize_(elementSize) {
+    persistent_ = GLEW_ARB_buffer_storage || GLEW_VERSION_4_4;
+    resize(INITIAL_CAPACITY);
+}
+
+InstanceRing::~InstanceRing() {
+    for (int i = 0; i < RING_FRAMES; ++i) {
+        if (fences_[i])
+            glDeleteSync((GLsync)fences_[i]);
+    }
+
+    if (mapped_) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &buffer_);
+}
+
+void *InstanceRing::beginFrame(int count) {
+    /* Everything drawn with the last section was issued by now */
+    if (frameStarted_)
+        fences_[section_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frameStarted_ = true;
+
+    section_ = (section_ + 1) % RING_FRAMES;
+    if (count > capacity_)
+        resize(std::max(count, capacity_ * 2));
+    else
+        waitForSection(section_);
+
+    count_ = count;
+    if (!persistent_)
+        return staging_.data();
+    return mapped_ + (size_t)section_ * capacity_ * elementSize_;
+}
+
+void InstanceRing::endFrame() {
+    if (persistent_ || !count_)
+        return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+    glBufferSubData(GL_ARRAY_BUFFER, (size_t)section_ * capacity_ * elementSize_, count_ * elementSize_, staging_.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+int InstanceRing::getFrameBase() {
+    return section_ * capacity_;
+}
+
+unsigned int InstanceRing::getBuffer() {
+    return buffer_;
+}
+
+int InstanceRing::getGeneration() {
+    return generation_;
+}
+
+bool InstanceRing::isPersistent() {
+    return persistent_;
+}
+
+void InstanceRing::waitForSection(int section) {
+    GLsync fence = (GLsync)fences_[section];
+    if (!fence)
+        return;
+
+    GLenum result;
+    while ((result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT)) == GL_TIMEOUT_EXPIRED)
+        ;
+    if (result == GL_WAIT_FAILED)
+        fprintf(stdout, "[INSTANCERING::waitForSection] Error: Waiting for the fence failed\n");
+    glDeleteSync(fence);
+    fences_[section] = nullptr;
+}
+
+/* The old buffer may still be in use, it is only released once the GPU is done with all sections */
+void InstanceRing::resize(int capacity) {
+    for (int i = 0; i < RING_FRAMES; ++i)
+        waitForSection(i);
+
+    /* Generated before the old one is deleted, so the name always changes */
+    unsigned int buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    size_t size = (size_t)capacity * RING_FRAMES * elementSize_;
+    if (persistent_) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+        mapped_ = static_cast<char *>(glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        staging_.resize((size_t)capacity * elementSize_);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (buffer_)
+        glDeleteBuffers(1, &buffer_);
+    buffer_ = buffer;
+    capacity_ = capacity;
+    ++generation_;
+}
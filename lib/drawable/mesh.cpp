@@ -10,6 +10,19 @@ Mesh::Mesh(VertexData *vertexData, std::vector<Texture> textures) : vertexData_(
     vertexData_->optimize();
 }
 
+Mesh::~Mesh() {
+    if (!incomplete_) {
+        glDeleteVertexArrays(1, &vao_);
+        glDeleteBuffers(1, &vbo_);
+        glDeleteBuffers(1, &ebo_);
+        if (ibo_)
+            glDeleteBuffers(1, &ibo_);
+        if (abo_)
+            glDeleteBuffers(1, &abo_);
+    }
+    delete vertexData_;
+}
+
 /*
  * initMesh() is not called on Mesh Object creation.
  * That's to ensure a mesh can be created by background Threads,
@@ -115,6 +128,37 @@ void Mesh::updateInstances(std::vector<glm::mat4> *instanceMatrices, VertexAttri
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
+void Mesh::setInstanceBuffer(unsigned int buffer, size_t stride, const std::vector<InstanceAttributeLayout> &layout) {
+    if (incomplete_)
+        initMesh();
+
+    isInstanced_ = true;
+    if (instanceAttributeIndex_ < 0) {
+        instanceAttributeIndex_ = vertexAttributeIndex_;
+        vertexAttributeIndex_ += layout.size();
+    }
+
+    glBindVertexArray(vao_);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (int i = 0; i < (int)layout.size(); ++i) {
+        const InstanceAttributeLayout &attribute = layout[i];
+        int index = instanceAttributeIndex_ + i;
+        glEnableVertexAttribArray(index);
+        if (attribute.isInteger)
+            glVertexAttribIPointer(index, attribute.numElements, GL_UNSIGNED_INT, stride, (void *)attribute.offset);
+        else
+            glVertexAttribPointer(index, attribute.numElements, GL_FLOAT, GL_FALSE, stride, (void *)attribute.offset);
+        glVertexAttribDivisor(index, 1);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Mesh::setInstanceRange(int first, int count) {
+    baseInstance_ = first;
+    drawInstances_ = count;
+}
+
 void Mesh::addTexture(Texture tex) {
     textures_.push_back(tex);
 }
@@ -135,6 +179,10 @@ unsigned int Mesh::getInstanceSize() {
     return drawInstances_;
 }
 
+unsigned int Mesh::getBaseInstance() {
+    return baseInstance_;
+}
+
 bool &Mesh::isInstanced() {
     return isInstanced_;
 }
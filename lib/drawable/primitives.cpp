@@ -1,46 +1,61 @@
 #include "primitives.hpp"
-
+#include "global.hpp"
+#include "parallel.hpp"
+
+namespace {
+/*
+ * A plane row only writes plain vertex and index values. Leaf planes of 16 to 64 quads stay on the calling thread,
+ * only larger planes give chunks of a few thousand vertices, enough to pay for handing them to a worker.
+ */
+const int MIN_ROWS_PER_CHUNK = 16;
+} // namespace
+
+/* Rows are independent, vertices and indices are filled in parallel */
 Mesh *Primitives::createPlane(int dimension, glm::vec3 axis) {
     dimension = dimension + 1;
     VertexData *vertexData = new VertexData(dimension * dimension, (dimension - 1) * (dimension - 1) * 6);
 
-    for (int i = 0; i < dimension; i++) {
-        for (int j = 0; j < dimension; j++) {
-            Vertex &tmp = vertexData->vertices[i * dimension + j];
-            tmp.position.x = j;
-            tmp.position.y = 0;
-            tmp.position.z = i;
-            tmp.textureCoords.x = (float)j / ((float)dimension - 1);
-            tmp.textureCoords.y = (float)i / ((float)dimension - 1);
+    parallelFor(g_threadPool, 0, dimension, MIN_ROWS_PER_CHUNK, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            for (int j = 0; j < dimension; j++) {
+                Vertex &tmp = vertexData->vertices[i * dimension + j];
+                tmp.position.x = j;
+                tmp.position.y = 0;
+                tmp.position.z = i;
+                tmp.textureCoords.x = (float)j / ((float)dimension - 1);
+                tmp.textureCoords.y = (float)i / ((float)dimension - 1);
+            }
         }
-    }
+    });
 
     bool inverted = false;
     if (axis.x == -1 || axis.z == 1 || axis.y == -1)
         inverted = true;
 
-    int cnt = 0;
-    for (int row = 0; row < dimension - 1; row++) {
-        for (int col = 0; col < dimension - 1; col++) {
-            if (inverted) {
-                vertexData->indices[cnt++] = dimension * row + col;
-                vertexData->indices[cnt++] = dimension * row + col + dimension + 1;
-                vertexData->indices[cnt++] = dimension * row + col + dimension;
-
-                vertexData->indices[cnt++] = dimension * row + col;
-                vertexData->indices[cnt++] = dimension * row + col + 1;
-                vertexData->indices[cnt++] = dimension * row + col + dimension + 1;
-            } else {
-                vertexData->indices[cnt++] = dimension * row + col;
-                vertexData->indices[cnt++] = dimension * row + col + dimension;
-                vertexData->indices[cnt++] = dimension * row + col + dimension + 1;
-
-                vertexData->indices[cnt++] = dimension * row + col;
-                vertexData->indices[cnt++] = dimension * row + col + dimension + 1;
-                vertexData->indices[cnt++] = dimension * row + col + 1;
+    parallelFor(g_threadPool, 0, dimension - 1, MIN_ROWS_PER_CHUNK, [&](int begin, int end) {
+        for (int row = begin; row < end; row++) {
+            int cnt = row * (dimension - 1) * 6;
+            for (int col = 0; col < dimension - 1; col++) {
+                if (inverted) {
+                    vertexData->indices[cnt++] = dimension * row + col;
+                    vertexData->indices[cnt++] = dimension * row + col + dimension + 1;
+                    vertexData->indices[cnt++] = dimension * row + col + dimension;
+
+                    vertexData->indices[cnt++] = dimension * row + col;
+                    vertexData->indices[cnt++] = dimension * row + col + 1;
+                    vertexData->indices[cnt++] = dimension * row + col + dimension + 1;
+                } else {
+                    vertexData->indices[cnt++] = dimension * row + col;
+                    vertexData->indices[cnt++] = dimension * row + col + dimension;
+                    vertexData->indices[cnt++] = dimension * row + col + dimension + 1;
+
+                    vertexData->indices[cnt++] = dimension * row + col;
+                    vertexData->indices[cnt++] = dimension * row + col + dimension + 1;
+                    vertexData->indices[cnt++] = dimension * row + col + 1;
+                }
             }
         }
-    }
+    });
 
     return new Mesh(vertexData);
 }
@@ -7,10 +7,12 @@ float g_currentFrameTime;
 unsigned int g_triangleCount = 0;
 bool g_debugPolygonMode = false;
 ThreadPool *g_threadPool = nullptr;
+GlJobQueue *g_glJobQueue = nullptr;
 
 Engine::Engine(int width, int height, const std::string &name) {
     initWindow(width, height, name);
     initThreadPool();
+    g_glJobQueue = new GlJobQueue();
 }
 
 Engine::~Engine() {
@@ -19,6 +21,10 @@ Engine::~Engine() {
 
     if (g_threadPool)
         delete g_threadPool;
+
+    /* Jobs still queued are dropped, the context is gone */
+    if (g_glJobQueue)
+        delete g_glJobQueue;
 }
 
 void Engine::initWindow(int width, int height, const std::string &name) {
@@ -84,6 +90,10 @@ void Engine::addScene(Scene *scene) {
     scene_ = scene;
 }
 
+void Engine::setGlJobBudget(float milliseconds) {
+    g_glJobQueue->setBudget(milliseconds);
+}
+
 void Engine::render() {
     if (scene_)
         render_();
@@ -102,6 +112,9 @@ void Engine::render_() {
         nbFrames++;
         if (g_currentFrameTime - lastTime >= 1.0) {
             fprintf(stdout, "%f ms/frame -> %i FPS. Triangles per Frame: %u\n", 1000.0 / float(nbFrames), nbFrames, g_triangleCount/nbFrames);
+#ifdef THREADPOOL_METRICS
+            g_threadPool->getMetrics().print(stdout);
+#endif
             nbFrames = 0;
             lastTime += 1.0;
             g_triangleCount = 0;
@@ -109,6 +122,8 @@ void Engine::render_() {
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        /* Before the update, so the scene sees what was uploaded this frame */
+        g_glJobQueue->run();
         scene_->update();
         scene_->render();
 
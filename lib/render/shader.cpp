@@ -200,6 +200,10 @@ void Shader::uniform(const std::string &name, float value) {
     glUniform1f(glGetUniformLocation(shaderProgramId_, name.c_str()), value);
 }
 
+void Shader::uniform(const std::string &name, const float *values, int count) {
+    glUniform1fv(glGetUniformLocation(shaderProgramId_, name.c_str()), count, values);
+}
+
 ShaderType Shader::type() {
     return type_;
 }
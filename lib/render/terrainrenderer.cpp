@@ -49,7 +49,7 @@ void TerrainRenderer::render_(TerrainObjectRenderData &renderData, SceneRenderDa
     shader_->use();
 
     bindTextureList(renderData.land->getGlobalTextureList());
-    shader_->setSceneUniforms(sceneData, nullptr);
+    shader_->setSceneUniforms(sceneData, renderData.attributes);
 
     for (int i = 0; i < renderData.land->size; ++i) {
         TextureList &texList = renderData.land->getTextureListAtIndex(i);
@@ -6,7 +6,8 @@ VaoRenderer::VaoRenderer() {}
 
 /*
  * Draws the vertex array objects
- * Checks if mesh is incomplete (so mesh data can be generated on different threads)
+ * Checks if mesh is incomplete (so mesh data can be generated on different threads).
+ * Meshes from background threads should be uploaded through g_glJobQueue instead, this is the fallback
  */
 void VaoRenderer::draw(Mesh *mesh) {
     if (mesh->incomplete())
@@ -14,7 +15,10 @@ void VaoRenderer::draw(Mesh *mesh) {
 
     glBindVertexArray(mesh->getVao());
 
-    if (mesh->isInstanced())
+    if (mesh->isInstanced() && mesh->getBaseInstance())
+        glDrawElementsInstancedBaseInstance(mesh->getDrawMode(), mesh->getIndicesSize(), GL_UNSIGNED_INT, 0, mesh->getInstanceSize(),
+                                            mesh->getBaseInstance());
+    else if (mesh->isInstanced())
         glDrawElementsInstanced(mesh->getDrawMode(), mesh->getIndicesSize(), GL_UNSIGNED_INT, 0, mesh->getInstanceSize());
     else 
         glDrawElements(mesh->getDrawMode(), mesh->getIndicesSize(), GL_UNSIGNED_INT, 0);
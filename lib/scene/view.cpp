@@ -41,18 +41,6 @@ View::View(GLFWwindow *window, glm::vec3 camPos, glm::vec3 camDir, float yaw, fl
     farPlaneDistance_ = DEFAULT_FAR_PLANE;
 
     updateForce();
-
-    /* Setup frustum planes */
-    float angle = PI / 2.0f + fov_ / 2.0f + 0.1f;
-    farPlane_.normal = -camDirection_;
-    nearPlane_.normal = camDirection_;
-    leftPlane_.normal = glm::vec3(glm::rotate(glm::mat4(), angle, camUp_) * glm::vec4(camDirection_, 1.0f));
-    rightPlane_.normal = glm::vec3(glm::rotate(glm::mat4(), -angle, camUp_) * glm::vec4(camDirection_, 1.0f));
-    topPlane_.normal = glm::vec3(glm::rotate(glm::mat4(), angle, camRight_) * glm::vec4(camDirection_, 1.0f));
-    bottomPlane_.normal = glm::vec3(glm::rotate(glm::mat4(), -angle, camRight_) * glm::vec4(camDirection_, 1.0f));
-
-    frustumPlanes_.insert(frustumPlanes_.begin(), {&farPlane_, &nearPlane_, &leftPlane_, &rightPlane_, &topPlane_, &bottomPlane_});
-
     setupInput();
 }
 
@@ -122,6 +110,7 @@ void View::rotateCamera() {
     camPosition_.z = cos(camRotateVal_) * abs(camPositionOriginal_.z);
 
     cameraMatrix_ = glm::lookAt(camPosition_, camDirection_, camUp_);
+    frustum_.extractPlanes(projectionMatrix_ * cameraMatrix_);
 }
 
 void View::updateForce() {
@@ -150,18 +139,8 @@ void View::update_() {
             glm::perspective(glm::radians(zoom_), (float)windowWidth_ / (float)windowHeight_, nearPlaneDistance_, farPlaneDistance_);
         cameraMatrix_ = glm::lookAt(camPosition_, camPosition_ + camDirection_, camUp_);
 
-        /* Update frustum planes */
-        nearPlane_.point = camPosition_ - dir * nearPlaneDistance_;
-        farPlane_.point = camPosition_ - dir * farPlaneDistance_;
-        leftPlane_.point = rightPlane_.point = topPlane_.point = bottomPlane_.point = camPosition_;
-
-        glm::mat3 modMat = glm::mat3(camRight_, camUp_, -camDirection_);
-        farPlane_.normal = -camDirection_;
-        nearPlane_.normal = camDirection_;
-        leftPlane_.normal = modMat * leftPlane_.normal;
-        rightPlane_.normal = modMat * rightPlane_.normal;
-        topPlane_.normal = modMat * topPlane_.normal;
-        bottomPlane_.normal = modMat * bottomPlane_.normal;
+        /* Planes straight from the matrices, so they can't drift from what is rendered */
+        frustum_.extractPlanes(projectionMatrix_ * cameraMatrix_);
 
         flagUpdate_ = false;
     }
@@ -251,28 +230,10 @@ void View::scrollCallback(GLFWwindow *window, double xoffset, double yoffset) {
     flagUpdate_ = true;
 }
 
-bool View::isInsidePlane(Plane *plane, glm::vec3 &max, glm::vec3 &min) {
-    glm::vec3 v = min;
-
-    if (plane->normal.x >= 0)
-        v.x = max.x;
-    if (plane->normal.y >= 0)
-        v.y = max.y;
-    if (plane->normal.z >= 0)
-        v.z = max.z;
-
-    float dotP = glm::dot(v - plane->point, plane->normal);
-
-    return dotP >= 0;
+Frustum &View::getFrustum() {
+    return frustum_;
 }
 
-/* http://www.lighthouse3d.com/tutorials/view-frustum-culling/ */
 bool View::isInsideFrustum(BoundingBox &bBox) {
-    fprintf(stdout, "bBoxMax: %s, bBoxMin: %s\n", glm::to_string(bBox.max).c_str(), glm::to_string(bBox.min).c_str());
-    for (Plane *p : frustumPlanes_) {
-        if (!isInsidePlane(p, bBox.max, bBox.min))
-            return false;
-    }
-
-    return true;
-}
\ No newline at end of file
+    return frustum_.testBox(bBox.min, bBox.max) != FRUSTUM_OUTSIDE;
+}
@@ -1,5 +1,12 @@
 #include "colorgenerator.hpp"
 #include <ctime>
+#include "global.hpp"
+#include "parallel.hpp"
+
+namespace {
+/* Color maps are a few hundred samples wide, 16 rows of palette lookups and blends make a chunk of several thousand colors */
+const int MIN_ROWS_PER_CHUNK = 16;
+} // namespace
 
 ColorGenerator::ColorGenerator(bool random) {
     if (random) {
@@ -25,11 +32,13 @@ ColorGenerator::ColorGenerator(std::vector<glm::vec4> colorPalette, float spread
 
 std::vector<glm::vec4> ColorGenerator::genColors(std::vector<float> &heights, float dimension, float amplitude) {
     std::vector<glm::vec4> colors(heights.size());
-    for (int z = 0; z < dimension; z++) {
-        for (int x = 0; x < dimension; x++) {
-            colors[z * dimension + x] = calcColor(heights[z * dimension + x], amplitude);
+    parallelFor(g_threadPool, 0, (int)dimension, MIN_ROWS_PER_CHUNK, [&](int begin, int end) {
+        for (int z = begin; z < end; z++) {
+            for (int x = 0; x < dimension; x++) {
+                colors[z * dimension + x] = calcColor(heights[z * dimension + x], amplitude);
+            }
         }
-    }
+    });
     return colors;
 }
 
@@ -1,28 +1,110 @@
 #include <cstdio>
+#include <algorithm>
+#include <cmath>
 #include "heightmap.hpp"
 #include "textureloader.hpp"
+#include "oglheader.hpp"
 
-HeightMap::HeightMap(TerrainGenerator *terrainGen, glm::vec2 cornerPos, glm::vec3 axis, int dimension, int index) : cornerPos_(cornerPos), axis_(axis), index_(index), dimension_(dimension) {
-    heightData_ = new std::vector<unsigned char>(dimension_ * dimension_);
-    normalData_ = new std::vector<unsigned char>(dimension_ * dimension_ * 3);
-    lowerNoiseBound_ = terrainGen->getPerlinNoise().getLowerBound();
-    upperNoiseBound_ = terrainGen->getPerlinNoise().getUpperBound();
+HeightMap::HeightMap(TerrainGenerator *terrainGen, glm::vec2 cornerPos, glm::vec3 axis, int dimension, int index, int sampleSpacing,
+                     bool keepLowFrequency)
+    : cornerPos_(cornerPos), axis_(axis), index_(index), dimension_(dimension), sampleSpacing_(sampleSpacing) {
+    sampleCount_ = dimension_ / sampleSpacing_;
+    if (keepLowFrequency)
+        lowFrequencyData_ = new LowFrequencyField();
+    generate(terrainGen, nullptr);
+}
+
+HeightMap::HeightMap(TerrainGenerator *terrainGen, HeightMap *parent, glm::vec2 cornerPos, int dimension, int index)
+    : cornerPos_(cornerPos), axis_(parent->axis_), index_(index), dimension_(dimension) {
+    sampleSpacing_ = std::max(1, dimension_ / parent->sampleCount_);
+    sampleCount_ = dimension_ / sampleSpacing_;
+    lowFrequencyData_ = new LowFrequencyField();
+    generate(terrainGen, parent->lowFrequencyData_);
+}
+
+HeightMap::~HeightMap() {
+    delete lowFrequencyData_;
+    if (heightTextureId_)
+        glDeleteTextures(1, &heightTextureId_);
+    if (normalTextureId_)
+        glDeleteTextures(1, &normalTextureId_);
+}
+
+void HeightMap::generate(TerrainGenerator *terrainGen, const LowFrequencyField *parentLowFrequencyData) {
+    PerlinNoise &noise = terrainGen->getPerlinNoise();
+    residualAmplitude_ = noise.getResidualAmplitude(noise.getOctavesForSpacing(sampleSpacing_));
+    heightData_.resize(sampleCount_ * sampleCount_);
+    normalData_.resize(sampleCount_ * sampleCount_ * 3);
+    std::vector<unsigned char> tiltData;
+    if (terrainGen->getSphereRadius())
+        tiltData.resize(sampleCount_ * sampleCount_);
+    lowerNoiseBound_ = noise.getLowerBound();
+    upperNoiseBound_ = noise.getUpperBound();
     GenerationAttributes attribs;
     attribs.position = cornerPos_;
     attribs.axis = axis_;
-    attribs.dimension = dimension_;
-    attribs.heightData = heightData_;
-    attribs.normalData = normalData_;
+    attribs.dimension = sampleCount_;
+    attribs.sampleSpacing = sampleSpacing_;
+    attribs.heightData = &heightData_;
+    attribs.normalData = &normalData_;
+    attribs.tiltData = tiltData.empty() ? nullptr : &tiltData;
+    attribs.lowFrequencyData = lowFrequencyData_;
+    attribs.parentLowFrequencyData = parentLowFrequencyData;
     terrainGen->generateTerrainHeightMap(&attribs);
-    heightTextureId_ = TextureLoader::createTextureFromArray(heightData_->data(), dimension_, dimension_, 1);
-    normalTextureId_ = TextureLoader::createTextureFromArray(normalData_->data(), dimension_, dimension_, 3);
-    delete normalData_;
+    heightPyramid_.build(heightData_.data(), sampleCount_, lowerNoiseBound_, upperNoiseBound_, tiltData.empty() ? nullptr : tiltData.data());
+}
+
+void HeightMap::uploadTextures(bool keepData) {
+    if (heightData_.empty()) {
+        fprintf(stdout, "[HEIGHTMAP::uploadTextures] Error: Textures are already uploaded\n");
+        return;
+    }
+
+    if (heightTextureId_) {
+        TextureLoader::updateTextureFromArray(heightTextureId_, heightData_.data(), sampleCount_, sampleCount_, 1);
+        TextureLoader::updateTextureFromArray(normalTextureId_, normalData_.data(), sampleCount_, sampleCount_, 3);
+    } else {
+        heightTextureId_ = TextureLoader::createTextureFromArray(heightData_.data(), sampleCount_, sampleCount_, 1);
+        normalTextureId_ = TextureLoader::createTextureFromArray(normalData_.data(), sampleCount_, sampleCount_, 3);
+    }
+
+    if (!keepData) {
+        std::vector<unsigned char>().swap(heightData_);
+        std::vector<unsigned char>().swap(normalData_);
+    }
+}
+
+void HeightMap::regenerate(TerrainGenerator *terrainGen, glm::vec2 cornerPos) {
+    if (heightData_.empty()) {
+        fprintf(stdout, "[HEIGHTMAP::regenerate] Error: The data was not kept by uploadTextures\n");
+        return;
+    }
+
+    cornerPos_ = cornerPos;
+    generate(terrainGen, nullptr);
 }
 
 int HeightMap::getIndex() {
     return index_;
 }
 
+int HeightMap::getDimension() {
+    return dimension_;
+}
+
+int HeightMap::getSampleSpacing() {
+    return sampleSpacing_;
+}
+
+size_t HeightMap::getMemoryUsage() {
+    /* Drivers store the RGB normals with 4 bytes per texel */
+    size_t bytes = heightTextureId_ ? (size_t)sampleCount_ * sampleCount_ * (1 + 4) : 0;
+    bytes += heightData_.capacity() + normalData_.capacity() + heightPyramid_.getMemoryUsage();
+    if (lowFrequencyData_)
+        bytes += lowFrequencyData_->samples.capacity() * sizeof(glm::vec4);
+    return bytes;
+}
+
 glm::vec3 &HeightMap::getAxis() {
     return axis_;
 }
@@ -35,27 +117,30 @@ unsigned int HeightMap::getNormalTexture() {
     return normalTextureId_;
 }
 
-/* Should be called after the root node tree for this height map is created */
-void HeightMap::cleanUpMapData() {
-    delete heightData_;
-    heightData_ = nullptr;
-}
-
-float HeightMap::getOriginalHeight(float inVal) {
-    float s = 1.0 * (upperNoiseBound_ - lowerNoiseBound_) / (255 - 0);
-    return lowerNoiseBound_ + std::floor((s * (inVal - 0)) + 0.5);
+/* Cells covered by the world space area at pos */
+void HeightMap::getSampleArea(glm::vec2 &pos, int dimension, int *x0, int *y0, int *x1, int *y1) {
+    *x0 = (int)std::floor((pos.x - cornerPos_.x) / sampleSpacing_);
+    *y0 = (int)std::floor((pos.y - cornerPos_.y) / sampleSpacing_);
+    *x1 = (int)std::ceil((pos.x + dimension - cornerPos_.x) / sampleSpacing_);
+    *y1 = (int)std::ceil((pos.y + dimension - cornerPos_.y) / sampleSpacing_);
 }
 
+/*
+ * pos and dimension are in world units. The result is widened by the octaves
+ * skipped at this sample spacing and by the 8 bit quantization, so the bounds stay conservative.
+ */
 void HeightMap::getMaxMinValuesFromArea(glm::vec2 &pos, int dimension, float *nodeMinHeight_, float *nodeMaxHeight_) {
-    float min = 0.0f;
-    float max = 0.0f;
-    for (int y = pos.y; y < pos.y + dimension; ++y) {
-        for (int x = pos.x; x < pos.x + dimension; ++x) {
-            min = std::min(min, getOriginalHeight((float)(*heightData_)[y * dimension + x]));
-            max = std::max(max, getOriginalHeight((float)(*heightData_)[y * dimension + x]));
-        }
-    }
+    int x0, y0, x1, y1;
+    getSampleArea(pos, dimension, &x0, &y0, &x1, &y1);
+    heightPyramid_.getMinMax(x0, y0, x1, y1, nodeMinHeight_, nodeMaxHeight_);
 
-    *nodeMinHeight_ = min;
-    *nodeMaxHeight_ = max;
-}
\ No newline at end of file
+    float margin = residualAmplitude_ + 0.5f * (upperNoiseBound_ - lowerNoiseBound_) / 255.0f;
+    *nodeMinHeight_ -= margin;
+    *nodeMaxHeight_ += margin;
+}
+
+float HeightMap::getMaxTiltFromArea(glm::vec2 &pos, int dimension) {
+    int x0, y0, x1, y1;
+    getSampleArea(pos, dimension, &x0, &y0, &x1, &y1);
+    return heightPyramid_.getMaxTilt(x0, y0, x1, y1);
+}
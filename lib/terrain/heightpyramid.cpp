@@ -0,0 +1,140 @@
+#include "heightpyramid.hpp"
+
+#include <cstdio>
+#include <algorithm>
+#include <glm/gtc/constants.hpp>
+
+void HeightPyramid::build(const unsigned char *heights, int dimension, float lowerBound, float upperBound, const unsigned char *tilts) {
+    lowerBound_ = lowerBound;
+    scale_ = (upperBound - lowerBound) / 65535.0f;
+    int levelCount = 1;
+    for (int d = dimension; d > 1; d = (d + 1) / 2)
+        ++levelCount;
+    /* Resized instead of rebuilt, building again with the same dimension reuses the allocations */
+    levels_.resize(levelCount);
+
+    /* Level 0: min/max of the four corner samples of each cell. 257 * 255 = 65535, so the bytes map exactly */
+    Level &base = levels_[0];
+    base.dimension = dimension;
+    base.values.resize(dimension * dimension);
+    for (int y = 0; y < dimension; ++y) {
+        const unsigned char *row0 = heights + y * dimension;
+        const unsigned char *row1 = heights + std::min(y + 1, dimension - 1) * dimension;
+        for (int x = 0; x < dimension; ++x) {
+            int x1 = std::min(x + 1, dimension - 1);
+            unsigned char min = std::min(std::min(row0[x], row0[x1]), std::min(row1[x], row1[x1]));
+            unsigned char max = std::max(std::max(row0[x], row0[x1]), std::max(row1[x], row1[x1]));
+            base.values[y * dimension + x] = glm::u16vec2(min * 257, max * 257);
+        }
+    }
+
+    base.tilts.resize(tilts ? dimension * dimension : 0);
+    if (tilts) {
+        for (int y = 0; y < dimension; ++y) {
+            const unsigned char *row0 = tilts + y * dimension;
+            const unsigned char *row1 = tilts + std::min(y + 1, dimension - 1) * dimension;
+            for (int x = 0; x < dimension; ++x) {
+                int x1 = std::min(x + 1, dimension - 1);
+                base.tilts[y * dimension + x] = std::max(std::max(row0[x], row0[x1]), std::max(row1[x], row1[x1]));
+            }
+        }
+    }
+
+    for (int i = 1; i < levelCount; ++i) {
+        int childDimension = levels_[i - 1].dimension;
+        Level &level = levels_[i];
+        level.dimension = (childDimension + 1) / 2;
+        level.values.resize(level.dimension * level.dimension);
+
+        const std::vector<glm::u16vec2> &child = levels_[i - 1].values;
+        const std::vector<unsigned char> &childTilts = levels_[i - 1].tilts;
+        level.tilts.resize(childTilts.empty() ? 0 : level.dimension * level.dimension);
+        for (int y = 0; y < level.dimension; ++y) {
+            int cy0 = 2 * y;
+            int cy1 = std::min(cy0 + 1, childDimension - 1);
+            for (int x = 0; x < level.dimension; ++x) {
+                int cx0 = 2 * x;
+                int cx1 = std::min(cx0 + 1, childDimension - 1);
+                glm::u16vec2 a = child[cy0 * childDimension + cx0];
+                glm::u16vec2 b = child[cy0 * childDimension + cx1];
+                glm::u16vec2 c = child[cy1 * childDimension + cx0];
+                glm::u16vec2 d = child[cy1 * childDimension + cx1];
+                level.values[y * level.dimension + x] = glm::u16vec2(std::min(std::min(a.x, b.x), std::min(c.x, d.x)),
+                                                                     std::max(std::max(a.y, b.y), std::max(c.y, d.y)));
+                if (!childTilts.empty())
+                    level.tilts[y * level.dimension + x] =
+                        std::max(std::max(childTilts[cy0 * childDimension + cx0], childTilts[cy0 * childDimension + cx1]),
+                                 std::max(childTilts[cy1 * childDimension + cx0], childTilts[cy1 * childDimension + cx1]));
+            }
+        }
+    }
+}
+
+/*
+ * Clamps the area to the map and returns the first level with blocks at least as large as the area.
+ * There the area touches at most 2x2 blocks, the coordinates are converted to block coordinates (inclusive).
+ */
+int HeightPyramid::getQueryLevel(int &x0, int &y0, int &x1, int &y1) {
+    int dimension = levels_[0].dimension;
+    x0 = glm::clamp(x0, 0, dimension - 1);
+    y0 = glm::clamp(y0, 0, dimension - 1);
+    x1 = glm::clamp(x1, x0 + 1, dimension);
+    y1 = glm::clamp(y1, y0 + 1, dimension);
+
+    int size = std::max(x1 - x0, y1 - y0);
+    int k = 0;
+    while ((1 << k) < size && k < (int)levels_.size() - 1)
+        ++k;
+
+    x0 >>= k;
+    y0 >>= k;
+    x1 = (x1 - 1) >> k;
+    y1 = (y1 - 1) >> k;
+    return k;
+}
+
+void HeightPyramid::getMinMax(int x0, int y0, int x1, int y1, float *minHeight, float *maxHeight) {
+    if (levels_.empty()) {
+        fprintf(stdout, "[HEIGHTPYRAMID::getMinMax] Error: Pyramid has not been built\n");
+        *minHeight = *maxHeight = 0.0f;
+        return;
+    }
+
+    Level &level = levels_[getQueryLevel(x0, y0, x1, y1)];
+    glm::u16vec2 result(65535, 0);
+    for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+            glm::u16vec2 v = level.values[y * level.dimension + x];
+            result.x = std::min(result.x, v.x);
+            result.y = std::max(result.y, v.y);
+        }
+    }
+
+    *minHeight = lowerBound_ + result.x * scale_;
+    *maxHeight = lowerBound_ + result.y * scale_;
+}
+
+float HeightPyramid::getMaxTilt(int x0, int y0, int x1, int y1) {
+    if (levels_.empty() || levels_[0].tilts.empty())
+        return glm::half_pi<float>();
+
+    Level &level = levels_[getQueryLevel(x0, y0, x1, y1)];
+    unsigned char result = 0;
+    for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x)
+            result = std::max(result, level.tilts[y * level.dimension + x]);
+    }
+
+    return result * glm::half_pi<float>() / 255.0f;
+}
+
+int HeightPyramid::getDimension() {
+    return levels_.empty() ? 0 : levels_[0].dimension;
+}
+
+size_t HeightPyramid::getMemoryUsage() {
+    size_t bytes = 0;
+    for (Level &level : levels_)
+        bytes += level.values.size() * sizeof(glm::u16vec2) + level.tilts.size();
+    return bytes;
+}
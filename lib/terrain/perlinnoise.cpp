@@ -1,8 +1,44 @@
 #include "perlinnoise.hpp"
+#include <algorithm>
 #include <cstdio>
 #include <glm/glm.hpp>
 #include <random>
 
+#ifdef PERLINNOISE_SIMD
+#include "perlinnoisesimd.hpp"
+#endif
+
+namespace {
+enum class NoiseKernelType { SCALAR, SSE4, AVX2 };
+
+/* Picked once per process, depending on what the cpu supports */
+NoiseKernelType getNoiseKernel() {
+#ifdef PERLINNOISE_SIMD
+    static const NoiseKernelType kernel = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return NoiseKernelType::AVX2;
+        if (__builtin_cpu_supports("sse4.1"))
+            return NoiseKernelType::SSE4;
+        return NoiseKernelType::SCALAR;
+    }();
+    return kernel;
+#else
+    return NoiseKernelType::SCALAR;
+#endif
+}
+
+/*
+ * Interpolates value and gradient (v, dx, dy, dz) of two corners.
+ * The weight w only depends on one axis, its derivative dw adds to that component.
+ */
+void lerpDeriv(float w, float dw, int axis, const float *a, const float *b, float *out) {
+    for (int i = 0; i < 4; ++i)
+        out[i] = a[i] + w * (b[i] - a[i]);
+    out[axis + 1] = out[axis + 1] + dw * (b[0] - a[0]);
+}
+} // namespace
+
 PerlinNoise::PerlinNoise() : PerlinNoise(DEFAULT_OCTAVES, DEFAULT_AMPLITUDE, DEFAULT_ROUGHNESS, DEFAULT_HEIGHT_OFFSET_FACTOR) {}
 PerlinNoise::PerlinNoise(int octaves, float amplitude, float roughness, int heightOffsetFactor, unsigned int seed)
     : octaves_(octaves), amplitude_(amplitude), roughness_(roughness), seed_(seed) {
@@ -14,6 +50,18 @@ PerlinNoise::PerlinNoise(int octaves, float amplitude, float roughness, int heig
     heightOffset_ = heightOffsetFactor == 0 ? 0 : (amplitude_ / heightOffsetFactor);
     lowerBound_ = 0 - amplitude_ + heightOffset_;
     upperBound_ = amplitude_ + heightOffset_;
+    initOctaves();
+}
+
+/* Frequency and amplitude per octave only depend on the constructor parameters */
+void PerlinNoise::initOctaves() {
+    octaveFrequencies_.resize(octaves_);
+    octaveAmplitudes_.resize(octaves_);
+    float d = (float)glm::pow(2, octaves_ - 1);
+    for (int i = 0; i < octaves_; i++) {
+        octaveFrequencies_[i] = (float)(glm::pow(2, i) / d);
+        octaveAmplitudes_[i] = (float)glm::pow(roughness_, i) * amplitude_;
+    }
 }
 
 /*
@@ -24,25 +72,141 @@ PerlinNoise::PerlinNoise(int octaves, float amplitude, float roughness, int heig
  * Other ideas: Increasing frequency. Decreasing amplitude
  */
 float PerlinNoise::getNoise2d(int x, int y) {
+    return fbm2d(x, y, 0, octaves_);
+}
+
+float PerlinNoise::getNoise3d(int x, int y, int z) {
+    return fbm3d(x, y, z, 0, octaves_);
+}
+
+/* Octave i has a wavelength of 2^(octaves - 1 - i) */
+int PerlinNoise::getOctavesForSpacing(float sampleSpacing) {
+    int count = 0;
+    while (count < octaves_ && 1.0f / octaveFrequencies_[count] >= sampleSpacing)
+        ++count;
+    return count;
+}
+
+/* A single octave of noise2d / noise3d stays inside [-1, 1] */
+float PerlinNoise::getResidualAmplitude(int firstSkipped) {
+    float residual = 0.0f;
+    for (int i = std::max(firstSkipped, 0); i < octaves_; ++i)
+        residual += octaveAmplitudes_[i];
+    return residual;
+}
+
+int PerlinNoise::clampOctaves(int octaves) {
+    return (octaves < 0 || octaves > octaves_) ? octaves_ : octaves;
+}
+
+float PerlinNoise::fbm2d(float x, float y, int firstOctave, int octaves) {
     float total = 0;
-    float d = (float)glm::pow(2, octaves_ - 1);
-    for (int i = 0; i < octaves_; i++) {
-        float freq = (float)(glm::pow(2, i) / d);
-        float amp = (float)glm::pow(roughness_, i) * amplitude_;
-        total += noise2d(x * freq, y * freq) * amp;
+    for (int i = firstOctave; i < octaves; i++) {
+        float freq = octaveFrequencies_[i];
+        total += noise2d(x * freq, y * freq) * octaveAmplitudes_[i];
     }
-    return total + heightOffset_;
+    return firstOctave == 0 ? total + heightOffset_ : total;
 }
 
-float PerlinNoise::getNoise3d(int x, int y, int z) {
+float PerlinNoise::fbm3d(float x, float y, float z, int firstOctave, int octaves) {
     float total = 0;
-    float d = (float)glm::pow(2, octaves_ - 1);
-    for (int i = 0; i < octaves_; i++) {
-        float freq = (float)(glm::pow(2, i) / d);
-        float amp = (float)glm::pow(roughness_, i) * amplitude_;
-        total += noise3d(x * freq, y * freq, z * freq) * amp;
+    for (int i = firstOctave; i < octaves; i++) {
+        float freq = octaveFrequencies_[i];
+        total += noise3d(x * freq, y * freq, z * freq) * octaveAmplitudes_[i];
+    }
+    return firstOctave == 0 ? total + heightOffset_ : total;
+}
+
+float PerlinNoise::getNoise2dDeriv(int x, int y, float *dx, float *dy) {
+    return fbm2dDeriv(x, y, 0, octaves_, dx, dy);
+}
+
+float PerlinNoise::getNoise3dDeriv(int x, int y, int z, float *dx, float *dy, float *dz) {
+    return fbm3dDeriv(x, y, z, 0, octaves_, dx, dy, dz);
+}
+
+/* The gradient of every octave is scaled by its amplitude and, by the chain rule, its frequency */
+float PerlinNoise::fbm2dDeriv(float x, float y, int firstOctave, int octaves, float *dx, float *dy) {
+    float total = 0;
+    *dx = *dy = 0;
+    for (int i = firstOctave; i < octaves; i++) {
+        float freq = octaveFrequencies_[i];
+        float scale = octaveAmplitudes_[i] * freq;
+        float nx, ny;
+        total += noise2dDeriv(x * freq, y * freq, &nx, &ny) * octaveAmplitudes_[i];
+        *dx += nx * scale;
+        *dy += ny * scale;
+    }
+    return firstOctave == 0 ? total + heightOffset_ : total;
+}
+
+float PerlinNoise::fbm3dDeriv(float x, float y, float z, int firstOctave, int octaves, float *dx, float *dy, float *dz) {
+    float total = 0;
+    *dx = *dy = *dz = 0;
+    for (int i = firstOctave; i < octaves; i++) {
+        float freq = octaveFrequencies_[i];
+        float scale = octaveAmplitudes_[i] * freq;
+        float nx, ny, nz;
+        total += noise3dDeriv(x * freq, y * freq, z * freq, &nx, &ny, &nz) * octaveAmplitudes_[i];
+        *dx += nx * scale;
+        *dy += ny * scale;
+        *dz += nz * scale;
+    }
+    return firstOctave == 0 ? total + heightOffset_ : total;
+}
+
+void PerlinNoise::getNoise2dRow(int x0, int y, int count, float *out, float *dx, float *dy, int octaves, int firstOctave) {
+    std::vector<float> xs(count);
+    std::vector<float> ys(count, (float)y);
+    for (int i = 0; i < count; ++i)
+        xs[i] = (float)(x0 + i);
+
+    getNoise2dBatch(xs.data(), ys.data(), count, out, dx, dy, octaves, firstOctave);
+}
+
+void PerlinNoise::getNoise2dBatch(const float *xs, const float *ys, int n, float *out, float *dx, float *dy, int octaves, int firstOctave) {
+    octaves = clampOctaves(octaves);
+#ifdef PERLINNOISE_SIMD
+    float offset = firstOctave == 0 ? (float)heightOffset_ : 0.0f;
+    NoiseKernelData data = {p.data(), octaveFrequencies_.data(), octaveAmplitudes_.data(), firstOctave, octaves, offset};
+    switch (getNoiseKernel()) {
+        case NoiseKernelType::AVX2:
+            dx ? fbm2dDerivAvx2(data, xs, ys, n, out, dx, dy) : fbm2dAvx2(data, xs, ys, n, out);
+            return;
+        case NoiseKernelType::SSE4:
+            dx ? fbm2dDerivSse4(data, xs, ys, n, out, dx, dy) : fbm2dSse4(data, xs, ys, n, out);
+            return;
+        default:
+            break;
     }
-    return total + heightOffset_;
+#endif
+    for (int i = 0; i < n; ++i)
+        out[i] = dx ? fbm2dDeriv(xs[i], ys[i], firstOctave, octaves, &dx[i], &dy[i]) : fbm2d(xs[i], ys[i], firstOctave, octaves);
+}
+
+void PerlinNoise::getNoise3dBatch(const float *xs, const float *ys, const float *zs, int n, float *out, float *dx,
+                                  float *dy, float *dz, int octaves, int firstOctave) {
+    octaves = clampOctaves(octaves);
+#ifdef PERLINNOISE_SIMD
+    float offset = firstOctave == 0 ? (float)heightOffset_ : 0.0f;
+    NoiseKernelData data = {p.data(), octaveFrequencies_.data(), octaveAmplitudes_.data(), firstOctave, octaves, offset};
+    switch (getNoiseKernel()) {
+        case NoiseKernelType::AVX2:
+            dx ? fbm3dDerivAvx2(data, xs, ys, zs, n, out, dx, dy, dz) : fbm3dAvx2(data, xs, ys, zs, n, out);
+            return;
+        case NoiseKernelType::SSE4:
+            dx ? fbm3dDerivSse4(data, xs, ys, zs, n, out, dx, dy, dz) : fbm3dSse4(data, xs, ys, zs, n, out);
+            return;
+        default:
+            break;
+    }
+#endif
+    for (int i = 0; i < n; ++i)
+        out[i] = dx ? fbm3dDeriv(xs[i], ys[i], zs[i], firstOctave, octaves, &dx[i], &dy[i], &dz[i]) : fbm3d(xs[i], ys[i], zs[i], firstOctave, octaves);
+}
+
+int PerlinNoise::getOctaves() {
+    return octaves_;
 }
 
 float PerlinNoise::getAmplitude() {
@@ -148,10 +312,115 @@ float PerlinNoise::noise3d(float x, float y, float z) {
     return 0.936f * (lerp(s, n0, n1));
 }
 
+/*
+ * noise2d with the partial derivatives.
+ * The value goes through exactly the same operations as noise2d.
+ */
+float PerlinNoise::noise2dDeriv(float x, float y, float *dx, float *dy) {
+    int ix0, iy0, ix1, iy1;
+    float fx0, fy0, fx1, fy1;
+    float s, t, ds, dt;
+
+    ix0 = (int)glm::floor(x);
+    iy0 = (int)glm::floor(y);
+    fx0 = x - ix0;
+    fy0 = y - iy0;
+    fx1 = fx0 - 1.0f;
+    fy1 = fy0 - 1.0f;
+    ix1 = (ix0 + 1) & 0xff;
+    iy1 = (iy0 + 1) & 0xff;
+    ix0 = ix0 & 0xff;
+    iy0 = iy0 & 0xff;
+
+    t = fade(fy0);
+    s = fade(fx0);
+    dt = fadeDeriv(fy0);
+    ds = fadeDeriv(fx0);
+
+    /* Corners as (value, dx, dy, dz) */
+    float c00[4] = {grad(p[ix0 + p[iy0]], fx0, fy0), 0, 0, 0};
+    float c01[4] = {grad(p[ix0 + p[iy1]], fx0, fy1), 0, 0, 0};
+    float c10[4] = {grad(p[ix1 + p[iy0]], fx1, fy0), 0, 0, 0};
+    float c11[4] = {grad(p[ix1 + p[iy1]], fx1, fy1), 0, 0, 0};
+    gradDeriv(p[ix0 + p[iy0]], &c00[1], &c00[2]);
+    gradDeriv(p[ix0 + p[iy1]], &c01[1], &c01[2]);
+    gradDeriv(p[ix1 + p[iy0]], &c10[1], &c10[2]);
+    gradDeriv(p[ix1 + p[iy1]], &c11[1], &c11[2]);
+
+    float n0[4], n1[4], n[4];
+    lerpDeriv(t, dt, 1, c00, c01, n0);
+    lerpDeriv(t, dt, 1, c10, c11, n1);
+    lerpDeriv(s, ds, 0, n0, n1, n);
+
+    *dx = 0.507f * n[1];
+    *dy = 0.507f * n[2];
+    return 0.507f * n[0];
+}
+
+/*
+ * noise3d with the partial derivatives.
+ * The value goes through exactly the same operations as noise3d.
+ */
+float PerlinNoise::noise3dDeriv(float x, float y, float z, float *dx, float *dy, float *dz) {
+    int ix[2], iy[2], iz[2];
+    float fx[2], fy[2], fz[2];
+    float s, t, r, ds, dt, dr;
+
+    ix[0] = (int)glm::floor(x);
+    iy[0] = (int)glm::floor(y);
+    iz[0] = (int)glm::floor(z);
+    fx[0] = x - ix[0];
+    fy[0] = y - iy[0];
+    fz[0] = z - iz[0];
+    fx[1] = fx[0] - 1.0f;
+    fy[1] = fy[0] - 1.0f;
+    fz[1] = fz[0] - 1.0f;
+    ix[1] = (ix[0] + 1) & 0xff;
+    iy[1] = (iy[0] + 1) & 0xff;
+    iz[1] = (iz[0] + 1) & 0xff;
+    ix[0] = ix[0] & 0xff;
+    iy[0] = iy[0] & 0xff;
+    iz[0] = iz[0] & 0xff;
+
+    r = fade(fz[0]);
+    t = fade(fy[0]);
+    s = fade(fx[0]);
+    dr = fadeDeriv(fz[0]);
+    dt = fadeDeriv(fy[0]);
+    ds = fadeDeriv(fx[0]);
+
+    float nx[2][4];
+    for (int i = 0; i < 2; ++i) {
+        float ny[2][4];
+        for (int j = 0; j < 2; ++j) {
+            float c[2][4];
+            for (int k = 0; k < 2; ++k) {
+                int hash = p[ix[i] + p[iy[j] + p[iz[k]]]];
+                c[k][0] = grad(hash, fx[i], fy[j], fz[k]);
+                gradDeriv(hash, &c[k][1], &c[k][2], &c[k][3]);
+            }
+            lerpDeriv(r, dr, 2, c[0], c[1], ny[j]);
+        }
+        lerpDeriv(t, dt, 1, ny[0], ny[1], nx[i]);
+    }
+
+    float n[4];
+    lerpDeriv(s, ds, 0, nx[0], nx[1], n);
+
+    *dx = 0.936f * n[1];
+    *dy = 0.936f * n[2];
+    *dz = 0.936f * n[3];
+    return 0.936f * n[0];
+}
+
 float PerlinNoise::fade(float t) {
     return t * t * t * (t * (t * 6 - 15) + 10);
 }
 
+float PerlinNoise::fadeDeriv(float t) {
+    return 30 * t * t * (t * (t - 2) + 1);
+}
+
 float PerlinNoise::lerp(float t, float a, float b) {
     return a + t * (b - a);
 }
@@ -169,4 +438,31 @@ float PerlinNoise::grad(int hash, float x, float y, float z) {
     float u = h<8 ? x : y;
     float v = h<4 ? y : h==12||h==14 ? x : z;
     return ((h&1)? -u : u) + ((h&2)? -v : v);
+}
+
+/* grad is linear in the offsets, the partial derivatives only depend on the hash */
+void PerlinNoise::gradDeriv(int hash, float *gx, float *gy) {
+    int h = hash & 7;
+    float su = (h & 1) ? -1.0f : 1.0f;
+    float sv = (h & 2) ? -2.0f : 2.0f;
+    *gx = h < 4 ? su : sv;
+    *gy = h < 4 ? sv : su;
+}
+
+void PerlinNoise::gradDeriv(int hash, float *gx, float *gy, float *gz) {
+    int h = hash & 15;
+    float su = (h & 1) ? -1.0f : 1.0f;
+    float sv = (h & 2) ? -1.0f : 1.0f;
+    *gx = *gy = *gz = 0.0f;
+    if (h < 8)
+        *gx += su;
+    else
+        *gy += su;
+
+    if (h < 4)
+        *gy += sv;
+    else if (h == 12 || h == 14)
+        *gx += sv;
+    else
+        *gz += sv;
 }
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include <immintrin.h>
+
+/* Compiled with -mavx2, only called if the cpu supports it */
+namespace {
+struct Avx2Lanes {
+    typedef __m256 F;
+    typedef __m256i I;
+    static const int width = 8;
+
+    static F load(const float *p) {
+        return _mm256_loadu_ps(p);
+    }
+    static void store(float *p, F v) {
+        _mm256_storeu_ps(p, v);
+    }
+    static F set1(float f) {
+        return _mm256_set1_ps(f);
+    }
+    static I set1i(int i) {
+        return _mm256_set1_epi32(i);
+    }
+    static F add(F a, F b) {
+        return _mm256_add_ps(a, b);
+    }
+    static F sub(F a, F b) {
+        return _mm256_sub_ps(a, b);
+    }
+    static F mul(F a, F b) {
+        return _mm256_mul_ps(a, b);
+    }
+    static F floor(F a) {
+        return _mm256_floor_ps(a);
+    }
+    static I toInt(F a) {
+        return _mm256_cvttps_epi32(a);
+    }
+    static F toFloat(I a) {
+        return _mm256_cvtepi32_ps(a);
+    }
+    static I addi(I a, I b) {
+        return _mm256_add_epi32(a, b);
+    }
+    static I andi(I a, I b) {
+        return _mm256_and_si256(a, b);
+    }
+    static I ori(I a, I b) {
+        return _mm256_or_si256(a, b);
+    }
+    static I shiftLeft(I a, int n) {
+        return _mm256_sll_epi32(a, _mm_cvtsi32_si128(n));
+    }
+    static I cmpEq(I a, I b) {
+        return _mm256_cmpeq_epi32(a, b);
+    }
+    static I cmpLt(I a, I b) {
+        return _mm256_cmpgt_epi32(b, a);
+    }
+    /* mask ? a : b */
+    static F select(I mask, F a, F b) {
+        return _mm256_blendv_ps(b, a, _mm256_castsi256_ps(mask));
+    }
+    static F flipSign(F v, I signBits) {
+        return _mm256_xor_ps(v, _mm256_castsi256_ps(signBits));
+    }
+    static I gather(const int *table, I idx) {
+        return _mm256_i32gather_epi32(table, idx, 4);
+    }
+};
+} // namespace
+
+#include "perlinnoisekernel.hpp"
+
+void fbm2dAvx2(const NoiseKernelData &data, const float *xs, const float *ys, int n, float *out) {
+    NoiseKernel<Avx2Lanes>::fbm2dBatch(data, xs, ys, n, out);
+}
+
+void fbm3dAvx2(const NoiseKernelData &data, const float *xs, const float *ys, const float *zs, int n, float *out) {
+    NoiseKernel<Avx2Lanes>::fbm3dBatch(data, xs, ys, zs, n, out);
+}
+
+void fbm2dDerivAvx2(const NoiseKernelData &data, const float *xs, const float *ys, int n, float *out, float *dx, float *dy) {
+    NoiseKernel<Avx2Lanes>::fbm2dDerivBatch(data, xs, ys, n, out, dx, dy);
+}
+
+void fbm3dDerivAvx2(const NoiseKernelData &data, const float *xs, const float *ys, const float *zs, int n, float *out,
+                    float *dx, float *dy, float *dz) {
+    NoiseKernel<Avx2Lanes>::fbm3dDerivBatch(data, xs, ys, zs, n, out, dx, dy, dz);
+}
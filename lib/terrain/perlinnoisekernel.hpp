@@ -0,0 +1,435 @@
+#ifndef PERLINNOISEKERNEL_HPP
+#define PERLINNOISEKERNEL_HPP
+
+#include "perlinnoisesimd.hpp"
+
+/*
+ * fBm kernel shared by the SSE4.1 and AVX2 translation units.
+ * V is a thin lane wrapper around the intrinsics of one instruction set (see perlinnoisesse4.cpp).
+ *
+ * Every operation mirrors PerlinNoise::noise2d / noise3d in the same order, without
+ * fused multiply-add, so each lane produces exactly the float the scalar path produces.
+ *
+ * Everything is in an anonymous namespace on purpose: both translation units include this
+ * header with different compiler flags, the instantiations must never be merged by the linker.
+ */
+namespace {
+
+template <class V> struct NoiseKernel {
+    typedef typename V::F F;
+    typedef typename V::I I;
+
+    /* t * t * t * (t * (t * 6 - 15) + 10) */
+    static F fade(F t) {
+        F inner = V::add(V::mul(t, V::sub(V::mul(t, V::set1(6.0f)), V::set1(15.0f))), V::set1(10.0f));
+        return V::mul(V::mul(V::mul(t, t), t), inner);
+    }
+
+    static F lerp(F t, F a, F b) {
+        return V::add(a, V::mul(t, V::sub(b, a)));
+    }
+
+    /* Derivative of fade: 30 * t * t * (t * (t - 2) + 1) */
+    static F fadeDeriv(F t) {
+        F inner = V::add(V::mul(t, V::sub(t, V::set1(2.0f))), V::set1(1.0f));
+        return V::mul(V::mul(V::mul(V::set1(30.0f), t), t), inner);
+    }
+
+    /* Moves bit 'bit' of h into the float sign bit, so xor-ing it negates the lanes where the bit is set */
+    static I signMask(I h, int bit, int shift) {
+        return V::shiftLeft(V::andi(h, V::set1i(bit)), shift);
+    }
+
+    static F grad(I hash, F x, F y) {
+        I h = V::andi(hash, V::set1i(7));
+        I lt4 = V::cmpLt(h, V::set1i(4));
+        F u = V::select(lt4, x, y);
+        F v = V::mul(V::set1(2.0f), V::select(lt4, y, x));
+        return V::add(V::flipSign(u, signMask(h, 1, 31)), V::flipSign(v, signMask(h, 2, 30)));
+    }
+
+    static F grad(I hash, F x, F y, F z) {
+        I h = V::andi(hash, V::set1i(15));
+        F u = V::select(V::cmpLt(h, V::set1i(8)), x, y);
+        I hx = V::ori(V::cmpEq(h, V::set1i(12)), V::cmpEq(h, V::set1i(14)));
+        F v = V::select(V::cmpLt(h, V::set1i(4)), y, V::select(hx, x, z));
+        return V::add(V::flipSign(u, signMask(h, 1, 31)), V::flipSign(v, signMask(h, 2, 30)));
+    }
+
+    /* grad() is linear in the offsets, so its partial derivatives only depend on the hash */
+    static void gradDeriv(I hash, F &gx, F &gy) {
+        I h = V::andi(hash, V::set1i(7));
+        I lt4 = V::cmpLt(h, V::set1i(4));
+        F su = V::flipSign(V::set1(1.0f), signMask(h, 1, 31));
+        F sv = V::flipSign(V::set1(2.0f), signMask(h, 2, 30));
+        gx = V::select(lt4, su, sv);
+        gy = V::select(lt4, sv, su);
+    }
+
+    static void gradDeriv(I hash, F &gx, F &gy, F &gz) {
+        I h = V::andi(hash, V::set1i(15));
+        F zero = V::set1(0.0f);
+        F su = V::flipSign(V::set1(1.0f), signMask(h, 1, 31));
+        F sv = V::flipSign(V::set1(1.0f), signMask(h, 2, 30));
+        I uIsX = V::cmpLt(h, V::set1i(8));
+        I vIsY = V::cmpLt(h, V::set1i(4));
+        I hx = V::ori(V::cmpEq(h, V::set1i(12)), V::cmpEq(h, V::set1i(14)));
+        F vx = V::select(vIsY, zero, V::select(hx, sv, zero));
+        F vz = V::select(vIsY, zero, V::select(hx, zero, sv));
+        gx = V::add(V::select(uIsX, su, zero), vx);
+        gy = V::add(V::select(uIsX, zero, su), V::select(vIsY, sv, zero));
+        gz = vz;
+    }
+
+    /* Value and gradient of one corner or one interpolation step */
+    struct Deriv {
+        F v, dx, dy, dz;
+    };
+
+    /* lerp of the value and the gradient, w only depends on the axis with the derivative dw */
+    static Deriv lerp(F w, F dw, int axis, const Deriv &a, const Deriv &b) {
+        Deriv o;
+        o.v = lerp(w, a.v, b.v);
+        o.dx = lerp(w, a.dx, b.dx);
+        o.dy = lerp(w, a.dy, b.dy);
+        o.dz = lerp(w, a.dz, b.dz);
+        F d = V::mul(dw, V::sub(b.v, a.v));
+        if (axis == 0)
+            o.dx = V::add(o.dx, d);
+        else if (axis == 1)
+            o.dy = V::add(o.dy, d);
+        else
+            o.dz = V::add(o.dz, d);
+        return o;
+    }
+
+    static Deriv corner(I hash, F x, F y) {
+        Deriv c;
+        c.v = grad(hash, x, y);
+        gradDeriv(hash, c.dx, c.dy);
+        c.dz = V::set1(0.0f);
+        return c;
+    }
+
+    static Deriv corner(I hash, F x, F y, F z) {
+        Deriv c;
+        c.v = grad(hash, x, y, z);
+        gradDeriv(hash, c.dx, c.dy, c.dz);
+        return c;
+    }
+
+    static F noise2d(const int *p, F x, F y) {
+        I ix0 = V::toInt(V::floor(x));
+        I iy0 = V::toInt(V::floor(y));
+        F fx0 = V::sub(x, V::toFloat(ix0));
+        F fy0 = V::sub(y, V::toFloat(iy0));
+        F fx1 = V::sub(fx0, V::set1(1.0f));
+        F fy1 = V::sub(fy0, V::set1(1.0f));
+        I mask = V::set1i(0xff);
+        I ix1 = V::andi(V::addi(ix0, V::set1i(1)), mask);
+        I iy1 = V::andi(V::addi(iy0, V::set1i(1)), mask);
+        ix0 = V::andi(ix0, mask);
+        iy0 = V::andi(iy0, mask);
+
+        F t = fade(fy0);
+        F s = fade(fx0);
+
+        I py0 = V::gather(p, iy0);
+        I py1 = V::gather(p, iy1);
+
+        F nx0 = grad(V::gather(p, V::addi(ix0, py0)), fx0, fy0);
+        F nx1 = grad(V::gather(p, V::addi(ix0, py1)), fx0, fy1);
+        F n0 = lerp(t, nx0, nx1);
+
+        nx0 = grad(V::gather(p, V::addi(ix1, py0)), fx1, fy0);
+        nx1 = grad(V::gather(p, V::addi(ix1, py1)), fx1, fy1);
+        F n1 = lerp(t, nx0, nx1);
+
+        return V::mul(V::set1(0.507f), lerp(s, n0, n1));
+    }
+
+    static F noise3d(const int *p, F x, F y, F z) {
+        I ix0 = V::toInt(V::floor(x));
+        I iy0 = V::toInt(V::floor(y));
+        I iz0 = V::toInt(V::floor(z));
+        F fx0 = V::sub(x, V::toFloat(ix0));
+        F fy0 = V::sub(y, V::toFloat(iy0));
+        F fz0 = V::sub(z, V::toFloat(iz0));
+        F fx1 = V::sub(fx0, V::set1(1.0f));
+        F fy1 = V::sub(fy0, V::set1(1.0f));
+        F fz1 = V::sub(fz0, V::set1(1.0f));
+        I mask = V::set1i(0xff);
+        I ix1 = V::andi(V::addi(ix0, V::set1i(1)), mask);
+        I iy1 = V::andi(V::addi(iy0, V::set1i(1)), mask);
+        I iz1 = V::andi(V::addi(iz0, V::set1i(1)), mask);
+        ix0 = V::andi(ix0, mask);
+        iy0 = V::andi(iy0, mask);
+        iz0 = V::andi(iz0, mask);
+
+        F r = fade(fz0);
+        F t = fade(fy0);
+        F s = fade(fx0);
+
+        I pz0 = V::gather(p, iz0);
+        I pz1 = V::gather(p, iz1);
+        I py0z0 = V::gather(p, V::addi(iy0, pz0));
+        I py0z1 = V::gather(p, V::addi(iy0, pz1));
+        I py1z0 = V::gather(p, V::addi(iy1, pz0));
+        I py1z1 = V::gather(p, V::addi(iy1, pz1));
+
+        F nxy0 = grad(V::gather(p, V::addi(ix0, py0z0)), fx0, fy0, fz0);
+        F nxy1 = grad(V::gather(p, V::addi(ix0, py0z1)), fx0, fy0, fz1);
+        F nx0 = lerp(r, nxy0, nxy1);
+
+        nxy0 = grad(V::gather(p, V::addi(ix0, py1z0)), fx0, fy1, fz0);
+        nxy1 = grad(V::gather(p, V::addi(ix0, py1z1)), fx0, fy1, fz1);
+        F nx1 = lerp(r, nxy0, nxy1);
+
+        F n0 = lerp(t, nx0, nx1);
+
+        nxy0 = grad(V::gather(p, V::addi(ix1, py0z0)), fx1, fy0, fz0);
+        nxy1 = grad(V::gather(p, V::addi(ix1, py0z1)), fx1, fy0, fz1);
+        nx0 = lerp(r, nxy0, nxy1);
+
+        nxy0 = grad(V::gather(p, V::addi(ix1, py1z0)), fx1, fy1, fz0);
+        nxy1 = grad(V::gather(p, V::addi(ix1, py1z1)), fx1, fy1, fz1);
+        nx1 = lerp(r, nxy0, nxy1);
+
+        F n1 = lerp(t, nx0, nx1);
+
+        return V::mul(V::set1(0.936f), lerp(s, n0, n1));
+    }
+
+    /* Same as noise2d, the value goes through the identical operations */
+    static Deriv noise2dDeriv(const int *p, F x, F y) {
+        I ix0 = V::toInt(V::floor(x));
+        I iy0 = V::toInt(V::floor(y));
+        F fx0 = V::sub(x, V::toFloat(ix0));
+        F fy0 = V::sub(y, V::toFloat(iy0));
+        F fx1 = V::sub(fx0, V::set1(1.0f));
+        F fy1 = V::sub(fy0, V::set1(1.0f));
+        I mask = V::set1i(0xff);
+        I ix1 = V::andi(V::addi(ix0, V::set1i(1)), mask);
+        I iy1 = V::andi(V::addi(iy0, V::set1i(1)), mask);
+        ix0 = V::andi(ix0, mask);
+        iy0 = V::andi(iy0, mask);
+
+        F t = fade(fy0);
+        F s = fade(fx0);
+        F dt = fadeDeriv(fy0);
+        F ds = fadeDeriv(fx0);
+
+        I py0 = V::gather(p, iy0);
+        I py1 = V::gather(p, iy1);
+
+        Deriv n0 = lerp(t, dt, 1, corner(V::gather(p, V::addi(ix0, py0)), fx0, fy0), corner(V::gather(p, V::addi(ix0, py1)), fx0, fy1));
+        Deriv n1 = lerp(t, dt, 1, corner(V::gather(p, V::addi(ix1, py0)), fx1, fy0), corner(V::gather(p, V::addi(ix1, py1)), fx1, fy1));
+        Deriv n = lerp(s, ds, 0, n0, n1);
+
+        F k = V::set1(0.507f);
+        n.v = V::mul(k, n.v);
+        n.dx = V::mul(k, n.dx);
+        n.dy = V::mul(k, n.dy);
+        return n;
+    }
+
+    /* Same as noise3d, the value goes through the identical operations */
+    static Deriv noise3dDeriv(const int *p, F x, F y, F z) {
+        I ix0 = V::toInt(V::floor(x));
+        I iy0 = V::toInt(V::floor(y));
+        I iz0 = V::toInt(V::floor(z));
+        F fx0 = V::sub(x, V::toFloat(ix0));
+        F fy0 = V::sub(y, V::toFloat(iy0));
+        F fz0 = V::sub(z, V::toFloat(iz0));
+        F fx1 = V::sub(fx0, V::set1(1.0f));
+        F fy1 = V::sub(fy0, V::set1(1.0f));
+        F fz1 = V::sub(fz0, V::set1(1.0f));
+        I mask = V::set1i(0xff);
+        I ix1 = V::andi(V::addi(ix0, V::set1i(1)), mask);
+        I iy1 = V::andi(V::addi(iy0, V::set1i(1)), mask);
+        I iz1 = V::andi(V::addi(iz0, V::set1i(1)), mask);
+        ix0 = V::andi(ix0, mask);
+        iy0 = V::andi(iy0, mask);
+        iz0 = V::andi(iz0, mask);
+
+        F r = fade(fz0);
+        F t = fade(fy0);
+        F s = fade(fx0);
+        F dr = fadeDeriv(fz0);
+        F dt = fadeDeriv(fy0);
+        F ds = fadeDeriv(fx0);
+
+        I pz0 = V::gather(p, iz0);
+        I pz1 = V::gather(p, iz1);
+        I py0z0 = V::gather(p, V::addi(iy0, pz0));
+        I py0z1 = V::gather(p, V::addi(iy0, pz1));
+        I py1z0 = V::gather(p, V::addi(iy1, pz0));
+        I py1z1 = V::gather(p, V::addi(iy1, pz1));
+
+        Deriv nx0 = lerp(r, dr, 2, corner(V::gather(p, V::addi(ix0, py0z0)), fx0, fy0, fz0), corner(V::gather(p, V::addi(ix0, py0z1)), fx0, fy0, fz1));
+        Deriv nx1 = lerp(r, dr, 2, corner(V::gather(p, V::addi(ix0, py1z0)), fx0, fy1, fz0), corner(V::gather(p, V::addi(ix0, py1z1)), fx0, fy1, fz1));
+        Deriv n0 = lerp(t, dt, 1, nx0, nx1);
+
+        nx0 = lerp(r, dr, 2, corner(V::gather(p, V::addi(ix1, py0z0)), fx1, fy0, fz0), corner(V::gather(p, V::addi(ix1, py0z1)), fx1, fy0, fz1));
+        nx1 = lerp(r, dr, 2, corner(V::gather(p, V::addi(ix1, py1z0)), fx1, fy1, fz0), corner(V::gather(p, V::addi(ix1, py1z1)), fx1, fy1, fz1));
+        Deriv n1 = lerp(t, dt, 1, nx0, nx1);
+
+        Deriv n = lerp(s, ds, 0, n0, n1);
+
+        F k = V::set1(0.936f);
+        n.v = V::mul(k, n.v);
+        n.dx = V::mul(k, n.dx);
+        n.dy = V::mul(k, n.dy);
+        n.dz = V::mul(k, n.dz);
+        return n;
+    }
+
+    static F fbm2d(const NoiseKernelData &data, F x, F y) {
+        F total = V::set1(0.0f);
+        for (int i = data.firstOctave; i < data.octaves; ++i) {
+            F freq = V::set1(data.frequencies[i]);
+            total = V::add(total, V::mul(noise2d(data.perm, V::mul(x, freq), V::mul(y, freq)), V::set1(data.amplitudes[i])));
+        }
+        return V::add(total, V::set1(data.heightOffset));
+    }
+
+    static F fbm3d(const NoiseKernelData &data, F x, F y, F z) {
+        F total = V::set1(0.0f);
+        for (int i = data.firstOctave; i < data.octaves; ++i) {
+            F freq = V::set1(data.frequencies[i]);
+            F n = noise3d(data.perm, V::mul(x, freq), V::mul(y, freq), V::mul(z, freq));
+            total = V::add(total, V::mul(n, V::set1(data.amplitudes[i])));
+        }
+        return V::add(total, V::set1(data.heightOffset));
+    }
+
+    /* The gradient of every octave is scaled by its amplitude and, by the chain rule, its frequency */
+    static Deriv fbm2dDeriv(const NoiseKernelData &data, F x, F y) {
+        Deriv total;
+        total.v = total.dx = total.dy = total.dz = V::set1(0.0f);
+        for (int i = data.firstOctave; i < data.octaves; ++i) {
+            F freq = V::set1(data.frequencies[i]);
+            F scale = V::set1(data.amplitudes[i] * data.frequencies[i]);
+            Deriv n = noise2dDeriv(data.perm, V::mul(x, freq), V::mul(y, freq));
+            total.v = V::add(total.v, V::mul(n.v, V::set1(data.amplitudes[i])));
+            total.dx = V::add(total.dx, V::mul(n.dx, scale));
+            total.dy = V::add(total.dy, V::mul(n.dy, scale));
+        }
+        total.v = V::add(total.v, V::set1(data.heightOffset));
+        return total;
+    }
+
+    static Deriv fbm3dDeriv(const NoiseKernelData &data, F x, F y, F z) {
+        Deriv total;
+        total.v = total.dx = total.dy = total.dz = V::set1(0.0f);
+        for (int i = data.firstOctave; i < data.octaves; ++i) {
+            F freq = V::set1(data.frequencies[i]);
+            F scale = V::set1(data.amplitudes[i] * data.frequencies[i]);
+            Deriv n = noise3dDeriv(data.perm, V::mul(x, freq), V::mul(y, freq), V::mul(z, freq));
+            total.v = V::add(total.v, V::mul(n.v, V::set1(data.amplitudes[i])));
+            total.dx = V::add(total.dx, V::mul(n.dx, scale));
+            total.dy = V::add(total.dy, V::mul(n.dy, scale));
+            total.dz = V::add(total.dz, V::mul(n.dz, scale));
+        }
+        total.v = V::add(total.v, V::set1(data.heightOffset));
+        return total;
+    }
+
+    /* Full blocks are loaded directly, the remainder goes through a zero padded block */
+    static void fbm2dBatch(const NoiseKernelData &data, const float *xs, const float *ys, int n, float *out) {
+        int i = 0;
+        for (; i + V::width <= n; i += V::width)
+            V::store(out + i, fbm2d(data, V::load(xs + i), V::load(ys + i)));
+
+        if (i < n) {
+            float x[V::width] = {}, y[V::width] = {}, o[V::width];
+            for (int j = 0; j < n - i; ++j) {
+                x[j] = xs[i + j];
+                y[j] = ys[i + j];
+            }
+            V::store(o, fbm2d(data, V::load(x), V::load(y)));
+            for (int j = 0; j < n - i; ++j)
+                out[i + j] = o[j];
+        }
+    }
+
+    static void fbm3dBatch(const NoiseKernelData &data, const float *xs, const float *ys, const float *zs, int n, float *out) {
+        int i = 0;
+        for (; i + V::width <= n; i += V::width)
+            V::store(out + i, fbm3d(data, V::load(xs + i), V::load(ys + i), V::load(zs + i)));
+
+        if (i < n) {
+            float x[V::width] = {}, y[V::width] = {}, z[V::width] = {}, o[V::width];
+            for (int j = 0; j < n - i; ++j) {
+                x[j] = xs[i + j];
+                y[j] = ys[i + j];
+                z[j] = zs[i + j];
+            }
+            V::store(o, fbm3d(data, V::load(x), V::load(y), V::load(z)));
+            for (int j = 0; j < n - i; ++j)
+                out[i + j] = o[j];
+        }
+    }
+
+    static void fbm2dDerivBatch(const NoiseKernelData &data, const float *xs, const float *ys, int n, float *out, float *dx, float *dy) {
+        int i = 0;
+        for (; i + V::width <= n; i += V::width) {
+            Deriv d = fbm2dDeriv(data, V::load(xs + i), V::load(ys + i));
+            V::store(out + i, d.v);
+            V::store(dx + i, d.dx);
+            V::store(dy + i, d.dy);
+        }
+
+        if (i < n) {
+            float x[V::width] = {}, y[V::width] = {}, o[V::width], ox[V::width], oy[V::width];
+            for (int j = 0; j < n - i; ++j) {
+                x[j] = xs[i + j];
+                y[j] = ys[i + j];
+            }
+            Deriv d = fbm2dDeriv(data, V::load(x), V::load(y));
+            V::store(o, d.v);
+            V::store(ox, d.dx);
+            V::store(oy, d.dy);
+            for (int j = 0; j < n - i; ++j) {
+                out[i + j] = o[j];
+                dx[i + j] = ox[j];
+                dy[i + j] = oy[j];
+            }
+        }
+    }
+
+    static void fbm3dDerivBatch(const NoiseKernelData &data, const float *xs, const float *ys, const float *zs, int n, float *out, float *dx, float *dy, float *dz) {
+        int i = 0;
+        for (; i + V::width <= n; i += V::width) {
+            Deriv d = fbm3dDeriv(data, V::load(xs + i), V::load(ys + i), V::load(zs + i));
+            V::store(out + i, d.v);
+            V::store(dx + i, d.dx);
+            V::store(dy + i, d.dy);
+            V::store(dz + i, d.dz);
+        }
+
+        if (i < n) {
+            float x[V::width] = {}, y[V::width] = {}, z[V::width] = {};
+            float o[V::width], ox[V::width], oy[V::width], oz[V::width];
+            for (int j = 0; j < n - i; ++j) {
+                x[j] = xs[i + j];
+                y[j] = ys[i + j];
+                z[j] = zs[i + j];
+            }
+            Deriv d = fbm3dDeriv(data, V::load(x), V::load(y), V::load(z));
+            V::store(o, d.v);
+            V::store(ox, d.dx);
+            V::store(oy, d.dy);
+            V::store(oz, d.dz);
+            for (int j = 0; j < n - i; ++j) {
+                out[i + j] = o[j];
+                dx[i + j] = ox[j];
+                dy[i + j] = oy[j];
+                dz[i + j] = oz[j];
+            }
+        }
+    }
+};
+
+} // namespace
+#endif
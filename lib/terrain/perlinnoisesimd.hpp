@@ -0,0 +1,29 @@
+#ifndef PERLINNOISESIMD_HPP
+#define PERLINNOISESIMD_HPP
+
+/*
+ * Vectorized fBm kernels used by the PerlinNoise batch functions.
+ * Each instruction set lives in its own translation unit, compiled with the matching
+ * compiler flags. PerlinNoise decides at runtime which one is safe to call.
+ */
+struct NoiseKernelData {
+    const int *perm; // 512 entry permutation table
+    const float *frequencies;
+    const float *amplitudes;
+    int firstOctave;
+    int octaves; // Octaves [firstOctave, octaves) are summed up
+    float heightOffset;
+};
+
+void fbm2dSse4(const NoiseKernelData &data, const float *xs, const float *ys, int n, float *out);
+void fbm3dSse4(const NoiseKernelData &data, const float *xs, const float *ys, const float *zs, int n, float *out);
+void fbm2dDerivSse4(const NoiseKernelData &data, const float *xs, const float *ys, int n, float *out, float *dx, float *dy);
+void fbm3dDerivSse4(const NoiseKernelData &data, const float *xs, const float *ys, const float *zs, int n, float *out,
+                    float *dx, float *dy, float *dz);
+
+void fbm2dAvx2(const NoiseKernelData &data, const float *xs, const float *ys, int n, float *out);
+void fbm3dAvx2(const NoiseKernelData &data, const float *xs, const float *ys, const float *zs, int n, float *out);
+void fbm2dDerivAvx2(const NoiseKernelData &data, const float *xs, const float *ys, int n, float *out, float *dx, float *dy);
+void fbm3dDerivAvx2(const NoiseKernelData &data, const float *xs, const float *ys, const float *zs, int n, float *out,
+                    float *dx, float *dy, float *dz);
+#endif
@@ -0,0 +1,91 @@
+#include <smmintrin.h>
+
+/* Compiled with -msse4.1, only called if the cpu supports it */
+namespace {
+struct Sse4Lanes {
+    typedef __m128 F;
+    typedef __m128i I;
+    static const int width = 4;
+
+    static F load(const float *p) {
+        return _mm_loadu_ps(p);
+    }
+    static void store(float *p, F v) {
+        _mm_storeu_ps(p, v);
+    }
+    static F set1(float f) {
+        return _mm_set1_ps(f);
+    }
+    static I set1i(int i) {
+        return _mm_set1_epi32(i);
+    }
+    static F add(F a, F b) {
+        return _mm_add_ps(a, b);
+    }
+    static F sub(F a, F b) {
+        return _mm_sub_ps(a, b);
+    }
+    static F mul(F a, F b) {
+        return _mm_mul_ps(a, b);
+    }
+    static F floor(F a) {
+        return _mm_floor_ps(a);
+    }
+    static I toInt(F a) {
+        return _mm_cvttps_epi32(a);
+    }
+    static F toFloat(I a) {
+        return _mm_cvtepi32_ps(a);
+    }
+    static I addi(I a, I b) {
+        return _mm_add_epi32(a, b);
+    }
+    static I andi(I a, I b) {
+        return _mm_and_si128(a, b);
+    }
+    static I ori(I a, I b) {
+        return _mm_or_si128(a, b);
+    }
+    static I shiftLeft(I a, int n) {
+        return _mm_sll_epi32(a, _mm_cvtsi32_si128(n));
+    }
+    static I cmpEq(I a, I b) {
+        return _mm_cmpeq_epi32(a, b);
+    }
+    static I cmpLt(I a, I b) {
+        return _mm_cmplt_epi32(a, b);
+    }
+    /* mask ? a : b */
+    static F select(I mask, F a, F b) {
+        return _mm_blendv_ps(b, a, _mm_castsi128_ps(mask));
+    }
+    static F flipSign(F v, I signBits) {
+        return _mm_xor_ps(v, _mm_castsi128_ps(signBits));
+    }
+    /* SSE has no gather instruction */
+    static I gather(const int *table, I idx) {
+        alignas(16) int i[4];
+        _mm_store_si128((I *)i, idx);
+        return _mm_set_epi32(table[i[3]], table[i[2]], table[i[1]], table[i[0]]);
+    }
+};
+} // namespace
+
+#include "perlinnoisekernel.hpp"
+
+void fbm2dSse4(const NoiseKernelData &data, const float *xs, const float *ys, int n, float *out) {
+    NoiseKernel<Sse4Lanes>::fbm2dBatch(data, xs, ys, n, out);
+}
+
+void fbm3dSse4(const NoiseKernelData &data, const float *xs, const float *ys, const float *zs, int n, float *out) {
+    NoiseKernel<Sse4Lanes>::fbm3dBatch(data, xs, ys, zs, n, out);
+}
+
+void fbm2dDerivSse4(const NoiseKernelData &data, const float *xs, const float *ys, int n, float *out, float *dx, float *dy) {
+    NoiseKernel<Sse4Lanes>::fbm2dDerivBatch(data, xs, ys, n, out, dx, dy);
+}
+
+void fbm3dDerivSse4(const NoiseKernelData &data, const float *xs, const float *ys, const float *zs, int n, float *out,
+                    float *dx, float *dy, float *dz) {
+    NoiseKernel<Sse4Lanes>::fbm3dDerivBatch(data, xs, ys, zs, n, out, dx, dy, dz);
+}
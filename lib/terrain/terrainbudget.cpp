@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <cmath>
+#include "terrainbudget.hpp"
+
+namespace {
+/* Range scale per step, 4 steps double the ranges and roughly quadruple the triangles */
+const float RANGE_SCALE_STEP = 1.189207f;
+const int MIN_RANGE_STEP = -4;
+const int MAX_RANGE_STEP = 8;
+/* Frames over budget before the ranges shrink, frames clearly below before they grow */
+const int OVER_BUDGET_FRAMES = 2;
+const int UNDER_BUDGET_FRAMES = 30;
+/* A step up has to leave this much of the budget unused, the gap to the step down is the hysteresis */
+const float STEP_UP_HEADROOM = 0.9f;
+
+/* Weight of the newest frame in the smoothed frame time */
+const float FRAME_TIME_SMOOTHING = 0.1f;
+/* Per frame change of the triangle budget while frames are too slow, or clearly fast enough */
+const float BUDGET_SHRINK = 0.97f;
+const float BUDGET_GROW = 1.005f;
+const float FRAME_TIME_HEADROOM = 0.85f;
+const float MIN_BUDGET_FACTOR = 0.125f;
+} // namespace
+
+void LodRangeController::setBudget(int triangles) {
+    if (!triangles)
+        step_ = 0;
+    if (!triangles || !budget_) {
+        overBudgetFrames_ = 0;
+        underBudgetFrames_ = 0;
+    }
+    budget_ = triangles;
+}
+
+int LodRangeController::getBudget() {
+    return budget_;
+}
+
+bool LodRangeController::update(int triangles) {
+    /* Nothing drawn says nothing about the ranges */
+    if (!budget_ || !triangles) {
+        overBudgetFrames_ = 0;
+        underBudgetFrames_ = 0;
+        return false;
+    }
+
+    int step = step_;
+    if (triangles > budget_) {
+        underBudgetFrames_ = 0;
+        if (++overBudgetFrames_ >= OVER_BUDGET_FRAMES) {
+            /* Far over budget takes several steps at once */
+            float steps = std::log((float)triangles / budget_) / (2.0f * std::log(RANGE_SCALE_STEP));
+            step = std::max(MIN_RANGE_STEP, step_ - std::max(1, (int)std::ceil(steps)));
+            overBudgetFrames_ = 0;
+        }
+    } else if (triangles * RANGE_SCALE_STEP * RANGE_SCALE_STEP < budget_ * STEP_UP_HEADROOM) {
+        overBudgetFrames_ = 0;
+        if (++underBudgetFrames_ >= UNDER_BUDGET_FRAMES) {
+            step = std::min(MAX_RANGE_STEP, step_ + 1);
+            underBudgetFrames_ = 0;
+        }
+    } else {
+        overBudgetFrames_ = 0;
+        underBudgetFrames_ = 0;
+    }
+
+    bool changed = step != step_;
+    step_ = step;
+    return changed;
+}
+
+float LodRangeController::getRangeScale() {
+    return std::pow(RANGE_SCALE_STEP, (float)step_);
+}
+
+void LodRangeController::scaleRanges(const std::vector<float> &baseRanges, std::vector<float> &ranges) {
+    ranges = baseRanges;
+    float scale = getRangeScale();
+    for (int i = (int)ranges.size() - 2; i >= 0; --i)
+        ranges[i] = std::min(baseRanges[i] * scale, ranges[i + 1] * 0.5f);
+}
+
+void TerrainBudget::setBudget(int triangles, float frameTime) {
+    triangles_ = triangles;
+    frameTime_ = frameTime;
+    if (!frameTime_)
+        factor_ = 1.0f;
+}
+
+int TerrainBudget::update(float frameTime) {
+    if (!triangles_ || frameTime_ <= 0.0f || frameTime <= 0.0f)
+        return triangles_;
+
+    smoothedFrameTime_ = smoothedFrameTime_ ? smoothedFrameTime_ + FRAME_TIME_SMOOTHING * (frameTime - smoothedFrameTime_) : frameTime;
+    if (smoothedFrameTime_ > frameTime_)
+        factor_ = std::max(MIN_BUDGET_FACTOR, factor_ * BUDGET_SHRINK);
+    else if (smoothedFrameTime_ < frameTime_ * FRAME_TIME_HEADROOM)
+        factor_ = std::min(1.0f, factor_ * BUDGET_GROW);
+    return (int)(triangles_ * factor_);
+}
+
+void TerrainBudget::split(int triangles, const std::vector<float> &screenSizes, std::vector<int> &budgets) {
+    float total = 0.0f;
+    for (float size : screenSizes)
+        total += size;
+
+    budgets.resize(screenSizes.size());
+    for (int i = 0; i < (int)screenSizes.size(); ++i)
+        budgets[i] = total > 0.0f ? (int)(triangles * (screenSizes[i] / total)) : 0;
+}
@@ -1,14 +1,23 @@
 #include "terraingenerator.hpp"
 
 #include <cstdio>
+#include <cmath>
 #include <algorithm>
 #include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
 #include <glm/gtx/norm.hpp>
 #include <glm/gtx/string_cast.hpp>
 
 #include "primitives.hpp"
 #include "textureloader.hpp"
 #include "terrainmeshdata.hpp"
+#include "global.hpp"
+#include "parallel.hpp"
+
+namespace {
+/* Every sample of a heightmap row evaluates all noise octaves, so a few rows already outweigh handing them to a worker */
+const int MIN_ROWS_PER_BAND = 8;
+} // namespace
 
 TerrainGenerator::TerrainGenerator() : colorGen_(ColorGenerator()), pNoise_(PerlinNoise()) {}
 TerrainGenerator::TerrainGenerator(PerlinNoise pNoise) : pNoise_(pNoise), colorGen_(ColorGenerator()) {}
@@ -62,16 +71,176 @@ Mesh *TerrainGenerator::generateTerrainMesh(GenerationAttributes *attr) {
     int dimension = attr->dimension + 3;
     TerrainMeshData meshData(dimension, attr->lod, attr->vertexType);
     generateTerrainMeshData(meshData, attr->position, dimension, attr->lod, attr->axis, attr->isFlat);
-    meshData.calculateNormals(false);
+    meshData.calculateNormals();
     return new Mesh(meshData.vertexData);
 }
 
+/*
+ * Generates the height and normal map in bands of rows on the thread pool.
+ * Normals come straight from the noise gradient, so no mesh or border vertices are needed
+ * and the bands are independent of each other.
+ * attr->dimension is the number of samples per side, attr->sampleSpacing the distance between them.
+ * Octaves that can't be represented at that spacing are not evaluated, see PerlinNoise::getOctavesForSpacing.
+ *
+ * With a parent field, its octaves are upsampled instead of evaluated. Compared to a full generation, the
+ * quantized heights then differ by at most one step, the normal components by at most 8 of 255 steps.
+ */
 void TerrainGenerator::generateTerrainHeightMap(GenerationAttributes *attr) {
-    int dimension = attr->dimension + 2;
-    TerrainMeshData meshData(dimension, 1, pNoise_, attr->heightData, attr->normalData, attr->vertexType);
-    generateTerrainHeightMapData(meshData, attr->position, dimension, 1, attr->axis, false);
-    meshData.calculateNormals(true);
-    meshData.destroy();
+    int dimension = attr->dimension;
+    int spacing = attr->sampleSpacing;
+    int offsetX = attr->position.x;
+    int offsetY = attr->position.y;
+    int octaves = pNoise_.getOctavesForSpacing(spacing);
+    float lowerBound = pNoise_.getLowerBound();
+    float upperBound = pNoise_.getUpperBound();
+
+    /* Without octaves in the parent field there is nothing to upsample */
+    const LowFrequencyField *parent = attr->parentLowFrequencyData;
+    if (parent && !parent->octaves)
+        parent = nullptr;
+
+    LowFrequencyField localField;
+    LowFrequencyField *field = attr->lowFrequencyData ? attr->lowFrequencyData : (parent ? &localField : nullptr);
+    int firstOctave = 0;
+    if (field && !attr->isFlat) {
+        generateLowFrequencyField(attr, parent, field);
+        firstOctave = field->octaves;
+    }
+
+    parallelFor(g_threadPool, 0, dimension, MIN_ROWS_PER_BAND, [&](int begin, int end) {
+        std::vector<glm::vec3> rowPositions(dimension);
+        std::vector<glm::vec4> rowNoise(dimension);
+
+        for (int y = begin; y < end; ++y) {
+            getRowPositions(attr->axis, offsetX, offsetY + y * spacing, dimension, spacing, rowPositions);
+            if (attr->isFlat)
+                std::fill(rowNoise.begin(), rowNoise.end(), glm::vec4(0.0f));
+            else
+                getRowNoise(rowPositions, dimension, firstOctave, octaves, rowNoise);
+
+            for (int x = 0; x < dimension; ++x) {
+                if (firstOctave)
+                    rowNoise[x] += field->samples[(y + LOW_FREQUENCY_BORDER) * field->dimension + x + LOW_FREQUENCY_BORDER];
+
+                glm::vec3 normal = getNoiseNormal(rowPositions[x], rowNoise[x]);
+                int index = y * dimension + x;
+                (*attr->heightData)[index] = mapRangeToUnsignedByte(rowNoise[x].x, lowerBound, upperBound);
+                (*attr->normalData)[index * 3] = mapRangeToUnsignedByte(normal.x, -1.0f, 1.0f);
+                (*attr->normalData)[index * 3 + 1] = mapRangeToUnsignedByte(normal.y, -1.0f, 1.0f);
+                (*attr->normalData)[index * 3 + 2] = mapRangeToUnsignedByte(normal.z, -1.0f, 1.0f);
+
+                if (attr->tiltData) {
+                    glm::vec3 up = sphereRadius_ ? glm::normalize(rowPositions[x] - sphereOrigin_) : glm::vec3(0, 1, 0);
+                    float tilt = std::acos(glm::clamp(glm::dot(normal, up), -1.0f, 1.0f));
+                    (*attr->tiltData)[index] = (unsigned char)glm::clamp(std::ceil(tilt * 255.0f / glm::half_pi<float>()), 0.0f, 255.0f);
+                }
+            }
+        }
+    });
+}
+
+/*
+ * Evaluates the octaves that have enough samples per wavelength at this spacing, including the border.
+ * Octaves already contained in the parent are upsampled from it.
+ */
+void TerrainGenerator::generateLowFrequencyField(GenerationAttributes *attr, const LowFrequencyField *parent, LowFrequencyField *field) {
+    int spacing = attr->sampleSpacing;
+    int parentOctaves = parent ? parent->octaves : 0;
+    int lowOctaves = pNoise_.getOctavesForSpacing(LOW_FREQUENCY_SAMPLES_PER_WAVELENGTH * spacing);
+
+    field->position = attr->position;
+    field->dimension = attr->dimension + 2 * LOW_FREQUENCY_BORDER;
+    field->sampleSpacing = spacing;
+    field->octaves = glm::clamp(lowOctaves, parentOctaves, pNoise_.getOctavesForSpacing(spacing));
+    field->samples.assign(field->dimension * field->dimension, glm::vec4(0.0f));
+    if (!field->octaves)
+        return;
+
+    int x0 = attr->position.x - LOW_FREQUENCY_BORDER * spacing;
+    int y0 = attr->position.y - LOW_FREQUENCY_BORDER * spacing;
+
+    if (parent)
+        upsampleLowFrequencyField(parent, field, x0, y0);
+
+    parallelFor(g_threadPool, 0, field->dimension, MIN_ROWS_PER_BAND, [&](int begin, int end) {
+        std::vector<glm::vec3> rowPositions(field->dimension);
+        std::vector<glm::vec4> rowNoise(field->dimension);
+
+        for (int y = begin; y < end; ++y) {
+            getRowPositions(attr->axis, x0, y0 + y * spacing, field->dimension, spacing, rowPositions);
+            getRowNoise(rowPositions, field->dimension, parentOctaves, field->octaves, rowNoise);
+
+            for (int x = 0; x < field->dimension; ++x)
+                field->samples[y * field->dimension + x] += rowNoise[x];
+        }
+    });
+}
+
+/*
+ * Catmull-Rom stencil at the parent sample coordinate coord. Exact on the samples of the parent.
+ * Indices outside of the parent field are clamped to its border.
+ */
+void TerrainGenerator::getCatmullRomStencil(int parentDimension, float coord, glm::ivec4 &indices, glm::vec4 &weights) {
+    int i = (int)std::floor(coord);
+    float t = coord - i;
+
+    weights = glm::vec4(((-t + 2.0f) * t - 1.0f) * t * 0.5f, ((3.0f * t - 5.0f) * t * t + 2.0f) * 0.5f,
+                        ((-3.0f * t + 4.0f) * t + 1.0f) * t * 0.5f, (t - 1.0f) * t * t * 0.5f);
+    for (int k = 0; k < 4; ++k)
+        indices[k] = glm::clamp(i - 1 + k, 0, parentDimension - 1);
+}
+
+/*
+ * Bicubic upsampling of the parent field onto the samples of field, starting at the cube side coordinates x0, y0.
+ * The interpolation is separable, so the parent rows are interpolated along x first and the result along y.
+ */
+void TerrainGenerator::upsampleLowFrequencyField(const LowFrequencyField *parent, LowFrequencyField *field, int x0, int y0) {
+    int dimension = field->dimension;
+    float scale = (float)field->sampleSpacing / parent->sampleSpacing;
+    float parentX0 = (x0 - parent->position.x) / parent->sampleSpacing + LOW_FREQUENCY_BORDER;
+    float parentY0 = (y0 - parent->position.y) / parent->sampleSpacing + LOW_FREQUENCY_BORDER;
+
+    std::vector<glm::ivec4> colIndices(dimension), rowIndices(dimension);
+    std::vector<glm::vec4> colWeights(dimension), rowWeights(dimension);
+    for (int i = 0; i < dimension; ++i) {
+        getCatmullRomStencil(parent->dimension, parentX0 + i * scale, colIndices[i], colWeights[i]);
+        getCatmullRomStencil(parent->dimension, parentY0 + i * scale, rowIndices[i], rowWeights[i]);
+    }
+
+    int firstRow = rowIndices.front()[0];
+    int lastRow = rowIndices.back()[3];
+    std::vector<glm::vec4> rows((lastRow - firstRow + 1) * dimension);
+    parallelFor(g_threadPool, 0, lastRow - firstRow + 1, MIN_ROWS_PER_BAND, [&](int begin, int end) {
+        for (int r = firstRow + begin; r < firstRow + end; ++r) {
+            const glm::vec4 *parentRow = &parent->samples[r * parent->dimension];
+            glm::vec4 *row = &rows[(r - firstRow) * dimension];
+            for (int x = 0; x < dimension; ++x) {
+                glm::ivec4 &c = colIndices[x];
+                glm::vec4 &w = colWeights[x];
+                row[x] = w[0] * parentRow[c[0]] + w[1] * parentRow[c[1]] + w[2] * parentRow[c[2]] + w[3] * parentRow[c[3]];
+            }
+        }
+    });
+
+    parallelFor(g_threadPool, 0, dimension, MIN_ROWS_PER_BAND, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            glm::ivec4 &r = rowIndices[y];
+            glm::vec4 &w = rowWeights[y];
+            const glm::vec4 *r0 = &rows[(r[0] - firstRow) * dimension];
+            const glm::vec4 *r1 = &rows[(r[1] - firstRow) * dimension];
+            const glm::vec4 *r2 = &rows[(r[2] - firstRow) * dimension];
+            const glm::vec4 *r3 = &rows[(r[3] - firstRow) * dimension];
+            glm::vec4 *out = &field->samples[y * dimension];
+            for (int x = 0; x < dimension; ++x)
+                out[x] = w[0] * r0[x] + w[1] * r1[x] + w[2] * r2[x] + w[3] * r3[x];
+        }
+    });
+}
+
+unsigned char TerrainGenerator::mapRangeToUnsignedByte(float inVal, float lowerBound, float upperBound) {
+    float in = glm::clamp(inVal, lowerBound, upperBound);
+    float s = 255.0f / (upperBound - lowerBound);
+    return (unsigned char)(s * (in - lowerBound) + 0.5f); // Not negative, truncation rounds
 }
 
 glm::vec3 TerrainGenerator::getAxisPos(glm::vec3 &axis, int x, int y) {
@@ -113,61 +282,62 @@ glm::vec3 TerrainGenerator::getVertexPosition(glm::vec3 vertPos, float height) {
     return vertPos;
 }
 
-/* Generates height map */
-void TerrainGenerator::generateTerrainHeightMapData(TerrainMeshData &meshData, glm::vec2 &pos, int numVertsPerLine, int skipIncrement, glm::vec3 &axis, bool isFlat) {
-    int offsetX = pos.x;
-    int offsetY = pos.y;
-
-    /* Triangles on the opposite side of the sphere need to have a clock-wise winding order */
-    bool inverted = false;
-    if (axis.x == -1 || axis.z == 1 || axis.y == -1)
-        inverted = true;
-
-    int vertexIndicesMap[numVertsPerLine][numVertsPerLine];
-    int meshVertexIndex = 0;
-    int outOfMeshVertexIndex = -1;
-
-    for (int y = 0; y < numVertsPerLine; ++y) {
-        for (int x = 0; x < numVertsPerLine; ++x) {
-            bool isOutOfMeshVertex = y == 0 || y == numVertsPerLine - 1 || x == 0 || x == numVertsPerLine - 1;
-            bool isSkippedVertex = x > 0 && x < numVertsPerLine - 1 && y > 0 && y < numVertsPerLine - 1 && ((x - 1) % skipIncrement != 0 || (y - 1) % skipIncrement != 0);
-
-            if (isOutOfMeshVertex)
-                vertexIndicesMap[x][y] = outOfMeshVertexIndex--;
-            else if (!isSkippedVertex)
-                vertexIndicesMap[x][y] = meshVertexIndex++;
-        }
+/*
+ * Positions of a row of samples, spacing apart.
+ * They are moved to the sphere surface if sphereRadius > 0, same as getHeightValue.
+ */
+void TerrainGenerator::getRowPositions(glm::vec3 &axis, int x0, int y, int count, int spacing, std::vector<glm::vec3> &positions) {
+    for (int x = 0; x < count; ++x) {
+        glm::vec3 pos = getAxisPos(axis, x0 + x * spacing, y);
+        if (sphereRadius_)
+            pos = sphereOrigin_ + (float)sphereRadius_ * glm::normalize(pos - sphereOrigin_);
+        positions[x] = pos;
     }
+}
 
-    for (int y = 0; y < numVertsPerLine; ++y) {
-        for (int x = 0; x < numVertsPerLine; ++x) {
-            bool isSkippedVertex = x > 0 && x < numVertsPerLine - 1 && y > 0 && y < numVertsPerLine - 1 && ((x - 1) % skipIncrement != 0 || (y - 1) % skipIncrement != 0);
-            
-            if (!isSkippedVertex) {
-                int vertexIndex = vertexIndicesMap[x][y];
-                
-                glm::vec3 vertPos = getAxisPos(axis, offsetX + x - 1, offsetY + y - 1);
-                float height = isFlat ? 0.0f : getHeightValue(vertPos); // vertPos is modified to sphere Position if sphereRadius > 0
-                glm::vec3 sPos = getVertexPosition(vertPos, height);
-                glm::vec2 uv = glm::vec2(x - 1, y - 1) / (float)(numVertsPerLine - 1);
-                meshData.addVertex(sPos, uv, vertexIndex);
-                meshData.addHeight(height, vertexIndex);
+/*
+ * Height and world space gradient of the octaves [firstOctave, octaves) for a row of positions,
+ * with one call to the noise batch api.
+ * The noise input is truncated to int, exactly like the scalar getNoise calls did.
+ */
+void TerrainGenerator::getRowNoise(std::vector<glm::vec3> &positions, int count, int firstOctave, int octaves, std::vector<glm::vec4> &noise) {
+    std::vector<float> xs(count), ys(count), zs(count);
+    std::vector<float> heights(count), dxs(count), dys(count), dzs(count);
+
+    for (int x = 0; x < count; ++x) {
+        xs[x] = (int)positions[x].x;
+        ys[x] = (int)positions[x].y;
+        zs[x] = (int)positions[x].z;
+    }
 
-                bool createTriangle = x < numVertsPerLine - 1 && y < numVertsPerLine - 1;
+    if (sphereRadius_) {
+        pNoise_.getNoise3dBatch(xs.data(), ys.data(), zs.data(), count, heights.data(), dxs.data(), dys.data(), dzs.data(), octaves, firstOctave);
+        for (int x = 0; x < count; ++x)
+            noise[x] = glm::vec4(heights[x], dxs[x], dys[x], dzs[x]);
+    } else {
+        /* For 2d noise the second derivative is along z */
+        pNoise_.getNoise2dBatch(xs.data(), zs.data(), count, heights.data(), dxs.data(), dys.data(), octaves, firstOctave);
+        for (int x = 0; x < count; ++x)
+            noise[x] = glm::vec4(heights[x], dxs[x], 0.0f, dys[x]);
+    }
+}
 
-                if (createTriangle) {
-                    int currentIncrement = (x == 0 || y == 0) ? 1 : skipIncrement;
-                    int a = vertexIndicesMap[x][y];
-                    int b = vertexIndicesMap[x + currentIncrement][y];
-                    int c = vertexIndicesMap[x][y + currentIncrement];
-                    int d = vertexIndicesMap[x + currentIncrement][y + currentIncrement];
-                    
-                    meshData.addTriangle(a, inverted ? d : c, inverted ? c : d);
-                    meshData.addTriangle(a, inverted ? b : d, inverted ? d : b);
-                }
-            }
-        }
+/*
+ * noise holds the height and the world space gradient.
+ * Planes: The surface is y = h(x, z), so the normal is (-dh/dx, 1, -dh/dz).
+ * Spheres: The surface is (R + h) * n. Only the part of the gradient in the tangent plane of n
+ * tilts the normal, scaled by R / (R + h) because the noise is sampled at radius R.
+ */
+glm::vec3 TerrainGenerator::getNoiseNormal(glm::vec3 &position, glm::vec4 &noise) {
+    glm::vec3 g = glm::vec3(noise.y, noise.z, noise.w);
+    if (sphereRadius_) {
+        glm::vec3 n = glm::normalize(position - sphereOrigin_);
+        glm::vec3 gTangent = g - glm::dot(g, n) * n;
+        float scale = (float)sphereRadius_ / (sphereRadius_ + noise.x);
+        return glm::normalize(n - scale * gTangent);
     }
+
+    return glm::normalize(glm::vec3(-g.x, 1.0f, -g.z));
 }
 
 /*
@@ -220,7 +390,6 @@ void TerrainGenerator::generateTerrainMeshData(TerrainMeshData &meshData, glm::v
                 glm::vec3 sPos = getVertexPosition(vertPos, height);
                 glm::vec2 uv = glm::vec2(x - 1, y - 1) / (float)(numVertsPerLine - 1);
                 meshData.addVertex(sPos, uv, vertexIndex);
-                meshData.addHeight(height, vertexIndex);
 
                 bool createTriangle = x < numVertsPerLine - 1 && y < numVertsPerLine - 1;
 
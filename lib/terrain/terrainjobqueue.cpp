@@ -0,0 +1,99 @@
+#include <algorithm>
+#include "terrainjobqueue.hpp"
+#include "global.hpp"
+
+TerrainJobQueue::TerrainJobQueue(ThreadPool *pool, int maxInFlight, int maxSpeculative)
+    : pool_(pool), inFlight_(std::make_shared<std::atomic<int>>(0)), speculativeInFlight_(std::make_shared<std::atomic<int>>(0)) {
+    setMaxInFlight(maxInFlight, maxSpeculative);
+}
+
+void TerrainJobQueue::push(int id, float priority, bool speculative, std::function<void()> job) {
+    jobs_.push_back({id, priority, speculative, std::move(job)});
+}
+
+void TerrainJobQueue::update(const PriorityFunction &getPriority, std::vector<int> &cancelled) {
+    int kept = 0;
+    for (QueuedJob &job : jobs_) {
+        job.priority = getPriority(job.id, job.speculative);
+        if (job.priority < 0.0f) {
+            cancelled.push_back(job.id);
+            continue;
+        }
+
+        if (&jobs_[kept] != &job)
+            jobs_[kept] = std::move(job);
+        ++kept;
+    }
+    jobs_.resize(kept);
+}
+
+bool TerrainJobQueue::cancel(int id) {
+    auto found = std::find_if(jobs_.begin(), jobs_.end(), [id](const QueuedJob &job) { return job.id == id; });
+    if (found == jobs_.end())
+        return false;
+
+    jobs_.erase(found);
+    return true;
+}
+
+void TerrainJobQueue::dispatch() {
+    int slots = maxInFlight_ - inFlight_->load();
+    if (slots <= 0 || jobs_.empty())
+        return;
+
+    /* Speculative jobs may be skipped, so the whole queue needs to be in order */
+    auto before = [](const QueuedJob &a, const QueuedJob &b) {
+        return a.speculative != b.speculative ? b.speculative : a.priority > b.priority;
+    };
+    std::sort(jobs_.begin(), jobs_.end(), before);
+
+    int speculativeSlots = maxSpeculative_ - speculativeInFlight_->load();
+    int kept = 0;
+    for (QueuedJob &queued : jobs_) {
+        if (!slots || (queued.speculative && speculativeSlots <= 0)) {
+            if (&jobs_[kept] != &queued)
+                jobs_[kept] = std::move(queued);
+            ++kept;
+            continue;
+        }
+
+        --slots;
+        ++*inFlight_;
+        std::shared_ptr<std::atomic<int>> inFlight = inFlight_;
+        std::shared_ptr<std::atomic<int>> speculativeInFlight;
+        if (queued.speculative) {
+            --speculativeSlots;
+            ++*speculativeInFlight_;
+            speculativeInFlight = speculativeInFlight_;
+        }
+
+        std::function<void()> job = [inFlight, speculativeInFlight, run = std::move(queued.job)] {
+            run();
+            if (speculativeInFlight)
+                --*speculativeInFlight;
+            --*inFlight;
+        };
+        if (pool_)
+            pool_->addJob(job, "terrain");
+        else
+            job();
+    }
+    jobs_.resize(kept);
+}
+
+void TerrainJobQueue::setMaxInFlight(int maxInFlight, int maxSpeculative) {
+    maxInFlight_ = std::max(1, maxInFlight);
+    maxSpeculative_ = std::min(maxInFlight_, std::max(0, maxSpeculative));
+}
+
+int TerrainJobQueue::getQueuedCount() {
+    return jobs_.size();
+}
+
+int TerrainJobQueue::getInFlightCount() {
+    return inFlight_->load();
+}
+
+int TerrainJobQueue::getSpeculativeInFlightCount() {
+    return speculativeInFlight_->load();
+}
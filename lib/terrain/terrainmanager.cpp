@@ -4,11 +4,74 @@
 #include <glm/gtx/intersect.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include <limits>
+#include <atomic>
+#include <memory>
+#include <thread>
 
 //#include <cstdlib>
 
 #include "global.hpp"
+#include "parallel.hpp"
 #include "drawablefactory.hpp"
+
+namespace {
+/* Frames the prefetcher looks ahead, the path is sampled at PREFETCH_SAMPLES positions */
+const int PREFETCH_FRAMES = 30;
+const int PREFETCH_SAMPLES = 2;
+/* Weight of the newest frame in the camera velocity */
+const float VELOCITY_SMOOTHING = 0.2f;
+
+/* Smallest screen size of a planet, far away planets keep a share of the triangle budget */
+const float MIN_SCREEN_SIZE = 0.01f;
+
+/* Position and scale as one vec3, lod level and cube side as one uint, see TerrainInstance */
+static_assert(sizeof(TerrainInstance) == 16, "The terrain shader expects 16 byte instances");
+const std::vector<InstanceAttributeLayout> TERRAIN_INSTANCE_LAYOUT = {
+    {3, false, offsetof(TerrainInstance, position)},
+    {1, true, offsetof(TerrainInstance, lodFace)},
+};
+
+/*
+ * Leaves stop at the first level whose vertices are not denser than the heightmap samples,
+ * finer levels need a child heightmap. Node size of lod level l is dimension >> (rootLodLevel - l).
+ */
+int getLeafLodLevel(int dimension, int rootLodLevel, int leafNodeSize, int sampleSpacing) {
+    int lodLevel = 0;
+    while (lodLevel < rootLodLevel - 1 && (dimension >> (rootLodLevel - lodLevel)) < leafNodeSize * sampleSpacing)
+        ++lodLevel;
+    return lodLevel;
+}
+
+TerrainQuadTree *createQuadTree(HeightMap *heightMap, glm::vec2 pos, int lodLevelCount, int leafNodeSize) {
+    int leafLodLevel = getLeafLodLevel(heightMap->getDimension(), lodLevelCount - 1, leafNodeSize, heightMap->getSampleSpacing());
+    return new TerrainQuadTree(heightMap->getIndex(), pos, heightMap->getDimension(), lodLevelCount,
+                               std::bind(&HeightMap::getMaxMinValuesFromArea, heightMap, std::placeholders::_1,
+                                         std::placeholders::_2, std::placeholders::_3, std::placeholders::_4),
+                               leafLodLevel, leafNodeSize);
+}
+
+/* Key of the cell of size size that contains pos */
+long long getCellKey(const glm::vec2 &pos, float size) {
+    long long x = (long long)std::floor(pos.x / size);
+    long long y = (long long)std::floor(pos.y / size);
+    return (x << 32) ^ (y & 0xffffffffLL);
+}
+
+/*
+ * Runs the jobs on g_threadPool and returns once all of them finished.
+ * The calling thread takes jobs as well, so jobs queued behind long heightmap creations don't stall the frame.
+ */
+void runJobBatch(std::vector<std::function<void()>> &jobs) {
+    parallelFor(g_threadPool, 0, jobs.size(), 1, [&jobs](int begin, int end) {
+        for (int i = begin; i < end; ++i)
+            jobs[i]();
+    });
+}
+} // namespace
+
 TerrainManager::TerrainManager() {}
 TerrainManager::TerrainManager(TerrainObject *obj) {
     addTerrainObject(obj);
@@ -28,7 +91,27 @@ TerrainType TerrainManager::getType() {
     return type_;
 }
 
+void TerrainManager::setTriangleBudget(int triangles, float frameTime) {
+    budget_.setBudget(triangles, frameTime);
+}
+
+/*
+ * Selection of all terrain objects runs in parallel, the results are applied in order on this thread.
+ * The triangle budget follows the last frame, the objects scale their ranges before they select.
+ */
 void TerrainManager::update(View *view) {
+    int triangles = budget_.update(g_deltaTime);
+    screenSizes_.resize(terrainObjectList_.size());
+    for (int i = 0; i < (int)terrainObjectList_.size(); ++i)
+        screenSizes_[i] = triangles ? terrainObjectList_[i]->getScreenSize(view) : 0.0f;
+    TerrainBudget::split(triangles, screenSizes_, objectBudgets_);
+    for (int i = 0; i < (int)terrainObjectList_.size(); ++i)
+        terrainObjectList_[i]->setTriangleBudget(objectBudgets_[i]);
+
+    selectionJobs_.clear();
+    for (TerrainObject *obj : terrainObjectList_)
+        obj->addSelectionJobs(view, selectionJobs_);
+    runJobBatch(selectionJobs_);
 
     for (int i = 0; i < terrainObjectRenderDataVector_.size(); ++i) {
         terrainObjectList_[i]->update(view, &terrainObjectRenderDataVector_[i]);
@@ -106,14 +189,26 @@ void PlanetCdlodImplementation::createTree(CdlodTreeData &treeData) {
     }
 }
 
-void PlanetCdlodImplementation::updateRootNodes(CdlodTreeData &data, std::vector<TerrainNode_ *> &heightMapDemandList) {
-    ;
+TerrainQuadTree *PlanetCdlodImplementation::createChildNode(CdlodTreeData &treeData, HeightMap *parent, TerrainNodeInfo &leaf, int index,
+                                                            HeightMap **heightMap) {
+    *heightMap = new HeightMap(terrainGen_, parent, leaf.position, leaf.size, index);
+    TerrainQuadTree *tree = createQuadTree(*heightMap, leaf.position, leaf.lodLevel + 1, *treeData.leafNodeSize);
+    setSphere(tree, *heightMap);
+    return tree;
 }
 
 void PlanetCdlodImplementation::createRootNode(CdlodTreeData &treeData, glm::vec2 &cornerPos, glm::vec3 &axis) {
-    HeightMap *heightMap = new HeightMap(terrainGen_, cornerPos, axis, rootNodeDimension_, *treeData.heightMapIndex);
-    treeData.rootNodes->push_back(new TerrainNode_(heightMap, rootNodeDimension_, *treeData.lodLevelCount - 1, cornerPos));
-    heightMap->cleanUpMapData();
+    /* Root nodes span a whole cube side, sample them coarser so only the resolvable octaves are generated.
+     * The coarse octaves are kept, closer heightmaps are refined from them. */
+    int sampleSpacing = 1;
+    while (rootNodeDimension_ / sampleSpacing > MAX_HEIGHTMAP_SAMPLES)
+        sampleSpacing *= 2;
+
+    HeightMap *heightMap = new HeightMap(terrainGen_, cornerPos, axis, rootNodeDimension_, *treeData.heightMapIndex, sampleSpacing, true);
+    heightMap->uploadTextures();
+    TerrainQuadTree *tree = createQuadTree(heightMap, cornerPos, *treeData.lodLevelCount, *treeData.leafNodeSize);
+    setSphere(tree, heightMap);
+    treeData.rootNodes->push_back(tree);
     (*treeData.heightMaps)[*treeData.heightMapIndex] = heightMap;
     
     (*treeData.heightMapTextures)[*treeData.heightMapIndex];
@@ -123,6 +218,13 @@ void PlanetCdlodImplementation::createRootNode(CdlodTreeData &treeData, glm::vec
     ++(*treeData.heightMapIndex);
 }
 
+void PlanetCdlodImplementation::setSphere(TerrainQuadTree *tree, HeightMap *heightMap) {
+    /* No terrain lies below the lowest noise value, so that sphere occludes everything behind it */
+    float occluderRadius = planetAttributes_->bodyRadius + terrainGen_->getPerlinNoise().getLowerBound();
+    tree->setSphere(heightMap->getAxis(), planetAttributes_->bodyOrigin, planetAttributes_->bodyRadius, occluderRadius,
+                    std::bind(&HeightMap::getMaxTiltFromArea, heightMap, std::placeholders::_1, std::placeholders::_2));
+}
+
 glm::vec2 PlanetCdlodImplementation::vec3ToVec2CubeSide(glm::vec3 &pos, glm::vec3 &axis) {
     glm::vec2 ret;
 
@@ -163,14 +265,38 @@ void PlaneCdlodImplementation::createTree(CdlodTreeData &treeData) {
     *treeData.leafNodeSize = leafNodeSize;
     *treeData.lodLevelCount = lodLevelCount;
 
-    createRootNode(treeData, glm::vec2(0,0));
-}
+    /* The ring reaches at least maxViewDistance past the camera's root node in every direction */
+    ringRadius_ = (int)std::ceil(maxViewDistance / rootNodeDimension_);
+    ringSize_ = 2 * ringRadius_ + 1;
 
-void PlaneCdlodImplementation::createRootNode(CdlodTreeData &treeData, glm::vec2 pos) {
+    /* The ring starts around the origin, the heightmaps are generated in parallel */
     glm::vec3 axis = glm::vec3(0,1,0);
-    HeightMap *heightMap = new HeightMap(terrainGen_, pos, axis, rootNodeDimension_, *treeData.heightMapIndex);
-    treeData.rootNodes->push_back(new TerrainNode_(heightMap, rootNodeDimension_, *treeData.lodLevelCount - 1, pos));
-    heightMap->cleanUpMapData();
+    std::vector<HeightMap *> heightMaps(ringSize_ * ringSize_);
+    std::vector<glm::vec2> positions(ringSize_ * ringSize_);
+    std::vector<std::function<void()>> jobs;
+    for (int y = 0; y < ringSize_; ++y) {
+        for (int x = 0; x < ringSize_; ++x) {
+            int slot = y * ringSize_ + x;
+            glm::vec2 pos = glm::vec2(getRingCell(glm::ivec2(0, 0), x, y) * rootNodeDimension_);
+            positions[slot] = pos;
+            int index = *treeData.heightMapIndex + slot;
+            HeightMap **heightMap = &heightMaps[slot];
+            jobs.push_back([this, heightMap, pos, axis, index] {
+                *heightMap = new HeightMap(terrainGen_, pos, axis, rootNodeDimension_, index);
+            });
+        }
+    }
+    runJobBatch(jobs);
+
+    for (int i = 0; i < (int)heightMaps.size(); ++i)
+        createRootNode(treeData, heightMaps[i], positions[i]);
+}
+
+void PlaneCdlodImplementation::createRootNode(CdlodTreeData &treeData, HeightMap *heightMap, glm::vec2 pos) {
+    glm::vec3 axis = heightMap->getAxis();
+    /* Keep the data, moving the root regenerates it in place */
+    heightMap->uploadTextures(true);
+    treeData.rootNodes->push_back(createQuadTree(heightMap, pos, *treeData.lodLevelCount, *treeData.leafNodeSize));
     (*treeData.heightMaps)[*treeData.heightMapIndex] = heightMap;
     
     (*treeData.heightMapTextures)[*treeData.heightMapIndex];
@@ -180,26 +306,68 @@ void PlaneCdlodImplementation::createRootNode(CdlodTreeData &treeData, glm::vec2
     ++(*treeData.heightMapIndex);
 }
 
-void PlaneCdlodImplementation::updateRootNodes(CdlodTreeData &treeData, std::vector<TerrainNode_ *> &heightMapDemandList) {
-    ;
-} 
+TerrainQuadTree *PlaneCdlodImplementation::createChildNode(CdlodTreeData &treeData, HeightMap *parent, TerrainNodeInfo &leaf, int index,
+                                                           HeightMap **heightMap) {
+    *heightMap = new HeightMap(terrainGen_, parent, leaf.position, leaf.size, index);
+    return createQuadTree(*heightMap, leaf.position, leaf.lodLevel + 1, *treeData.leafNodeSize);
+}
 
+void PlaneCdlodImplementation::getRootNodeTargets(const glm::vec3 &cameraPosition, std::vector<glm::vec2> &targets) {
+    glm::ivec2 cameraCell = glm::ivec2(glm::floor(glm::vec2(cameraPosition.x, cameraPosition.z) / (float)rootNodeDimension_));
+    for (int y = 0; y < ringSize_; ++y) {
+        for (int x = 0; x < ringSize_; ++x)
+            targets[y * ringSize_ + x] = glm::vec2(getRingCell(cameraCell, x, y) * rootNodeDimension_);
+    }
+}
 
-CdlodTree::CdlodTree(CdlodTreeImplementation *imple, TerrainObjectAttributes *attribs) : treeImplementation_(imple), terrainAttributes_(attribs){
+void PlaneCdlodImplementation::moveRootNode(CdlodTreeData &treeData, HeightMap *heightMap, TerrainQuadTree *tree, glm::vec2 pos) {
+    heightMap->regenerate(terrainGen_, pos);
+    tree->moveTo(pos);
+}
+
+/* The cell within ringRadius_ of cameraCell that root node (x, y) covers */
+glm::ivec2 PlaneCdlodImplementation::getRingCell(glm::ivec2 cameraCell, int x, int y) {
+    glm::ivec2 first = cameraCell - ringRadius_;
+    glm::ivec2 offset = glm::ivec2(x, y) - first;
+    offset = ((offset % ringSize_) + ringSize_) % ringSize_;
+    return first + offset;
+}
+
+
+CdlodTree::CdlodTree(CdlodTreeImplementation *imple, TerrainObjectAttributes *attribs)
+    : instanceRing_(sizeof(TerrainInstance)), terrainAttributes_(attribs), treeImplementation_(imple),
+      streaming_(std::make_shared<StreamingState>()),
+      jobQueue_(g_threadPool, g_threadPool ? g_threadPool->getThreadCount() : 1,
+                std::max(1, g_threadPool ? g_threadPool->getThreadCount() / 4 : 1)) {
     init();
 }
 
 CdlodTree::~CdlodTree() {
+    /* Running generation jobs still use the implementation and the parent heightmaps */
+    streaming_->cancelled = true;
+    while (streaming_->running)
+        std::this_thread::yield();
+
+    /* Uploads still queued on g_glJobQueue delete their nodes themselves */
+    streaming_->completed.drain([](StreamedNode &node) {
+        /* Moved roots are still in rootNodeList_ */
+        if (node.parentIndex < 0)
+            return;
+        delete node.plane;
+        delete node.tree;
+        delete node.heightMap;
+    });
+
     delete treeImplementation_;
 
-    for (TerrainNode_ *node : rootNodeList_)
-        delete node;
+    for (int i = 0; i < quadTrees_.size(); ++i)
+        delete quadTrees_[i];
 
-    for (auto &kv : heightMaps_)
-        delete kv.second;
+    for (int i = 0; i < heightMaps_.size(); ++i)
+        delete heightMaps_[i];
 
-    for (auto &kv : meshInstanceData_.baseMeshListMap) {
-        for (Drawable *d : kv.second)
+    for (int i = 0; i < meshInstanceData_.baseMeshListMap.size(); ++i) {
+        for (Drawable *d : meshInstanceData_.baseMeshListMap[i])
             delete d;
     }
 }
@@ -215,115 +383,604 @@ void CdlodTree::init() {
     publicTreeData_.leafNodeSize = &leafNodeSize_;
     publicTreeData_.lodLevelCount = &lodLevelCount_;
     treeImplementation_->createTree(publicTreeData_);
+    baseRanges_ = ranges_;
+    terrainAttributes_->lodRanges = &ranges_;
+    if ((int)ranges_.size() > MAX_TERRAIN_LOD_LEVELS)
+        fprintf(stdout, "[CDLODTREE::init] Error: The terrain shader only has ranges for %i lod levels\n", MAX_TERRAIN_LOD_LEVELS);
+
+    for (TerrainQuadTree *tree : rootNodeList_) {
+        rootIndices_[tree->getHeightMapIndex()] = rootPositions_.size();
+        rootPositions_.push_back(tree->getPosition());
+        quadTrees_[tree->getHeightMapIndex()] = tree;
+        memoryUsage_ += heightMaps_[tree->getHeightMapIndex()]->getMemoryUsage() + tree->getMemoryUsage();
+    }
+    rootTargets_ = rootPositions_;
+    movingRoots_.resize(rootNodeList_.size(), false);
+}
+
+/*
+ * Uploads a generated node on g_glJobQueue and passes it on to finishStreamedNodes.
+ * Once the tree is gone the upload deletes a child instead, moved roots belong to the tree and are left alone.
+ * Without a GL job queue, like without an Engine, the upload runs right here.
+ */
+void CdlodTree::postUpload(std::shared_ptr<StreamingState> streaming, StreamedNode node) {
+    std::function<void()> upload = [streaming, node] {
+        if (streaming->cancelled) {
+            if (node.parentIndex >= 0) {
+                delete node.plane;
+                delete node.tree;
+                delete node.heightMap;
+            }
+            return;
+        }
+
+        /* A moved root keeps its data for the next move */
+        node.heightMap->uploadTextures(node.parentIndex < 0);
+        if (node.plane) {
+            for (Mesh *mesh : node.plane->getMeshes())
+                mesh->updateMesh();
+        }
+        streaming->completed.push(node);
+    };
+
+    if (g_glJobQueue)
+        g_glJobQueue->post(std::move(upload));
+    else
+        upload();
 }
 
-/* This function is called on the thread pool, so we need to copy the list
- * The list should be very small anyways
+/*
+ * Hands the uploaded child heightmaps to their parent trees and puts the moved roots in place.
+ * Main thread only, while no selection job runs.
  */
-void CdlodTree::handleRootNodeUpdate(std::vector<TerrainNode_ *> creationList) {
-    treeImplementation_->updateRootNodes(publicTreeData_, creationList);
+void CdlodTree::finishStreamedNodes() {
+    streaming_->completed.drain([this](StreamedNode &node) {
+        HeightMap *heightMap = node.heightMap;
+        if (node.parentIndex < 0) {
+            /* Same textures, same instance data, the full selection of the moved tree overwrites it */
+            int rootIndex = -1 - node.parentIndex;
+            rootPositions_[rootIndex] = node.leafPosition;
+            movingRoots_[rootIndex] = false;
+            refineRangesDirty_ = true;
+            return;
+        }
+
+        int index = heightMap->getIndex();
+        heightMaps_[index] = heightMap;
+        heightMapTextures_[index].emplace_back(heightMap->getHeightTexture(), "texture_height");
+        heightMapTextures_[index].emplace_back(heightMap->getNormalTexture(), "texture_normal");
+        meshInstanceData_.baseMeshListMap[index] = DrawableList(1, node.plane);
+        quadTrees_[index] = node.tree;
+        quadTrees_[node.parentIndex]->attachChild(node.leafPosition, node.tree);
+        refineRangesDirty_ = true;
+
+        size_t memoryUsage = heightMap->getMemoryUsage() + node.tree->getMemoryUsage();
+        streamedTrees_[index] = {node.parentIndex, node.leafPosition, memoryUsage, frame_, 0};
+        memoryUsage_ += memoryUsage;
+        StreamedTree &parent = streamedTrees_[node.parentIndex];
+        if (parent.parentIndex >= 0)
+            ++parent.childCount;
+        requestedLeaves_.erase(std::make_tuple(node.parentIndex, (int)node.leafPosition.x, (int)node.leafPosition.y));
+        requestedNodes_.erase(index);
+    });
 }
 
+/*
+ * Extrapolates the camera from its smoothed velocity. The selection jobs select the predicted positions
+ * speculatively, so heightmaps needed within PREFETCH_FRAMES are generated before the camera arrives.
+ */
+void CdlodTree::predictCamera(const glm::vec3 &cameraPosition) {
+    if (hasCameraPosition_ && g_deltaTime > 0.0f)
+        cameraVelocity_ = glm::mix(cameraVelocity_, (cameraPosition - lastCameraPosition_) / g_deltaTime, VELOCITY_SMOOTHING);
+    lastCameraPosition_ = cameraPosition;
+    hasCameraPosition_ = true;
+
+    predictedPositions_.clear();
+    glm::vec3 lookahead = cameraVelocity_ * (g_deltaTime * PREFETCH_FRAMES);
+    /* The current selection already covers that */
+    if (glm::length(lookahead) < leafNodeSize_)
+        return;
+
+    for (int i = 1; i <= PREFETCH_SAMPLES; ++i)
+        predictedPositions_.push_back(cameraPosition + lookahead * ((float)i / PREFETCH_SAMPLES));
+}
 
-void CdlodTree::update(View *view, TerrainObjectRenderData *renderData) {
-    landDrawData_.listOfDrawableLists.clear();
-    landDrawData_.listOfTextureLists.clear();
-    landDrawData_.size = 0;
-    selectedNodes_.clear();
+/*
+ * Larger for big leaves close to the camera, like their screen space error.
+ * Leaves the selection refines right now are real requests. Leaves only a predicted camera position refines,
+ * or that the camera just left but is still within their own range, are speculative. Negative once neither holds.
+ */
+float CdlodTree::getRequestPriority(TerrainNodeInfo &leaf, const glm::vec3 &cameraPosition, bool &speculative) {
+    TerrainQuadTree *tree = quadTrees_[leaf.heightMapIndex];
+    float distance = tree->getLeafDistance(leaf.position, cameraPosition);
+    float refineRange = tree->getRefineRange(leaf.lodLevel, leaf.position);
+    if (refineRange < 0.0f)
+        refineRange = ranges_[leaf.lodLevel - 1];
+    speculative = distance > refineRange;
+    if (!speculative)
+        return leaf.size / std::max(distance, 1.0f);
+
+    float nearest = distance <= ranges_[leaf.lodLevel] ? distance : std::numeric_limits<float>::max();
+    for (glm::vec3 &position : predictedPositions_) {
+        float predicted = tree->getLeafDistance(leaf.position, position);
+        if (predicted <= refineRange)
+            nearest = std::min(nearest, predicted);
+    }
+
+    if (nearest == std::numeric_limits<float>::max())
+        return -1.0f;
+    return leaf.size / std::max(nearest, 1.0f);
+}
+
+/*
+ * Queues a child heightmap for every leaf on the creation list, then starts the most important ones.
+ * A leaf is requested once until its child is attached, no matter how often it shows up on the list.
+ * Leaves neither the camera nor its prediction needs are dropped before their job starts and may ask again later.
+ */
+void CdlodTree::requestChildNodes(const glm::vec3 &cameraPosition) {
+    for (TerrainNodeInfo &leaf : heightMapCreationList_) {
+        /* Its root is about to move, the leaf will be somewhere else */
+        int rootIndex = getRootIndex(leaf.heightMapIndex);
+        if (rootTargets_[rootIndex] != rootPositions_[rootIndex])
+            continue;
+        if (!requestedLeaves_.insert(std::make_tuple(leaf.heightMapIndex, (int)leaf.position.x, (int)leaf.position.y)).second)
+            continue;
 
+        /* Indices are handed out here, so the jobs never touch the tree data. Recycled ones keep the slot arrays dense */
+        int index;
+        if (freeHeightMapIndices_.empty()) {
+            index = heightMapIndex_++;
+        } else {
+            index = freeHeightMapIndices_.back();
+            freeHeightMapIndices_.pop_back();
+        }
+        HeightMap *parent = heightMaps_[leaf.heightMapIndex];
+        std::shared_ptr<StreamingState> streaming = streaming_;
+        CdlodTreeImplementation *imple = treeImplementation_;
+        CdlodTreeData *treeData = &publicTreeData_;
+        TerrainNodeInfo node = leaf;
+        int leafNodeSize = leafNodeSize_;
+        std::function<void()> job = [streaming, imple, treeData, parent, node, index, leafNodeSize]() mutable {
+            /* Counted before the check, so the destructor either cancels us or waits for us */
+            ++streaming->running;
+            if (!streaming->cancelled) {
+                StreamedNode streamed = {node.heightMapIndex, node.position, nullptr, nullptr, nullptr};
+                streamed.tree = imple->createChildNode(*treeData, parent, node, index, &streamed.heightMap);
+                streamed.plane = DrawableFactory::createPrimitivePlane(streamed.heightMap->getAxis(), leafNodeSize);
+                postUpload(streaming, streamed);
+            }
+            --streaming->running;
+        };
+
+        /* Prioritized by the update below */
+        requestedNodes_[index] = leaf;
+        jobQueue_.push(index, 0.0f, true, job);
+    }
+    heightMapCreationList_.clear();
+
+    cancelledRequests_.clear();
+    jobQueue_.update([this, &cameraPosition](int index, bool &speculative) {
+        if (index >= 0)
+            return getRequestPriority(requestedNodes_[index], cameraPosition, speculative);
+
+        /* Root node moves are never dropped, the root is not drawn until it arrived */
+        glm::vec2 &target = rootTargets_[-1 - index];
+        float size = rootNodeList_[-1 - index]->getSize();
+        glm::vec2 center = target + glm::vec2(size * 0.5f);
+        speculative = false;
+        return size / std::max(glm::distance(center, glm::vec2(cameraPosition.x, cameraPosition.z)), 1.0f);
+    }, cancelledRequests_);
+    for (int index : cancelledRequests_) {
+        TerrainNodeInfo &leaf = requestedNodes_[index];
+        quadTrees_[leaf.heightMapIndex]->unscheduleLeaf(leaf.position);
+        requestedLeaves_.erase(std::make_tuple(leaf.heightMapIndex, (int)leaf.position.x, (int)leaf.position.y));
+        requestedNodes_.erase(index);
+        freeHeightMapIndices_.push_back(index);
+    }
+    jobQueue_.dispatch();
+}
+
+/*
+ * Asks the implementation where the roots should be and starts moving the ones that are elsewhere.
+ * A root only moves once its subtree is gone, until then it stays where it is and gets no new children.
+ * Root node moves go through the same job queue as the child requests, with negative ids.
+ */
+void CdlodTree::moveRootNodes(const glm::vec3 &cameraPosition) {
+    treeImplementation_->getRootNodeTargets(cameraPosition, rootTargets_);
+    for (int i = 0; i < (int)rootNodeList_.size(); ++i) {
+        if (movingRoots_[i] || rootTargets_[i] == rootPositions_[i])
+            continue;
+
+        TerrainQuadTree *tree = rootNodeList_[i];
+        if (!clearRootNode(tree->getHeightMapIndex()))
+            continue;
+
+        movingRoots_[i] = true;
+        std::shared_ptr<StreamingState> streaming = streaming_;
+        CdlodTreeImplementation *imple = treeImplementation_;
+        CdlodTreeData *treeData = &publicTreeData_;
+        HeightMap *heightMap = heightMaps_[tree->getHeightMapIndex()];
+        glm::vec2 target = rootTargets_[i];
+        int parentIndex = -1 - i;
+        std::function<void()> job = [streaming, imple, treeData, heightMap, tree, target, parentIndex]() {
+            ++streaming->running;
+            if (!streaming->cancelled) {
+                imple->moveRootNode(*treeData, heightMap, tree, target);
+                postUpload(streaming, {parentIndex, target, heightMap, tree, nullptr});
+            }
+            --streaming->running;
+        };
+        jobQueue_.push(parentIndex, 0.0f, false, job);
+    }
+}
+
+/*
+ * Drops the queued requests below the root with heightMapIndex and evicts its streamed trees.
+ * False while a request is generating or waiting for its upload, the root has to try again later.
+ */
+bool CdlodTree::clearRootNode(int heightMapIndex) {
+    int rootIndex = rootIndices_[heightMapIndex];
+    bool cleared = true;
+    for (std::unordered_map<int, TerrainNodeInfo>::iterator it = requestedNodes_.begin(); it != requestedNodes_.end();) {
+        TerrainNodeInfo &leaf = it->second;
+        if (getRootIndex(leaf.heightMapIndex) != rootIndex) {
+            ++it;
+        } else if (jobQueue_.cancel(it->first)) {
+            quadTrees_[leaf.heightMapIndex]->unscheduleLeaf(leaf.position);
+            requestedLeaves_.erase(std::make_tuple(leaf.heightMapIndex, (int)leaf.position.x, (int)leaf.position.y));
+            freeHeightMapIndices_.push_back(it->first);
+            it = requestedNodes_.erase(it);
+        } else {
+            cleared = false;
+            ++it;
+        }
+    }
+    if (!cleared)
+        return false;
+
+    /* Leaves first, each eviction may turn its parent into one */
+    bool evicted = true;
+    while (evicted) {
+        evicted = false;
+        for (int i = 0; i < streamedTrees_.size(); ++i) {
+            if (streamedTrees_[i].parentIndex >= 0 && !streamedTrees_[i].childCount && getRootIndex(i) == rootIndex) {
+                evictTree(i);
+                evicted = true;
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+/* Index in rootNodeList_ of the root the tree with heightMapIndex belongs to */
+int CdlodTree::getRootIndex(int heightMapIndex) {
+    while (streamedTrees_[heightMapIndex].parentIndex >= 0)
+        heightMapIndex = streamedTrees_[heightMapIndex].parentIndex;
+    return rootIndices_[heightMapIndex];
+}
+
+bool CdlodTree::hasPendingRequests(int heightMapIndex) {
+    std::set<std::tuple<int, int, int>>::iterator it =
+        requestedLeaves_.lower_bound(std::make_tuple(heightMapIndex, std::numeric_limits<int>::min(), std::numeric_limits<int>::min()));
+    return it != requestedLeaves_.end() && std::get<0>(*it) == heightMapIndex;
+}
+
+/*
+ * Evicts streamed children, least recently drawn first, until the terrain fits into its memory budget.
+ * Only trees that have no children and no requests left are evicted, their parents may follow in a later round.
+ * Running generation jobs still read the parent heightmap, so those trees are kept as well.
+ */
+void CdlodTree::evictHeightMaps() {
+    while (memoryUsage_ > terrainAttributes_->memoryBudget) {
+        int oldest = -1;
+        int oldestFrame = frame_; // Trees drawn this frame stay
+        for (int i = 0; i < streamedTrees_.size(); ++i) {
+            StreamedTree &tree = streamedTrees_[i];
+            if (tree.parentIndex >= 0 && tree.lastUsedFrame < oldestFrame && !tree.childCount && !hasPendingRequests(i)) {
+                oldest = i;
+                oldestFrame = tree.lastUsedFrame;
+            }
+        }
+
+        if (oldest < 0)
+            break;
+        evictTree(oldest);
+    }
+}
+
+/* Collapses the tree back into the parent's leaf and frees everything that belongs to its heightmap */
+void CdlodTree::evictTree(int heightMapIndex) {
+    StreamedTree &tree = streamedTrees_[heightMapIndex];
+    quadTrees_[tree.parentIndex]->detachChild(tree.leafPosition);
+    refineRangesDirty_ = true;
+    StreamedTree &parent = streamedTrees_[tree.parentIndex];
+    if (parent.parentIndex >= 0)
+        --parent.childCount;
+    memoryUsage_ -= tree.memoryUsage;
+    streamedTrees_.erase(heightMapIndex);
+
+    delete quadTrees_[heightMapIndex];
+    quadTrees_.erase(heightMapIndex);
+    delete heightMaps_[heightMapIndex];
+    heightMaps_.erase(heightMapIndex);
+    heightMapTextures_.erase(heightMapIndex);
+    meshInstanceData_.removeInstance(heightMapIndex);
+    freeHeightMapIndices_.push_back(heightMapIndex);
+}
+
+void CdlodTree::selectTree(TerrainQuadTree *tree, RootSelection &selection, const glm::vec3 &cameraPosition, const Frustum *frustum) {
+    TreeSelection treeSelection = {tree, false, 0, 0};
+    treeSelection.changed = tree->updateSelection(ranges_, cameraPosition, frustum, selection.creationList, &treeSelection.first,
+                                                  &treeSelection.end);
+    selection.trees.push_back(treeSelection);
+    for (TerrainQuadTree *child : tree->getActiveChildren())
+        selectTree(child, selection, cameraPosition, frustum);
+}
+
+/* Trees only touch their own data during selection, so the root nodes can be selected concurrently */
+void CdlodTree::selectRootNode(int index, glm::vec3 cameraPosition, const Frustum *frustum) {
+    RootSelection &selection = rootSelections_[index];
+    selection.trees.clear();
+    selectTree(rootNodeList_[index], selection, cameraPosition, frustum);
+
+    /* Only the leaves are of interest here. Nothing is culled, the camera may turn until it gets there */
+    for (glm::vec3 &position : predictedPositions_) {
+        for (auto &kv : selection.prefetchNodes)
+            kv.second.clear();
+        rootNodeList_[index]->lodSelect(ranges_, position, nullptr, selection.prefetchNodes, selection.prefetchList);
+    }
+}
+
+void CdlodTree::addSelectionJobs(View *view, std::vector<std::function<void()>> &jobs) {
     /* TODO: Once I get to the level closeup to the planet where I need to create more detailed heightmaps,
      *          this should start with a lower level root node.
      * Example: Let the implementation decide!
      * treeImplementation_->selectStartNode()
      *      Choses one or more nodes from the list to be used.
      */
-    for (TerrainNode_ *node : rootNodeList_) {
-        node->lodSelect(ranges_, lodLevelCount_-1, view, selectedNodes_, heightMapCreationList_);
+    /* Node boxes of a planet are in cube side coordinates, not in world space. Only cull planes for now */
+    const Frustum *frustum = terrainAttributes_->bodyRadius ? nullptr : &view->getFrustum();
+    glm::vec3 cameraPosition = view->getCameraPosition();
+    /* A new frame, the jobs of the last one are done */
+    frameArena_.reset();
+    applyRangeScale();
+    /* Resolution and field of view count, not just the distance */
+    if (terrainAttributes_->maxPixelError > 0.0f) {
+        int width, height;
+        view->getWindowSize(&width, &height);
+        float errorToRange = TerrainQuadTree::getErrorToRange(view->getProjectionMatrix()[1][1], height, terrainAttributes_->maxPixelError);
+        refineRangesDirty_ |= errorToRange != errorToRange_;
+        errorToRange_ = errorToRange;
+        updateRefineRanges();
     }
-
-    float rotationDegree = 0.0f;
-    for (auto &mapIndexNodeList : selectedNodes_) {
-        if (mapIndexNodeList.second.empty())
+    predictCamera(cameraPosition);
+    rootSelections_.resize(rootNodeList_.size());
+    for (int i = 0; i < (int)rootNodeList_.size(); ++i) {
+        /* A pool job is regenerating the tree */
+        if (i < (int)movingRoots_.size() && movingRoots_[i]) {
+            rootSelections_[i].trees.clear();
             continue;
-        
-        ++landDrawData_.size;
-        // TODO: Bad and costly lookup. This has to go. Needs to be called when a new heightMap is created.
-        if (meshInstanceData_.instanceAttribListMap.find(mapIndexNodeList.first) == meshInstanceData_.instanceAttribListMap.end())
-            meshInstanceData_.createNewInstance(mapIndexNodeList.first);
-        meshInstanceData_.updateInstanceSize(mapIndexNodeList.first, mapIndexNodeList.second.size());
-        glm::vec3 currentAxis = heightMaps_[mapIndexNodeList.first]->getAxis();
-        glm::vec3 rotationAxis = getRotationAxis(currentAxis, &rotationDegree);
-        int instanceIndex = 0;
-
-        /* Update model matrices and additional attributes for each instance belonging to the current heightmap */
-        fprintf(stdout, "List size: %lu\n", mapIndexNodeList.second.size());
-        for (TerrainNode_ *node : mapIndexNodeList.second)
-            fprintf(stdout, "(R: %f, Dim: %i, L: %i, Pos: %s), ", node->getRange(), node->getSize(), node->getLodLevel(), glm::to_string(node->getPosition()).c_str());
-        fprintf(stdout, "\n");
-
-        for (TerrainNode_ *node : mapIndexNodeList.second) {
-            float scale = node->getSize() / leafNodeSize_;
-            glm::vec3 translate = terrainAttributes_->bodyRadius ? vec2ToVec3CubeSide(node->getPosition(), currentAxis) : glm::vec3(node->getPosition().x, 0, node->getPosition().y);
-            glm::vec3 scaleVec = glm::vec3(scale);
-            meshInstanceData_.insertModelMatrix(instanceIndex, &scaleVec, &translate, &rotationAxis, rotationDegree);
-            meshInstanceData_.insertAttribute(instanceIndex, node->getRange(), getPrevRange(node->getLodLevel()), scale);
-            ++instanceIndex;
         }
+        /* Small enough for std::function to store without allocating */
+        SelectionJob *job = frameArena_.create<SelectionJob>(SelectionJob{i, cameraPosition, frustum});
+        jobs.push_back([this, job] { selectRootNode(job->rootIndex, job->cameraPosition, job->frustum); });
+    }
+    selectionScheduled_ = true;
+}
 
-        meshInstanceData_.finishInstance(mapIndexNodeList.first);
+void CdlodTree::update(View *view, TerrainObjectRenderData *renderData) {
+    ++frame_;
+    /* Attached children take part in the next selection */
+    finishStreamedNodes();
+
+    /* Called without TerrainManager, select here */
+    if (!selectionScheduled_) {
+        selectionJobs_.clear();
+        addSelectionJobs(view, selectionJobs_);
+        for (std::function<void()> &job : selectionJobs_)
+            job();
+    }
+    selectionScheduled_ = false;
+    /* Root nodes added since the jobs were created are selected next frame */
+    rootSelections_.resize(rootNodeList_.size());
+
+    bool selectionChanged = false;
+    nextActiveTrees_.clear();
+    for (int rootIndex = 0; rootIndex < (int)rootNodeList_.size(); ++rootIndex) {
+        /* Merge in root node order, so the creation list does not depend on which thread finished first */
+        RootSelection &selection = rootSelections_[rootIndex];
+        heightMapCreationList_.insert(heightMapCreationList_.end(), selection.creationList.begin(), selection.creationList.end());
+        heightMapCreationList_.insert(heightMapCreationList_.end(), selection.prefetchList.begin(), selection.prefetchList.end());
+        selection.creationList.clear();
+        selection.prefetchList.clear();
+
+        for (TreeSelection &treeSelection : selection.trees) {
+            TerrainQuadTree *tree = treeSelection.tree;
+            nextActiveTrees_.push_back(tree);
+            StreamedTree &streamed = streamedTrees_[tree->getHeightMapIndex()];
+            if (streamed.parentIndex >= 0)
+                streamed.lastUsedFrame = frame_;
+
+            /* Trees keep their selection, only the entries that changed get new instance data */
+            if (!treeSelection.changed)
+                continue;
+
+            int first = treeSelection.first;
+            int end = treeSelection.end;
+            selectionChanged = true;
+            int mapIndex = tree->getHeightMapIndex();
+            std::vector<TerrainNodeInfo> &nodes = tree->getSelection();
+            std::vector<TerrainInstance> &instances = meshInstanceData_.instanceListMap[mapIndex];
+            instances.resize(nodes.size());
+            unsigned int face = getTerrainFace(heightMaps_[mapIndex]->getAxis());
+
+            /* Update the instances of the changed nodes, writeInstances hands them to the GPU */
+            for (int i = first; i < end; ++i) {
+                TerrainNodeInfo &node = nodes[i];
+                instances[i] = {node.position, (float)(node.size / leafNodeSize_), (unsigned int)node.lodLevel | face << 8};
+            }
+        }
+    }
 
-        landDrawData_.listOfDrawableLists.push_back(&meshInstanceData_.baseMeshListMap[mapIndexNodeList.first]);
-        landDrawData_.listOfTextureLists.push_back(&heightMapTextures_[mapIndexNodeList.first]);
+    /* Children that became inactive keep their instance data, they are just not drawn */
+    bool activeTreesChanged = nextActiveTrees_ != activeTrees_;
+    activeTrees_.swap(nextActiveTrees_);
+    if (selectionChanged || activeTreesChanged) {
+        landDrawData_.listOfDrawableLists.clear();
+        landDrawData_.listOfTextureLists.clear();
+        landDrawData_.size = 0;
+        for (TerrainQuadTree *tree : activeTrees_) {
+            if (tree->getSelection().empty())
+                continue;
+
+            ++landDrawData_.size;
+            landDrawData_.listOfDrawableLists.push_back(&meshInstanceData_.baseMeshListMap[tree->getHeightMapIndex()]);
+            landDrawData_.listOfTextureLists.push_back(&heightMapTextures_[tree->getHeightMapIndex()]);
+        }
     }
 
+    writeInstances();
+    /* A new scale is applied when the next selection starts, the shader draws this frame with the old ranges */
+    rangeController_.update(triangleCount_);
     renderData->land = &landDrawData_;
     renderData->attributes = terrainAttributes_;
 
-    /* Handle heightmap creation list */
-    if (heightMapCreationList_.size()) {
-        g_threadPool->addJob(std::bind(&CdlodTree::handleRootNodeUpdate, this, heightMapCreationList_));
-        ;
-    }
+    evictHeightMaps();
+    moveRootNodes(view->getCameraPosition());
+    requestChildNodes(view->getCameraPosition());
 }
 
-glm::vec3 CdlodTree::vec2ToVec3CubeSide(glm::vec2 &pos, glm::vec3 &axis) {
-    glm::vec3 ret;
-    if (axis.x)
-        ret = glm::vec3(terrainAttributes_->bodyOrigin.x + axis.x * terrainAttributes_->bodyRadius, pos.y, pos.x);
-    else if (axis.y)
-        ret = glm::vec3(pos.x, terrainAttributes_->bodyOrigin.y + axis.y * terrainAttributes_->bodyRadius, pos.y);
-    else
-        ret = glm::vec3(pos.x, pos.y, terrainAttributes_->bodyOrigin.z + axis.z * terrainAttributes_->bodyRadius);
+/*
+ * Copies the instances of all drawn trees into the next section of the instance ring, in draw order.
+ * That happens every frame, the section was last written RING_FRAMES frames ago. The base meshes of each tree
+ * draw their part of the section.
+ */
+void CdlodTree::writeInstances() {
+    int count = 0;
+    triangleCount_ = 0;
+    for (TerrainQuadTree *tree : activeTrees_) {
+        int mapIndex = tree->getHeightMapIndex();
+        int instanceCount = meshInstanceData_.instanceListMap[mapIndex].size();
+        count += instanceCount;
+        for (Drawable *drawable : meshInstanceData_.baseMeshListMap[mapIndex])
+            triangleCount_ += instanceCount * drawable->getTriangleCount();
+    }
 
-    return ret;
+    TerrainInstance *ring = static_cast<TerrainInstance *>(instanceRing_.beginFrame(count));
+    int first = instanceRing_.getFrameBase();
+    for (TerrainQuadTree *tree : activeTrees_) {
+        int mapIndex = tree->getHeightMapIndex();
+        std::vector<TerrainInstance> &instances = meshInstanceData_.instanceListMap[mapIndex];
+        if (instances.empty())
+            continue;
+
+        std::copy(instances.begin(), instances.end(), ring);
+        int &ringGeneration = meshInstanceData_.ringGenerationMap[mapIndex];
+        for (Drawable *drawable : meshInstanceData_.baseMeshListMap[mapIndex]) {
+            for (Mesh *mesh : drawable->getMeshes()) {
+                if (ringGeneration != instanceRing_.getGeneration())
+                    mesh->setInstanceBuffer(instanceRing_.getBuffer(), sizeof(TerrainInstance), TERRAIN_INSTANCE_LAYOUT);
+                mesh->setInstanceRange(first, instances.size());
+            }
+        }
+        ringGeneration = instanceRing_.getGeneration();
+        ring += instances.size();
+        first += instances.size();
+    }
+    instanceRing_.endFrame();
 }
 
-glm::vec3 CdlodTree::getRotationAxis(glm::vec3 &axis, float *degree) {
-    glm::vec3 rotAx;
+/* The controller stepped since the last selection. Cached selections were made with the old ranges */
+void CdlodTree::applyRangeScale() {
+    float scale = rangeController_.getRangeScale();
+    if (scale == rangeScale_)
+        return;
+
+    rangeScale_ = scale;
+    rangeController_.scaleRanges(baseRanges_, ranges_);
+    refineRangesDirty_ = true;
+    for (int i = 0; i < quadTrees_.size(); ++i) {
+        /* Moving roots belong to a pool job, moveTo invalidates them anyway */
+        if (!quadTrees_[i] || (streamedTrees_[i].parentIndex < 0 && movingRoots_[rootIndices_[i]]))
+            continue;
+        quadTrees_[i]->invalidateSelection();
+    }
+}
 
-    if (axis.x) {
-        rotAx = glm::vec3(0,0,1);
-        *degree = 90.0f;
+/*
+ * A node's refine range depends on the touching nodes one level finer, in its own tree, in child trees and in the
+ * neighbouring roots. So all trees go through the lod levels together, from the finest up.
+ * Only trees whose ranges changed select everything again.
+ */
+void CdlodTree::updateRefineRanges() {
+    if (!refineRangesDirty_)
+        return;
+    refineRangesDirty_ = false;
+
+    rootCells_.clear();
+    for (int i = 0; !terrainAttributes_->bodyRadius && i < (int)rootNodeList_.size(); ++i) {
+        if (!movingRoots_[i])
+            rootCells_[getCellKey(rootNodeList_[i]->getPosition(), rootNodeList_[i]->getSize())] = rootNodeList_[i];
     }
-    else if (axis.y) {
-        rotAx = glm::vec3(0,1,0);
-        *degree = 0.0f;
+
+    /* Moving roots belong to a pool job, they are updated once they are back */
+    std::vector<std::pair<TerrainQuadTree *, TerrainQuadTree *>> trees; // With their roots
+    for (int i = 0; i < quadTrees_.size(); ++i) {
+        if (!quadTrees_[i] || (streamedTrees_[i].parentIndex < 0 && movingRoots_[rootIndices_[i]]))
+            continue;
+        trees.push_back(std::make_pair(quadTrees_[i], rootNodeList_[getRootIndex(i)]));
     }
-    else {
-        rotAx = glm::vec3(1,0,0);
-        *degree = 90.0f;
+
+    for (int lodLevel = 1; lodLevel < (int)ranges_.size(); ++lodLevel) {
+        for (std::pair<TerrainQuadTree *, TerrainQuadTree *> &tree : trees) {
+            TerrainQuadTree *root = tree.second;
+            tree.first->updateRefineRanges(lodLevel, ranges_, errorToRange_, [this, root](int finerLevel, const glm::vec2 &pos) {
+                return getOuterRefineRange(root, finerLevel, pos);
+            });
+        }
     }
+}
 
-    return rotAx;
+/* Plane roots continue in the neighbouring cells. Planet roots are cube sides, past their edges only the distance ranges hold */
+float CdlodTree::getOuterRefineRange(TerrainQuadTree *root, int lodLevel, const glm::vec2 &pos) {
+    glm::vec2 offset = pos - root->getPosition();
+    float size = root->getSize();
+    if (offset.x >= 0.0f && offset.y >= 0.0f && offset.x < size && offset.y < size)
+        return root->getRefineRange(lodLevel, pos);
+    if (terrainAttributes_->bodyRadius)
+        return ranges_[lodLevel - 1];
+
+    std::unordered_map<long long, TerrainQuadTree *>::iterator cell = rootCells_.find(getCellKey(pos, size));
+    return cell != rootCells_.end() ? cell->second->getRefineRange(lodLevel, pos) : -1.0f;
 }
 
-float CdlodTree::getPrevRange(int lodLevel) {
-    return lodLevel == 0 ? 0.0f : ranges_[lodLevel - 1];
+void CdlodTree::setTriangleBudget(int triangles) {
+    rangeController_.setBudget(triangles);
+}
+
+/* A plane reaches the horizon. A planet covers its projected diameter, inside it covers everything */
+float CdlodTree::getScreenSize(View *view) {
+    float radius = terrainAttributes_->bodyRadius;
+    float distance = glm::length(view->getCameraPosition() - terrainAttributes_->bodyOrigin);
+    if (!radius || distance <= radius)
+        return 1.0f;
+
+    float halfAngleTan = radius / std::sqrt(distance * distance - radius * radius);
+    return glm::clamp(halfAngleTan * view->getProjectionMatrix()[1][1], MIN_SCREEN_SIZE, 1.0f);
+}
+
+/* Cube side of axis as the terrain shader numbers them */
+unsigned int CdlodTree::getTerrainFace(const glm::vec3 &axis) {
+    int component = axis.x ? 0 : axis.y ? 1 : 2;
+    return component * 2 + (axis[component] < 0.0f ? 1 : 0);
 }
 
 // TODO: Radius and origin at 2 different positions in memory...think about it and change
 // TODO: Provide terrainAttributes to the class
-Planet::Planet(TerrainGenerator *terrainGen) : terrainGen_(terrainGen) {
+Planet::Planet(TerrainGenerator *terrainGen, size_t memoryBudget, float maxPixelError) : terrainGen_(terrainGen) {
+    terrainAttributes_.memoryBudget = memoryBudget;
+    terrainAttributes_.maxPixelError = maxPixelError;
     terrainAttributes_.bodyOrigin = terrainGen_->getSphereOrigin();
     terrainAttributes_.bodyRadius = terrainGen_->getSphereRadius();
     terrainAttributes_.hasAtmosphere = false;
@@ -342,11 +999,25 @@ void Planet::initPlanet() {
     lodTree_ = new CdlodTree(imple, &terrainAttributes_);
 }
 
+void Planet::addSelectionJobs(View *view, std::vector<std::function<void()>> &jobs) {
+    lodTree_->addSelectionJobs(view, jobs);
+}
+
 void Planet::update(View *view, TerrainObjectRenderData *terrainObjectRenderData) {
     lodTree_->update(view, terrainObjectRenderData);
 }
 
-EndlessPlane::EndlessPlane(TerrainGenerator *terrainGen) : terrainGen_(terrainGen) {
+void Planet::setTriangleBudget(int triangles) {
+    lodTree_->setTriangleBudget(triangles);
+}
+
+float Planet::getScreenSize(View *view) {
+    return lodTree_->getScreenSize(view);
+}
+
+EndlessPlane::EndlessPlane(TerrainGenerator *terrainGen, size_t memoryBudget, float maxPixelError) : terrainGen_(terrainGen) {
+    terrainAttributes_.memoryBudget = memoryBudget;
+    terrainAttributes_.maxPixelError = maxPixelError;
     terrainAttributes_.bodyOrigin = glm::vec3(0,0,0);
     terrainAttributes_.bodyRadius = 0.0f;
     terrainAttributes_.hasAtmosphere = false;
@@ -365,6 +1036,18 @@ void EndlessPlane::initPlane() {
     lodTree_ = new CdlodTree(imp, &terrainAttributes_);
 }
 
+void EndlessPlane::addSelectionJobs(View *view, std::vector<std::function<void()>> &jobs) {
+    lodTree_->addSelectionJobs(view, jobs);
+}
+
 void EndlessPlane::update(View *view, TerrainObjectRenderData *terrainObjectRenderData) {
     lodTree_->update(view, terrainObjectRenderData);
+}
+
+void EndlessPlane::setTriangleBudget(int triangles) {
+    lodTree_->setTriangleBudget(triangles);
+}
+
+float EndlessPlane::getScreenSize(View *view) {
+    return lodTree_->getScreenSize(view);
 }
\ No newline at end of file
@@ -1,19 +1,18 @@
 #include "terrainmeshdata.hpp"
+#include "global.hpp"
+#include "parallel.hpp"
+
+namespace {
+/* A face normal is a cross product and a normalize, a few thousand of them take tens of microseconds */
+const int MIN_TRIANGLES_PER_CHUNK = 4096;
+/* Vertices only get normalized, about half the work of a triangle */
+const int MIN_VERTICES_PER_CHUNK = 8192;
+} // namespace
 
 TerrainMeshData::TerrainMeshData(int numVertsPerLine, int skipIncrement, VertexType type) {
     initMeshData(numVertsPerLine, skipIncrement, type);
 }
 
-TerrainMeshData::TerrainMeshData(int numVertsPerLine, int skipIncrement, PerlinNoise &noiseGen, 
-                                std::vector<unsigned char> *heightValues, std::vector<unsigned char> *normalValues, VertexType type) {
-    initMeshData(numVertsPerLine, 1, type);
-    heightMapHeightValues = heightValues;
-    heightMapNormalValues = normalValues;
-    heightLowerBound = noiseGen.getLowerBound();
-    heightUpperBound = noiseGen.getUpperBound();
-    calcHeightMap_ = true;
-}
-
 void TerrainMeshData::initMeshData(int numVertsPerLine, int skipIncrement, VertexType type) {
     int numMeshEdgeVertices = (numVertsPerLine - 2) * 4 - 4;
     int numMainVerticesPerLine = ((numVertsPerLine - 3) / skipIncrement + 1) - 2;
@@ -33,11 +32,6 @@ void TerrainMeshData::initMeshData(int numVertsPerLine, int skipIncrement, Verte
     outOfMeshTriangles.resize(3 * (4 * (2 * (numVertsPerLine - 1)) - 8));
 }
 
-void TerrainMeshData::addHeight(float height, int vertexIndex) {
-    if (calcHeightMap_ && vertexIndex >= 0)
-        (*heightMapHeightValues)[vertexIndex] = mapRangeToUnsignedByte(height, heightLowerBound, heightUpperBound);
-}
-
 void TerrainMeshData::addVertex(glm::vec3 pos, glm::vec2 uv, int vertexIndex) {
     if (vertexIndex < 0)
         outOfMeshVertices[-vertexIndex - 1] = pos; // Because index starts with -1 for outOfMesh vertices
@@ -72,20 +66,26 @@ glm::vec3 TerrainMeshData::calculateNormalFromIndices(int index0, int index1, in
     return glm::normalize(glm::cross(p0, p1));
 }
 
-void TerrainMeshData::calculateNormals(bool createHeightMap) {
+/*
+ * The face normals are calculated in parallel, vertices share triangles though, so they are summed up in triangle order.
+ * Normalizing runs in parallel again.
+ */
+void TerrainMeshData::calculateNormals() {
     int triangleCount = vertexData->indices.size() / 3;
+    std::vector<glm::vec3> faceNormals(triangleCount);
+    parallelFor(g_threadPool, 0, triangleCount, MIN_TRIANGLES_PER_CHUNK, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            int normalIndex = i * 3;
+            faceNormals[i] = calculateNormalFromIndices(vertexData->indices[normalIndex], vertexData->indices[normalIndex + 1],
+                                                        vertexData->indices[normalIndex + 2]);
+        }
+    });
 
     for (int i = 0; i < triangleCount; ++i) {
         int normalIndex = i * 3;
-        int index0 = vertexData->indices[normalIndex];
-        int index1 = vertexData->indices[normalIndex + 1];
-        int index2 = vertexData->indices[normalIndex + 2];
-
-        glm::vec3 normal = calculateNormalFromIndices(index0, index1, index2);
-
-        vertexData->vertices[index0].normal += normal;
-        vertexData->vertices[index1].normal += normal;
-        vertexData->vertices[index2].normal += normal;
+        vertexData->vertices[vertexData->indices[normalIndex]].normal += faceNormals[i];
+        vertexData->vertices[vertexData->indices[normalIndex + 1]].normal += faceNormals[i];
+        vertexData->vertices[vertexData->indices[normalIndex + 2]].normal += faceNormals[i];
     }
 
     int borderTriangleCount = outOfMeshTriangles.size() / 3;
@@ -105,34 +105,10 @@ void TerrainMeshData::calculateNormals(bool createHeightMap) {
             vertexData->vertices[index2].normal += normal;
     }
 
-    for (int i = 0; i < vertexData->vertices.size(); ++i) {
-        vertexData->vertices[i].normal = glm::normalize(vertexData->vertices[i].normal);
-    }
-
-    if (createHeightMap) {
-        float lower = -1.0f;
-        float upper = 1.0f;
-        for (int i = 0; i < vertexData->vertices.size(); ++i) {
-            (*heightMapNormalValues)[i * 3] = mapRangeToUnsignedByte(vertexData->vertices[i].normal.x, lower, upper);
-            (*heightMapNormalValues)[i * 3 + 1] = mapRangeToUnsignedByte(vertexData->vertices[i].normal.y, lower, upper);
-            (*heightMapNormalValues)[i * 3 + 2] = mapRangeToUnsignedByte(vertexData->vertices[i].normal.z, lower, upper);
-        }
-    }
-}
-
-unsigned char TerrainMeshData::mapRangeToUnsignedByte(float inVal, float lowerBound, float upperBound) {
-    float in = clamp(inVal, lowerBound, upperBound);
-    float s = 1.0 * (255 - 0) / (upperBound - lowerBound);
-    return 0 + std::floor((s * (inVal - lowerBound)) + 0.5);
-}
-
-float TerrainMeshData::clamp(float i, float l, float u) {
-    if (i < l)
-        return l;
-    else if (i > u)
-        return u;
-    else
-        return i;
+    parallelFor(g_threadPool, 0, vertexData->vertices.size(), MIN_VERTICES_PER_CHUNK, [this](int begin, int end) {
+        for (int i = begin; i < end; ++i)
+            vertexData->vertices[i].normal = glm::normalize(vertexData->vertices[i].normal);
+    });
 }
 
 void TerrainMeshData::destroy() {
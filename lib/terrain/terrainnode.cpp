@@ -1,6 +1,10 @@
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <limits>
 #include <glm/gtx/string_cast.hpp>
+#include <glm/gtc/constants.hpp>
 #include "terrainnode.hpp"
-#include "view.hpp"
 #include "mathutils.hpp"
 
 TerrainNode::TerrainNode(TerrainTile *terrain, TerrainTile *water) : terrain_(terrain), water_(water) {}
@@ -86,117 +90,620 @@ void TerrainNode::update() {
     ;
 }
 
-/* TODO: getMaxMinValuesFromArea -> call when reached lowest level of current heightmap, instead of global 0 
- *          -> that means a heightMap needs a range of lod levels it covers.
+TerrainQuadTree::TerrainQuadTree(int heightMapIndex, glm::vec2 pos, int dimension, int lodLevelCount, BoundsFunction getBounds,
+                                 int leafLodLevel, int meshSize)
+    : heightMapIndex_(heightMapIndex), position_(pos), dimension_(dimension), getBounds_(getBounds), leafLodLevel_(leafLodLevel),
+      meshSize_(meshSize) {
+    int levelCount = lodLevelCount - leafLodLevel_;
+    if (levelCount < 1 || levelCount > MAX_LEVELS) {
+        fprintf(stdout, "[TERRAINQUADTREE::TerrainQuadTree] Error: Invalid level count %i\n", levelCount);
+        levelCount = glm::clamp(levelCount, 1, MAX_LEVELS);
+    }
+
+    levels_.resize(levelCount);
+    for (int i = 0; i < levelCount; ++i) {
+        Level &level = levels_[i];
+        level.nodesPerSide = 1 << (levelCount - 1 - i);
+        level.nodeSize = dimension_ / level.nodesPerSide;
+        level.nodes.resize(level.nodesPerSide * level.nodesPerSide);
+    }
+    readBounds();
+
+    leafScheduled_.resize(levels_[0].nodes.size(), false);
+    blockLevel_ = std::max(levelCount - 1 - BLOCK_DEPTH, 0);
+    blocks_.resize(levels_[blockLevel_].nodes.size());
+}
+
+void TerrainQuadTree::readBounds() {
+    /* The root bounds contain all others, they define the quantization range */
+    float rootMin, rootMax;
+    getBounds_(position_, dimension_, &rootMin, &rootMax);
+    heightOffset_ = rootMin;
+    heightScale_ = std::max(rootMax - rootMin, 1e-3f) / 65535.0f;
+
+    for (Level &level : levels_) {
+        for (int y = 0; y < level.nodesPerSide; ++y) {
+            for (int x = 0; x < level.nodesPerSide; ++x) {
+                glm::vec2 nodePos = position_ + glm::vec2(x, y) * level.nodeSize;
+                float min, max;
+                getBounds_(nodePos, level.nodeSize, &min, &max);
+                /* Round outwards, so the quantized box still contains the node */
+                NodeBounds &bounds = level.nodes[y * level.nodesPerSide + x];
+                bounds.minHeight = (unsigned short)glm::clamp(std::floor((min - heightOffset_) / heightScale_), 0.0f, 65535.0f);
+                bounds.maxHeight = (unsigned short)glm::clamp(std::ceil((max - heightOffset_) / heightScale_), 0.0f, 65535.0f);
+            }
+        }
+    }
+    if (meshSize_ > 0)
+        readErrors();
+}
+
+/*
+ * A node is drawn as meshSize * meshSize quads. The surface within a quad stays between the min and max of its area,
+ * so the largest height range of any quad bounds how far the mesh is off. That includes the detail the heightmap
+ * does not have, see HeightMap::getMaxMinValuesFromArea. A parent is never more exact than its children.
  */
-TerrainNode_::TerrainNode_(HeightMap *heightMap, int nodeDimension, int lod, glm::vec2 pos) : nodeDimension_(nodeDimension), nodePos_(pos), lodLevel_(lod) {
-    heightMapIndex_ = heightMap->getIndex();
-    
-    if (lod == 0) {
-        heightMap->getMaxMinValuesFromArea(nodePos_, nodeDimension_, &nodeMinHeight_, &nodeMaxHeight_);
-    } else {
-        createChildren(heightMap, nodeDimension_, lod);
-        for (TerrainNode_ *child : children_) {
-            nodeMaxHeight_ = std::max(child->getNodeMaxHeight(), nodeMaxHeight_);
-            nodeMinHeight_ = std::min(child->getNodeMinHeight(), nodeMinHeight_);
+void TerrainQuadTree::readErrors() {
+    for (int i = 0; i < (int)levels_.size(); ++i) {
+        Level &level = levels_[i];
+        level.errors.resize(level.nodes.size());
+        float quadSize = level.nodeSize / meshSize_;
+        int quadDimension = std::max(1, (int)std::ceil(quadSize));
+        for (int y = 0; y < level.nodesPerSide; ++y) {
+            for (int x = 0; x < level.nodesPerSide; ++x) {
+                glm::vec2 nodePos = position_ + glm::vec2(x, y) * level.nodeSize;
+                float error = 0.0f;
+                for (int qy = 0; qy < meshSize_; ++qy) {
+                    for (int qx = 0; qx < meshSize_; ++qx) {
+                        glm::vec2 quadPos = nodePos + glm::vec2(qx, qy) * quadSize;
+                        float min, max;
+                        getBounds_(quadPos, quadDimension, &min, &max);
+                        error = std::max(error, max - min);
+                    }
+                }
+
+                unsigned short &nodeError = level.errors[y * level.nodesPerSide + x];
+                nodeError = (unsigned short)glm::clamp(std::ceil(error / heightScale_), 0.0f, 65535.0f);
+                if (i == 0)
+                    continue;
+
+                Level &below = levels_[i - 1];
+                for (int c = 0; c < 4; ++c)
+                    nodeError = std::max(nodeError, below.errors[(y * 2 + c / 2) * below.nodesPerSide + x * 2 + c % 2]);
+            }
         }
     }
 }
 
-TerrainNode_::~TerrainNode_() {
-    for (TerrainNode_ *t : children_)
-        delete t;
+void TerrainQuadTree::moveTo(const glm::vec2 &pos) {
+    if (!children_.empty())
+        fprintf(stdout, "[TERRAINQUADTREE::moveTo] Error: Children are still attached\n");
+
+    position_ = pos;
+    readBounds();
+    std::fill(leafScheduled_.begin(), leafScheduled_.end(), false);
+    selectionValid_ = false;
 }
 
-void TerrainNode_::createChildren(HeightMap *heightMap, int dim, int lod) {
-    int half = dim / 2;
-    --lod;
+void TerrainQuadTree::getNodeBox(StackEntry &node, glm::vec3 &min, glm::vec3 &max) {
+    Level &level = levels_[node.level];
+    NodeBounds bounds = level.nodes[node.y * level.nodesPerSide + node.x];
+    min = glm::vec3(position_.x + node.x * level.nodeSize, heightOffset_ + bounds.minHeight * heightScale_,
+                    position_.y + node.y * level.nodeSize);
+    max = glm::vec3(min.x + level.nodeSize, heightOffset_ + bounds.maxHeight * heightScale_, min.z + level.nodeSize);
+}
 
-    children_[0] = new TerrainNode_(heightMap, half, lod, glm::vec3(nodePos_.x, 0, nodePos_.y));
-    children_[1] = new TerrainNode_(heightMap, half, lod, glm::vec3(nodePos_.x + half, 0, nodePos_.y));
-    children_[2] = new TerrainNode_(heightMap, half, lod, glm::vec3(nodePos_.x, 0, nodePos_.y + half));
-    children_[3] = new TerrainNode_(heightMap, half, lod, glm::vec3(nodePos_.x + half, 0, nodePos_.y + half));
+void TerrainQuadTree::setSphere(const glm::vec3 &axis, const glm::vec3 &origin, float radius, float occluderRadius, TiltFunction getMaxTilt) {
+    sphereAxis_ = axis;
+    sphereOrigin_ = origin;
+    sphereRadius_ = radius;
+    occluderRadius_ = occluderRadius;
+
+    for (Level &level : levels_) {
+        level.maxTilts.resize(level.nodes.size());
+        for (int y = 0; y < level.nodesPerSide; ++y) {
+            for (int x = 0; x < level.nodesPerSide; ++x) {
+                glm::vec2 nodePos = position_ + glm::vec2(x, y) * level.nodeSize;
+                float tilt = getMaxTilt(nodePos, level.nodeSize);
+                level.maxTilts[y * level.nodesPerSide + x] =
+                    (unsigned char)glm::clamp(std::ceil(tilt * 255.0f / glm::half_pi<float>()), 0.0f, 255.0f);
+            }
+        }
+    }
+    selectionValid_ = false;
+}
 
-    childrenCreated_ = true;
+/* Direction from the sphere origin to the cube side position (x, y) */
+glm::vec3 TerrainQuadTree::getSphereDirection(float x, float y) {
+    glm::vec3 pos;
+    if (sphereAxis_.x)
+        pos = glm::vec3(sphereOrigin_.x + sphereAxis_.x * sphereRadius_, y, x);
+    else if (sphereAxis_.y)
+        pos = glm::vec3(x, sphereOrigin_.y + sphereAxis_.y * sphereRadius_, y);
+    else
+        pos = glm::vec3(x, y, sphereOrigin_.z + sphereAxis_.z * sphereRadius_);
+
+    return glm::normalize(pos - sphereOrigin_);
 }
 
-void TerrainNode_::insertNode(IndexedTerrainNodeListMap &nodeMap, TerrainNode_ *node) {
-    auto it = nodeMap.find(heightMapIndex_);
+/*
+ * A node on the sphere lies in a cone around its center direction. Its half angle is the largest corner angle,
+ * cube side edges map to great circles, so no point of the node is further out.
+ * Horizon: every point of the node is further from the camera direction than the angle at which a point
+ * at the node's max radius can still be seen over the occluder sphere.
+ * Back faces: the surface normal is at most tilt away from the radial direction, so n . (camera - p) is at most
+ * d * cos(angle between camera and cone minus tilt) - minRadius * cos(tilt). Below 0 every triangle faces away.
+ * slack is lowered to the distance the camera can move before the result may change. The back face term moves
+ * at most as fast as the camera, the horizon term only has a first order bound, halved to stay on the safe side.
+ */
+bool TerrainQuadTree::isHidden(StackEntry &node, float minHeight, float maxHeight, const glm::vec3 &cameraPosition, float *slack) {
+    Level &level = levels_[node.level];
+    float x0 = position_.x + node.x * level.nodeSize;
+    float y0 = position_.y + node.y * level.nodeSize;
+    float x1 = x0 + level.nodeSize;
+    float y1 = y0 + level.nodeSize;
+
+    glm::vec3 center = getSphereDirection(0.5f * (x0 + x1), 0.5f * (y0 + y1));
+    float minCos = std::min(std::min(glm::dot(center, getSphereDirection(x0, y0)), glm::dot(center, getSphereDirection(x1, y0))),
+                            std::min(glm::dot(center, getSphereDirection(x0, y1)), glm::dot(center, getSphereDirection(x1, y1))));
+    float coneAngle = std::acos(glm::clamp(minCos, -1.0f, 1.0f));
+
+    glm::vec3 toCamera = cameraPosition - sphereOrigin_;
+    float distance = glm::length(toCamera);
+    if (distance <= 0.0f) {
+        *slack = 0.0f;
+        return false;
+    }
+    float cameraAngle = std::acos(glm::clamp(glm::dot(center, toCamera / distance), -1.0f, 1.0f));
+
+    bool behindHorizon = false;
+    float horizonSlack = std::numeric_limits<float>::max();
+    if (occluderRadius_ > 0.0f) {
+        horizonSlack = std::abs(distance - occluderRadius_);
+        if (distance > occluderRadius_) {
+            float maxRadius = std::max(sphereRadius_ + maxHeight, occluderRadius_);
+            float horizon = std::acos(occluderRadius_ / distance) + std::acos(occluderRadius_ / maxRadius);
+            float margin = cameraAngle - coneAngle - horizon;
+            behindHorizon = margin > 0.0f;
+
+            float gradient = 1.0f / distance + occluderRadius_ / (distance * std::sqrt(distance * distance - occluderRadius_ * occluderRadius_));
+            horizonSlack = 0.5f * std::min(horizonSlack, std::abs(margin) / gradient);
+        }
+    }
+
+    bool backFacing = false;
+    float backFaceSlack = std::numeric_limits<float>::max();
+    float tilt = level.maxTilts[node.y * level.nodesPerSide + node.x] * glm::half_pi<float>() / 255.0f;
+    float minRadius = sphereRadius_ + minHeight;
+    if (tilt < glm::half_pi<float>() && minRadius > 0.0f) {
+        float closestNormalAngle = std::max(0.0f, cameraAngle - coneAngle - tilt);
+        float margin = minRadius * std::cos(tilt) - distance * std::cos(closestNormalAngle);
+        backFacing = margin > 0.0f;
+        backFaceSlack = std::abs(margin);
+    }
 
-    if (it == nodeMap.end())
-        nodeMap.emplace(std::make_pair(heightMapIndex_, std::vector<TerrainNode_ *>(1, node)));
+    /* A hidden node stays hidden while one of the hiding tests holds, a visible one needs both to stay false */
+    if (behindHorizon || backFacing)
+        *slack = std::min(*slack, std::max(behindHorizon ? horizonSlack : 0.0f, backFacing ? backFaceSlack : 0.0f));
     else
-        it->second.push_back(node);
+        *slack = std::min(*slack, std::min(horizonSlack, backFaceSlack));
+
+    return behindHorizon || backFacing;
 }
 
 /*
- * TODO: Fix frustum culling && Add culling of nodes that are not visible due to being on the other side of the sphere
+ * Same selection as the recursive version: a node out of its own range is skipped if it is the root,
+ * otherwise it covers its area for the parent. Children are pushed in reverse, so the output order matches.
+ * Nodes outside the frustum are dropped before they are pushed, hidden nodes of a planet once they are popped.
+ * The 4 children of a node are tested in one batch and only against the planes their parent intersects,
+ * so everything below a fully visible node skips the test.
+ * Nodes on blockLevel below start are handed to selectBlock. If given, slack is lowered to the smallest distance
+ * between the camera and a range border of a tested node.
  */
-bool TerrainNode_::lodSelect(std::vector<float> &ranges, int lodLevel, View *view, IndexedTerrainNodeListMap &nodeMap, std::vector<TerrainNode_ *> &creationList) {
-    currentLodRange_ = ranges[lodLevel];
+void TerrainQuadTree::selectNodes(StackEntry start, int blockLevel, SelectionContext &context, std::vector<TerrainNodeInfo> &selected,
+                                  std::vector<TerrainQuadTree *> &activeChildren, float *slack) {
+    std::vector<float> &ranges = *context.ranges;
+    const glm::vec3 &cameraPosition = context.cameraPosition;
+    const Frustum *frustum = context.frustum;
+    int top = levels_.size() - 1;
+    BoundingBox box;
+    float unusedSlack = 0.0f;
+
+    /* Every expanded node replaces itself with its 4 children */
+    StackEntry stack[3 * MAX_LEVELS + 1];
+    int stackSize = 0;
+    stack[stackSize++] = start;
+
+    while (stackSize) {
+        StackEntry node = stack[--stackSize];
+        if (node.level == blockLevel && node.level != start.level) {
+            selectBlock(node, context, selected, activeChildren);
+            continue;
+        }
 
-    BoundingBox bBox(glm::vec3(nodePos_.x, nodeMinHeight_, nodePos_.y), glm::vec3(nodePos_.x + nodeDimension_, nodeMaxHeight_, nodePos_.y + nodeDimension_));
+        Level &level = levels_[node.level];
+        getNodeBox(node, box.min, box.max);
+        if (sphereRadius_ && isHidden(node, box.min.y, box.max.y, cameraPosition, slack ? slack : &unusedSlack))
+            continue;
+
+        int lodLevel = leafLodLevel_ + node.level;
+        float range = ranges[lodLevel];
+        float distanceSq = box.minDistanceFromPointSq(cameraPosition);
+        float distance = slack ? std::sqrt(distanceSq) : 0.0f;
+        if (slack)
+            *slack = std::min(*slack, std::abs(distance - range));
+
+        if (distanceSq > range * range) {
+            if (node.level != top || coversParentLeaf_)
+                selected.push_back({heightMapIndex_, glm::vec2(box.min.x, box.min.z), (int)level.nodeSize, lodLevel, range});
+            continue;
+        }
 
-    if (!bBox.intersectSphereSq(view->getCameraPosition(), currentLodRange_ * currentLodRange_))
-        return false;
+        /* Refined within the range of the next level, with screen space error within the node's own range */
+        float refineRange = 0.0f;
+        if (lodLevel > 0)
+            refineRange = level.refineRanges.empty() ? ranges[lodLevel - 1] : level.refineRanges[node.y * level.nodesPerSide + node.x];
+        if (slack && lodLevel > 0)
+            *slack = std::min(*slack, std::abs(distance - refineRange));
+        if (lodLevel == 0 || distanceSq > refineRange * refineRange) {
+            selected.push_back({heightMapIndex_, glm::vec2(box.min.x, box.min.z), (int)level.nodeSize, lodLevel, range});
+            continue;
+        }
 
-    /*
-    //TODO ceifert: FIXME
-    if (!view->isInsideFrustum(bBox)) {
-        fprintf(stdout, "NotInFrustum. LodLevel: %i\n", lodLevel);
-        return true;
-    }
-    */
+        if (node.level > 0) {
+            /* Reverse order: (x+1, y+1), (x, y+1), (x+1, y), (x, y) */
+            StackEntry children[4];
+            for (int i = 0; i < 4; ++i)
+                children[i] = {node.level - 1, node.x * 2 + (~i & 1), node.y * 2 + (i < 2), 0};
+
+            if (node.planeMask) {
+                float minX[4], minY[4], minZ[4], maxX[4], maxY[4], maxZ[4];
+                unsigned char results[4];
+                for (int i = 0; i < 4; ++i) {
+                    glm::vec3 min, max;
+                    getNodeBox(children[i], min, max);
+                    minX[i] = min.x, minY[i] = min.y, minZ[i] = min.z;
+                    maxX[i] = max.x, maxY[i] = max.y, maxZ[i] = max.z;
+                }
 
-    if (lodLevel == 0) {
-        insertNode(nodeMap, this);
-        return true;
-    } else {
-        if (!bBox.intersectSphereSq(view->getCameraPosition(), ranges[lodLevel-1] * ranges[lodLevel-1])) {
-            insertNode(nodeMap, this);
-        } else {
-            if (childrenCreated_) {
-                for (TerrainNode_ *child : children_) {
-                    if (!child->lodSelect(ranges, lodLevel - 1, view, nodeMap, creationList)) {
-                        //child->currentLodRange_ = currentLodRange_;
-                        insertNode(nodeMap, child); // this should actually be the area covered by the child represented in the current lodlevel -> Hm...
-                    }
+                frustum->testBoxes(minX, minY, minZ, maxX, maxY, maxZ, 4, node.planeMask, results);
+                for (int i = 0; i < 4; ++i) {
+                    children[i].planeMask = results[i];
+                    if (results[i] != FRUSTUM_OUTSIDE)
+                        stack[stackSize++] = children[i];
                 }
             } else {
-                if (!childrenCreationScheduled_) {
-                    creationList.push_back(this); // create heightmap size of this node, so it covers all children
-                    childrenCreationScheduled_ = true;
+                for (int i = 0; i < 4; ++i)
+                    stack[stackSize++] = children[i];
+            }
+        } else {
+            int index = node.y * level.nodesPerSide + node.x;
+            if (!children_.empty()) {
+                std::unordered_map<int, TerrainQuadTree *>::iterator child = children_.find(index);
+                if (child != children_.end()) {
+                    activeChildren.push_back(child->second);
+                    continue;
                 }
+            }
 
-                /* Cover the are with ourself, while we wait for children to be created */
-                insertNode(nodeMap, this);
+            /* Cover the area with the leaf, while we wait for a more detailed heightmap */
+            TerrainNodeInfo info = {heightMapIndex_, glm::vec2(box.min.x, box.min.z), (int)level.nodeSize, lodLevel, range};
+            if (!leafScheduled_[index]) {
+                context.creationList->push_back(info);
+                leafScheduled_[index] = true;
             }
+            selected.push_back(info);
         }
+    }
+}
+
+/*
+ * The cached nodes are still valid if the camera stayed inside the block's slack and the frustum did not change
+ * for the block: either it was and is fully inside, or the frustum is the same and so is the root's plane mask.
+ */
+void TerrainQuadTree::selectBlock(StackEntry &node, SelectionContext &context, std::vector<TerrainNodeInfo> &selected,
+                                  std::vector<TerrainQuadTree *> &children) {
+    Block &block = blocks_[node.y * levels_[node.level].nodesPerSide + node.x];
+    float moved = glm::length(context.cameraPosition - block.cameraPosition);
+    bool sameVisibility = block.planeMask == node.planeMask && (!node.planeMask || !context.frustumChanged);
+
+    if (!block.valid || moved >= block.slack || !sameVisibility) {
+        block.valid = true;
+        block.cameraPosition = context.cameraPosition;
+        block.slack = std::numeric_limits<float>::max();
+        block.planeMask = node.planeMask;
+        block.nodes.clear();
+        block.children.clear();
+        selectNodes(node, -1, context, block.nodes, block.children, &block.slack);
+        moved = 0.0f;
+    }
+
+    context.slack = std::min(context.slack, block.slack - moved);
+    selected.insert(selected.end(), block.nodes.begin(), block.nodes.end());
+    children.insert(children.end(), block.children.begin(), block.children.end());
+}
+
+void TerrainQuadTree::lodSelect(std::vector<float> &ranges, const glm::vec3 &cameraPosition, const Frustum *frustum,
+                                IndexedTerrainNodeListMap &nodeMap, std::vector<TerrainNodeInfo> &creationList) {
+    StackEntry root = {(int)levels_.size() - 1, 0, 0, 0};
+    if (frustum) {
+        BoundingBox box;
+        getNodeBox(root, box.min, box.max);
+        root.planeMask = frustum->testBox(box.min, box.max, FRUSTUM_ALL_PLANES, &rootCullPlane_);
+        if (root.planeMask == FRUSTUM_OUTSIDE)
+            return;
+    }
+
+    SelectionContext context = {&ranges, cameraPosition, frustum, &creationList, true, 0.0f};
+    std::vector<TerrainQuadTree *> activeChildren;
+    selectNodes(root, -1, context, nodeMap[heightMapIndex_], activeChildren, nullptr);
+    for (TerrainQuadTree *child : activeChildren)
+        child->lodSelect(ranges, cameraPosition, frustum, nodeMap, creationList);
+}
+
+static bool isSameNode(const TerrainNodeInfo &a, const TerrainNodeInfo &b) {
+    return a.position == b.position && a.size == b.size && a.lodLevel == b.lodLevel && a.range == b.range;
+}
+
+/*
+ * While the camera stays within the slack of the last selection and the frustum is unchanged, nothing is traversed.
+ * Otherwise the levels above the blocks are selected again and the blocks decide whether their cache is still valid.
+ */
+bool TerrainQuadTree::updateSelection(std::vector<float> &ranges, const glm::vec3 &cameraPosition, const Frustum *frustum,
+                                      std::vector<TerrainNodeInfo> &creationList, int *first, int *end) {
+    bool frustumChanged = !selectionValid_ || (frustum != nullptr) != selectionHadFrustum_;
+    for (int i = 0; frustum && !frustumChanged && i < 6; ++i)
+        frustumChanged = frustum->getPlane(i) != selectionFrustum_.getPlane(i);
+
+    if (!frustumChanged && glm::length(cameraPosition - selectionCamera_) < selectionSlack_)
+        return false;
+
+    if (!selectionValid_) {
+        for (Block &block : blocks_)
+            block.valid = false;
+    }
+
+    nextSelection_.clear();
+    nextActiveChildren_.clear();
+    SelectionContext context = {&ranges, cameraPosition, frustum, &creationList, frustumChanged, std::numeric_limits<float>::max()};
+    StackEntry root = {(int)levels_.size() - 1, 0, 0, 0};
+    BoundingBox box;
+    getNodeBox(root, box.min, box.max);
+    if (frustum)
+        root.planeMask = frustum->testBox(box.min, box.max, FRUSTUM_ALL_PLANES, &rootCullPlane_);
+    if (root.planeMask != FRUSTUM_OUTSIDE)
+        selectNodes(root, blockLevel_, context, nextSelection_, nextActiveChildren_, &context.slack);
+
+    selectionValid_ = true;
+    selectionCamera_ = cameraPosition;
+    selectionSlack_ = context.slack;
+    selectionHadFrustum_ = frustum != nullptr;
+    if (frustum)
+        selectionFrustum_ = *frustum;
+
+    int size = std::min(selection_.size(), nextSelection_.size());
+    int begin = 0;
+    while (begin < size && isSameNode(selection_[begin], nextSelection_[begin]))
+        ++begin;
+    int tail = 0;
+    if (selection_.size() == nextSelection_.size()) {
+        while (tail < size - begin && isSameNode(selection_[size - 1 - tail], nextSelection_[size - 1 - tail]))
+            ++tail;
+    }
+
+    selection_.swap(nextSelection_);
+    activeChildren_.swap(nextActiveChildren_);
+    if (begin == (int)selection_.size() && selection_.size() == nextSelection_.size())
+        return false;
+
+    *first = begin;
+    *end = selection_.size() - tail;
+    return true;
+}
+
+std::vector<TerrainNodeInfo> &TerrainQuadTree::getSelection() {
+    return selection_;
+}
+
+void TerrainQuadTree::invalidateSelection() {
+    selectionValid_ = false;
+}
+
+std::vector<TerrainQuadTree *> &TerrainQuadTree::getActiveChildren() {
+    return activeChildren_;
+}
+
+bool TerrainQuadTree::getLeaf(const glm::vec2 &leafPosition, StackEntry &leaf) {
+    Level &leaves = levels_[0];
+    leaf.level = 0;
+    leaf.x = (int)std::floor((leafPosition.x - position_.x) / leaves.nodeSize);
+    leaf.y = (int)std::floor((leafPosition.y - position_.y) / leaves.nodeSize);
+    leaf.planeMask = 0;
+    return leaf.x >= 0 && leaf.y >= 0 && leaf.x < leaves.nodesPerSide && leaf.y < leaves.nodesPerSide;
+}
+
+void TerrainQuadTree::attachChild(const glm::vec2 &leafPosition, TerrainQuadTree *child) {
+    StackEntry leaf;
+    if (!getLeaf(leafPosition, leaf)) {
+        fprintf(stdout, "[TERRAINQUADTREE::attachChild] Error: Position is not a leaf of this tree\n");
+        return;
+    }
+
+    child->coversParentLeaf_ = true;
+    children_[leaf.y * levels_[0].nodesPerSide + leaf.x] = child;
+    selectionValid_ = false;
+}
+
+void TerrainQuadTree::detachChild(const glm::vec2 &leafPosition) {
+    StackEntry leaf;
+    if (!getLeaf(leafPosition, leaf)) {
+        fprintf(stdout, "[TERRAINQUADTREE::detachChild] Error: Position is not a leaf of this tree\n");
+        return;
+    }
+
+    int index = leaf.y * levels_[0].nodesPerSide + leaf.x;
+    children_.erase(index);
+    leafScheduled_[index] = false;
+    /* Cached blocks may still hold the child */
+    selectionValid_ = false;
+}
+
+/*
+ * The cached blocks need no invalidation: getting back into refinement range of the leaf
+ * crosses a range border, which recomputes the block holding it.
+ */
+void TerrainQuadTree::unscheduleLeaf(const glm::vec2 &leafPosition) {
+    StackEntry leaf;
+    if (!getLeaf(leafPosition, leaf)) {
+        fprintf(stdout, "[TERRAINQUADTREE::unscheduleLeaf] Error: Position is not a leaf of this tree\n");
+        return;
+    }
+
+    leafScheduled_[leaf.y * levels_[0].nodesPerSide + leaf.x] = false;
+}
 
-        return true;
+float TerrainQuadTree::getLeafDistance(const glm::vec2 &leafPosition, const glm::vec3 &cameraPosition) {
+    StackEntry leaf;
+    if (!getLeaf(leafPosition, leaf)) {
+        fprintf(stdout, "[TERRAINQUADTREE::getLeafDistance] Error: Position is not a leaf of this tree\n");
+        return std::numeric_limits<float>::max();
     }
+
+    BoundingBox box;
+    getNodeBox(leaf, box.min, box.max);
+    return std::sqrt(box.minDistanceFromPointSq(cameraPosition));
 }
 
-float TerrainNode_::getNodeMaxHeight() {
-    return nodeMaxHeight_;
+int TerrainQuadTree::getHeightMapIndex() {
+    return heightMapIndex_;
 }
 
-float TerrainNode_::getNodeMinHeight() {
-    return nodeMinHeight_;
+glm::vec2 &TerrainQuadTree::getPosition() {
+    return position_;
 }
 
-float TerrainNode_::getRange() {
-    return currentLodRange_;
+int TerrainQuadTree::getSize() {
+    return dimension_;
 }
 
-glm::vec2 &TerrainNode_::getPosition() {
-    return nodePos_;
+size_t TerrainQuadTree::getMemoryUsage() {
+    size_t bytes = leafScheduled_.size() / 8 + (selection_.capacity() + nextSelection_.capacity()) * sizeof(TerrainNodeInfo);
+    for (Level &level : levels_)
+        bytes += level.nodes.size() * sizeof(NodeBounds) + level.maxTilts.size() + level.errors.size() * sizeof(unsigned short) +
+                 level.refineRanges.size() * sizeof(float);
+    for (Block &block : blocks_)
+        bytes += sizeof(Block) + block.nodes.capacity() * sizeof(TerrainNodeInfo);
+    return bytes;
 }
 
-int TerrainNode_::getSize() {
-    return nodeDimension_;
+float TerrainQuadTree::getErrorToRange(float projectionScale, int screenHeight, float maxPixelError) {
+    /* error / distance * projectionScale is the projected error in half screen heights */
+    return projectionScale * screenHeight * 0.5f / maxPixelError;
 }
 
-int TerrainNode_::getLodLevel() {
-    return lodLevel_;
-}
\ No newline at end of file
+/*
+ * The camera is at most the gap between the distance ranges further from a node than from a finer node that touches it,
+ * as far as the distance ranges keep neighbours within one level. So a node whose range is at least that gap above
+ * the ranges of the touching finer nodes refines whenever one of them does. Those are the 4 * 4 nodes one level down
+ * around the node's children. Nodes on lod level 0 never refine and put no limit on their neighbours.
+ */
+void TerrainQuadTree::updateRefineRanges(int lodLevel, const std::vector<float> &ranges, float errorToRange,
+                                         const RefineRangeFunction &getOuterRange) {
+    int i = lodLevel - leafLodLevel_;
+    if (lodLevel < 1 || i < 0 || i >= (int)levels_.size())
+        return;
+
+    Level &level = levels_[i];
+    if (errorToRange <= 0.0f) {
+        if (!level.refineRanges.empty())
+            selectionValid_ = false;
+        level.refineRanges.clear();
+        return;
+    }
+
+    bool changed = level.refineRanges.size() != level.nodes.size();
+    level.refineRanges.resize(level.nodes.size());
+    float range = ranges[lodLevel - 1];
+    float gap = lodLevel > 1 ? range - ranges[lodLevel - 2] : 0.0f;
+    int finerPerSide = level.nodesPerSide * 2;
+    for (int y = 0; y < level.nodesPerSide; ++y) {
+        for (int x = 0; x < level.nodesPerSide; ++x) {
+            int index = y * level.nodesPerSide + x;
+            float refineRange = level.errors.empty() ? range : std::min(range, level.errors[index] * heightScale_ * errorToRange);
+            for (int fy = y * 2 - 1; lodLevel > 1 && fy <= y * 2 + 2; ++fy) {
+                for (int fx = x * 2 - 1; fx <= x * 2 + 2; ++fx) {
+                    bool inside = fx >= 0 && fy >= 0 && fx < finerPerSide && fy < finerPerSide;
+                    float finerRange = -1.0f;
+                    if (inside && i > 0) {
+                        finerRange = levels_[i - 1].refineRanges[fy * finerPerSide + fx];
+                    } else {
+                        /* Below the leaves in a child, or in another tree */
+                        glm::vec2 center = position_ + (glm::vec2(fx, fy) + 0.5f) * level.nodeSize * 0.5f;
+                        if (inside)
+                            finerRange = getRefineRange(lodLevel - 1, center);
+                        else if (getOuterRange)
+                            finerRange = getOuterRange(lodLevel - 1, center);
+                    }
+                    if (finerRange >= 0.0f)
+                        refineRange = std::max(refineRange, finerRange + gap);
+                }
+            }
+
+            changed |= level.refineRanges[index] != refineRange;
+            level.refineRanges[index] = refineRange;
+        }
+    }
+    if (changed)
+        selectionValid_ = false;
+}
+
+void TerrainQuadTree::updateRefineRanges(const std::vector<float> &ranges, float errorToRange) {
+    for (int i = 0; i < (int)levels_.size(); ++i)
+        updateRefineRanges(leafLodLevel_ + i, ranges, errorToRange, nullptr);
+}
+
+float TerrainQuadTree::getRefineRange(int lodLevel, const glm::vec2 &pos) {
+    int i = lodLevel - leafLodLevel_;
+    if (i >= (int)levels_.size())
+        return -1.0f;
+
+    if (i < 0) {
+        StackEntry leaf;
+        if (!getLeaf(pos, leaf))
+            return -1.0f;
+        auto child = children_.find(leaf.y * levels_[0].nodesPerSide + leaf.x);
+        return child != children_.end() ? child->second->getRefineRange(lodLevel, pos) : -1.0f;
+    }
+
+    Level &level = levels_[i];
+    if (level.refineRanges.empty())
+        return -1.0f;
+    int x = glm::clamp((int)std::floor((pos.x - position_.x) / level.nodeSize), 0, level.nodesPerSide - 1);
+    int y = glm::clamp((int)std::floor((pos.y - position_.y) / level.nodeSize), 0, level.nodesPerSide - 1);
+    return level.refineRanges[y * level.nodesPerSide + x];
+}
+
+float TerrainQuadTree::getNodeError(int level, const glm::vec2 &nodePosition) {
+    if (level < 0 || level >= (int)levels_.size() || levels_[level].errors.empty())
+        return 0.0f;
+
+    Level &nodes = levels_[level];
+    int x = glm::clamp((int)std::floor((nodePosition.x - position_.x) / nodes.nodeSize), 0, nodes.nodesPerSide - 1);
+    int y = glm::clamp((int)std::floor((nodePosition.y - position_.y) / nodes.nodeSize), 0, nodes.nodesPerSide - 1);
+    return nodes.errors[y * nodes.nodesPerSide + x] * heightScale_;
+}
+
+int TerrainQuadTree::getNodeCount() {
+    int count = 0;
+    for (Level &level : levels_)
+        count += level.nodes.size();
+    return count;
+}
+
+float TerrainQuadTree::getMinHeight() {
+    return heightOffset_ + levels_.back().nodes[0].minHeight * heightScale_;
+}
+
+float TerrainQuadTree::getMaxHeight() {
+    return heightOffset_ + levels_.back().nodes[0].maxHeight * heightScale_;
+}
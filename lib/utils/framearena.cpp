@@ -0,0 +1,54 @@
+#include <algorithm>
+#include <cstdint>
+#include "framearena.hpp"
+
+FrameArena::FrameArena(size_t capacity) {
+    blocks_.push_back({new char[std::max(capacity, (size_t)1)], std::max(capacity, (size_t)1)});
+}
+
+FrameArena::~FrameArena() {
+    for (Block &block : blocks_)
+        delete[] block.data;
+}
+
+void *FrameArena::allocate(size_t size, size_t alignment) {
+    Block *block = &blocks_.back();
+    uintptr_t start = (uintptr_t)block->data;
+    size_t offset = ((start + offset_ + alignment - 1) & ~(uintptr_t)(alignment - 1)) - start;
+    if (offset + size > block->size) {
+        /* Grow geometrically, the frame after the next reset fits into one block */
+        used_ += offset_;
+        size_t blockSize = std::max(block->size * 2, size + alignment);
+        blocks_.push_back({new char[blockSize], blockSize});
+        block = &blocks_.back();
+        start = (uintptr_t)block->data;
+        offset = ((start + alignment - 1) & ~(uintptr_t)(alignment - 1)) - start;
+    }
+
+    offset_ = offset + size;
+    return block->data + offset;
+}
+
+void FrameArena::reset() {
+    if (blocks_.size() > 1) {
+        size_t capacity = getCapacity();
+        for (Block &block : blocks_)
+            delete[] block.data;
+        blocks_.clear();
+        blocks_.push_back({new char[capacity], capacity});
+    }
+
+    offset_ = 0;
+    used_ = 0;
+}
+
+size_t FrameArena::getUsed() {
+    return used_ + offset_;
+}
+
+size_t FrameArena::getCapacity() {
+    size_t capacity = 0;
+    for (Block &block : blocks_)
+        capacity += block.size;
+    return capacity;
+}
@@ -0,0 +1,104 @@
+#include "frustum.hpp"
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+Frustum::Frustum() {
+    for (glm::vec4 &plane : planes_)
+        plane = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+void Frustum::extractPlanes(const glm::mat4 &viewProjection) {
+    /* glm is column major, row i is (m[0][i], m[1][i], m[2][i], m[3][i]) */
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; ++i)
+        rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+    planes_[0] = rows[3] + rows[0];
+    planes_[1] = rows[3] - rows[0];
+    planes_[2] = rows[3] + rows[1];
+    planes_[3] = rows[3] - rows[1];
+    planes_[4] = rows[3] + rows[2];
+    planes_[5] = rows[3] - rows[2];
+
+    for (glm::vec4 &plane : planes_)
+        plane /= glm::length(glm::vec3(plane));
+}
+
+/*
+ * The corner furthest along the normal decides whether the box is outside,
+ * the corner furthest against it whether the box is fully inside.
+ */
+unsigned char Frustum::testBox(const glm::vec3 &min, const glm::vec3 &max, unsigned char planeMask, int *coherentPlane) const {
+    int start = coherentPlane ? *coherentPlane : 0;
+    unsigned char result = planeMask;
+
+    for (int k = 0; k < 6; ++k) {
+        int i = (start + k) % 6;
+        if (!(planeMask & (1 << i)))
+            continue;
+
+        const glm::vec4 &p = planes_[i];
+        glm::vec3 far(p.x >= 0 ? max.x : min.x, p.y >= 0 ? max.y : min.y, p.z >= 0 ? max.z : min.z);
+        if (glm::dot(glm::vec3(p), far) + p.w < 0) {
+            if (coherentPlane)
+                *coherentPlane = i;
+            return FRUSTUM_OUTSIDE;
+        }
+
+        glm::vec3 near(p.x >= 0 ? min.x : max.x, p.y >= 0 ? min.y : max.y, p.z >= 0 ? min.z : max.z);
+        if (glm::dot(glm::vec3(p), near) + p.w >= 0)
+            result &= ~(1 << i);
+    }
+
+    return result;
+}
+
+void Frustum::testBoxes(const float *minX, const float *minY, const float *minZ, const float *maxX, const float *maxY,
+                        const float *maxZ, int count, unsigned char planeMask, unsigned char *results) const {
+    int i = 0;
+#ifdef __SSE__
+    /* max(n * min, n * max) picks the far corner per axis without branches, min(...) the near one */
+    for (; i + 4 <= count; i += 4) {
+        __m128 x0 = _mm_loadu_ps(minX + i), x1 = _mm_loadu_ps(maxX + i);
+        __m128 y0 = _mm_loadu_ps(minY + i), y1 = _mm_loadu_ps(maxY + i);
+        __m128 z0 = _mm_loadu_ps(minZ + i), z1 = _mm_loadu_ps(maxZ + i);
+        __m128 zero = _mm_setzero_ps();
+        int outside = 0;
+        int intersecting[6] = {0, 0, 0, 0, 0, 0};
+
+        for (int j = 0; j < 6; ++j) {
+            if (!(planeMask & (1 << j)))
+                continue;
+
+            const glm::vec4 &p = planes_[j];
+            __m128 nx = _mm_set1_ps(p.x), ny = _mm_set1_ps(p.y), nz = _mm_set1_ps(p.z);
+            __m128 ax = _mm_mul_ps(nx, x0), bx = _mm_mul_ps(nx, x1);
+            __m128 ay = _mm_mul_ps(ny, y0), by = _mm_mul_ps(ny, y1);
+            __m128 az = _mm_mul_ps(nz, z0), bz = _mm_mul_ps(nz, z1);
+            __m128 d = _mm_set1_ps(p.w);
+            __m128 far = _mm_add_ps(_mm_add_ps(_mm_max_ps(ax, bx), _mm_max_ps(ay, by)), _mm_add_ps(_mm_max_ps(az, bz), d));
+            __m128 near = _mm_add_ps(_mm_add_ps(_mm_min_ps(ax, bx), _mm_min_ps(ay, by)), _mm_add_ps(_mm_min_ps(az, bz), d));
+
+            outside |= _mm_movemask_ps(_mm_cmplt_ps(far, zero));
+            intersecting[j] = _mm_movemask_ps(_mm_cmplt_ps(near, zero));
+            if (outside == 0xf)
+                break;
+        }
+
+        for (int lane = 0; lane < 4; ++lane) {
+            unsigned char result = 0;
+            for (int j = 0; j < 6; ++j)
+                result |= ((intersecting[j] >> lane) & 1) << j;
+            results[i + lane] = (outside >> lane) & 1 ? FRUSTUM_OUTSIDE : result;
+        }
+    }
+#endif
+    for (; i < count; ++i)
+        results[i] = testBox(glm::vec3(minX[i], minY[i], minZ[i]), glm::vec3(maxX[i], maxY[i], maxZ[i]), planeMask);
+}
+
+const glm::vec4 &Frustum::getPlane(int i) const {
+    return planes_[i];
+}
@@ -0,0 +1,44 @@
+#include <chrono>
+#include "gljobqueue.hpp"
+
+GlJobQueue::GlJobQueue(float budgetMilliseconds) : budget_(budgetMilliseconds) {}
+
+void GlJobQueue::post(std::function<void()> job) {
+    posted_.push(std::move(job));
+}
+
+int GlJobQueue::run() {
+    takePosted();
+
+    std::chrono::steady_clock::time_point end =
+        std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                               std::chrono::duration<float, std::milli>(budget_));
+    int count = 0;
+    while (!pending_.empty()) {
+        /* The job may post more, those wait for the next frame */
+        std::function<void()> job = std::move(pending_.front());
+        pending_.pop_front();
+        job();
+        ++count;
+        if (std::chrono::steady_clock::now() >= end)
+            break;
+    }
+    return count;
+}
+
+void GlJobQueue::setBudget(float milliseconds) {
+    budget_ = milliseconds;
+}
+
+float GlJobQueue::getBudget() {
+    return budget_;
+}
+
+int GlJobQueue::getPendingCount() {
+    takePosted();
+    return pending_.size();
+}
+
+void GlJobQueue::takePosted() {
+    posted_.drain([this](std::function<void()> &job) { pending_.push_back(std::move(job)); });
+}
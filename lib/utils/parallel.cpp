@@ -0,0 +1,64 @@
+#include <atomic>
+#include <memory>
+#include <condition_variable>
+#include "parallel.hpp"
+#include "threadpool.hpp"
+
+namespace {
+struct ParallelRange {
+    std::function<void(int, int)> fn;
+    int end;
+    int grain;
+    int participants; // Workers plus the caller
+    std::atomic<int> next;
+    std::atomic<int> remaining; // Items not finished yet
+    std::mutex mutex;
+    std::condition_variable done;
+};
+
+/* Takes chunks until none is left. A chunk is 1 / (2 * participants) of the rest, so the last ones are small */
+void processRange(ParallelRange &range) {
+    int begin = range.next.load();
+    while (begin < range.end) {
+        int size = std::max(range.grain, (range.end - begin) / (2 * range.participants));
+        int chunkEnd = std::min(range.end, begin + size);
+        if (!range.next.compare_exchange_weak(begin, chunkEnd))
+            continue;
+
+        range.fn(begin, chunkEnd);
+        if (range.remaining.fetch_sub(chunkEnd - begin) == chunkEnd - begin) {
+            std::lock_guard<std::mutex> lock(range.mutex);
+            range.done.notify_all();
+        }
+        begin = range.next.load();
+    }
+}
+} // namespace
+
+void parallelFor(ThreadPool *pool, int begin, int end, int grain, const std::function<void(int, int)> &fn) {
+    grain = std::max(1, grain);
+    int threads = pool ? pool->getThreadCount() : 0;
+    if (!threads || end - begin < 2 * grain) {
+        if (begin < end)
+            fn(begin, end);
+        return;
+    }
+
+    /* Pool jobs may start after we returned, they only find no chunk left then */
+    std::shared_ptr<ParallelRange> range = std::make_shared<ParallelRange>();
+    range->fn = fn;
+    range->end = end;
+    range->grain = grain;
+    range->participants = threads + 1;
+    range->next = begin;
+    range->remaining = end - begin;
+
+    int helpers = std::min(threads, (end - begin) / grain - 1);
+    for (int i = 0; i < helpers; ++i)
+        pool->addJob([range] { processRange(*range); }, "parallelFor");
+
+    processRange(*range);
+
+    std::unique_lock<std::mutex> lock(range->mutex);
+    range->done.wait(lock, [&range] { return range->remaining == 0; });
+}
@@ -0,0 +1,156 @@
+#include <cstdio>
+#include "task.hpp"
+#include "threadpool.hpp"
+
+Task::Task() {}
+Task::Task(std::shared_ptr<State> state) : state_(std::move(state)) {}
+
+bool Task::valid() {
+    return state_ != nullptr;
+}
+
+bool Task::isDone() {
+    if (!state_)
+        return false;
+
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->done;
+}
+
+void Task::wait() {
+    if (!state_) {
+        fprintf(stdout, "[Task::wait] Error: Waiting for an invalid task\n");
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    state_->finished.wait(lock, [this] { return state_->done; });
+}
+
+Task Task::then(std::function<void()> job, const char *tag) {
+    if (!state_) {
+        fprintf(stdout, "[Task::then] Error: Continuation of an invalid task\n");
+        return Task();
+    }
+
+    std::shared_ptr<State> successor = std::make_shared<State>(state_->pool, std::move(job), 1, tag);
+    attach(state_, successor);
+    return Task(successor);
+}
+
+Task Task::whenAll(const std::vector<Task> &tasks) {
+    ThreadPool *pool = nullptr;
+    for (const Task &task : tasks) {
+        if (task.state_) {
+            pool = task.state_->pool;
+            break;
+        }
+    }
+
+    /* The extra predecessor keeps the join from finishing while we still attach it */
+    std::shared_ptr<State> join = std::make_shared<State>(pool, nullptr, tasks.size() + 1);
+    for (const Task &task : tasks) {
+        if (task.state_)
+            attach(task.state_, join);
+        else
+            release(join);
+    }
+    release(join);
+    return Task(join);
+}
+
+void Task::attach(const std::shared_ptr<State> &predecessor, const std::shared_ptr<State> &successor) {
+    {
+        std::lock_guard<std::mutex> lock(predecessor->mutex);
+        if (!predecessor->done) {
+            predecessor->successors.push_back(successor);
+            return;
+        }
+    }
+    release(successor);
+}
+
+void Task::release(const std::shared_ptr<State> &successor) {
+    if (successor->pending.fetch_sub(1) == 1)
+        start(successor);
+}
+
+/* Joins and jobs without a pool run on the calling thread */
+void Task::start(std::shared_ptr<State> state) {
+    if (state->job && state->pool)
+        state->pool->addJob([state] { run(state); }, state->tag);
+    else
+        run(std::move(state));
+}
+
+/*
+ * Runs the job, then marks it done and releases its successors. The first one that became ready continues
+ * on this thread if it is a worker of the successor's pool, which saves the round trip through the queues.
+ */
+void Task::run(std::shared_ptr<State> state) {
+    std::vector<std::shared_ptr<State>> ready;
+    while (state) {
+        if (state->job)
+            state->job();
+
+        std::vector<std::shared_ptr<State>> successors;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->done = true;
+            successors.swap(state->successors);
+        }
+        state->finished.notify_all();
+
+        for (std::shared_ptr<State> &successor : successors) {
+            if (successor->pending.fetch_sub(1) == 1)
+                ready.push_back(std::move(successor));
+        }
+
+        state = nullptr;
+        for (std::shared_ptr<State> &next : ready) {
+            if (!state && (!next->job || (next->pool && next->pool->isWorkerThread())))
+                state = std::move(next);
+            else
+                start(std::move(next));
+        }
+        ready.clear();
+    }
+}
+
+int TaskGraph::add(std::function<void()> job, const std::vector<int> &dependencies, const char *tag) {
+    for (int dependency : dependencies) {
+        if (dependency < 0 || dependency >= (int)nodes_.size()) {
+            fprintf(stdout, "[TaskGraph::add] Error: Dependency %i is not an earlier node\n", dependency);
+            return -1;
+        }
+    }
+
+    nodes_.push_back({std::move(job), dependencies, tag});
+    return nodes_.size() - 1;
+}
+
+Task TaskGraph::submit(ThreadPool *pool) {
+    /* Every node and the join wait for one extra predecessor, released once all links exist */
+    std::vector<std::shared_ptr<Task::State>> states;
+    states.reserve(nodes_.size());
+    for (Node &node : nodes_)
+        states.push_back(std::make_shared<Task::State>(pool, std::move(node.job), node.dependencies.size() + 1, node.tag));
+    std::shared_ptr<Task::State> join = std::make_shared<Task::State>(pool, nullptr, nodes_.size() + 1);
+
+    /* Nothing runs yet, the successor lists need no lock */
+    for (int i = 0; i < (int)nodes_.size(); ++i) {
+        for (int dependency : nodes_[i].dependencies)
+            states[dependency]->successors.push_back(states[i]);
+        states[i]->successors.push_back(join);
+    }
+    nodes_.clear();
+
+    for (std::shared_ptr<Task::State> &state : states)
+        Task::release(state);
+    Task::release(join);
+    return Task(join);
+}
+
+int TaskGraph::getNodeCount() {
+    return nodes_.size();
+}
@@ -95,6 +95,18 @@ unsigned int TextureLoader::createTextureFromArray(unsigned char *data, int widt
     return texId;
 }
 
+void TextureLoader::updateTextureFromArray(unsigned int texId, unsigned char *data, int width, int height, int size) {
+    GLenum format = GL_RED;
+    if (size == 3)
+        format = GL_RGB;
+    else if (size == 4)
+        format = GL_RGBA;
+
+    glBindTexture(GL_TEXTURE_2D, texId);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, data);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
 unsigned int TextureLoader::loadCubeMap(std::vector<std::string> textures) {
     unsigned char *data;
     int width, height, nrChannels;
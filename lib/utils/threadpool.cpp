@@ -0,0 +1,215 @@
+#include <algorithm>
+#include "threadpool.hpp"
+
+namespace {
+/* Rounds over the injection queue and all victims before a worker without work goes to sleep */
+const int STEAL_ROUNDS = 64;
+
+/* Pool and worker index of the calling thread, jobs added by a job go to its worker's deque */
+thread_local ThreadPool *currentPool = nullptr;
+thread_local int currentWorker = -1;
+} // namespace
+
+ThreadPool::ThreadPool(int numThreads) {
+    /* All deques exist before the first worker may steal */
+    for (int i = 0; i < numThreads; i++) {
+        workers_.emplace_back(new Worker());
+        workers_.back()->random = 0x9e3779b9u * (i + 1);
+    }
+
+    for (int i = 0; i < numThreads; i++)
+        workers_[i]->thread = new std::thread(&ThreadPool::workerFunction, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    if (!closed_)
+        closePool();
+}
+
+/*
+ * queuedJobs_ is raised before the job is visible and sleepingWorkers_ before a worker checks it,
+ * so either the worker sees the job or we see the sleeper and wake it.
+ */
+void ThreadPool::addJob(std::function<void()> job, const char *tag) {
+#ifdef THREADPOOL_METRICS
+    Job *newJob = new Job{std::move(job), tag, std::chrono::steady_clock::now()};
+    int queued = queuedJobs_.fetch_add(1) + 1;
+    int maxQueued = maxQueuedJobs_.load(std::memory_order_relaxed);
+    while (queued > maxQueued && !maxQueuedJobs_.compare_exchange_weak(maxQueued, queued, std::memory_order_relaxed))
+        ;
+#else
+    (void)tag;
+    Job *newJob = new Job{std::move(job)};
+    queuedJobs_.fetch_add(1);
+#endif
+    if (currentPool == this) {
+        workers_[currentWorker]->deque.push(newJob);
+    } else {
+        std::lock_guard<std::mutex> lock(injectionMutex_);
+        injection_.push_back(newJob);
+        injectedCount_.store(injection_.size(), std::memory_order_relaxed);
+    }
+
+    if (sleepingWorkers_.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        wakeUp_.notify_one();
+    }
+}
+
+Task ThreadPool::submit(std::function<void()> job, const char *tag) {
+    std::shared_ptr<Task::State> state = std::make_shared<Task::State>(this, std::move(job), 0, tag);
+    Task::start(state);
+    return Task(state);
+}
+
+int ThreadPool::getThreadCount() {
+    return workers_.size();
+}
+
+bool ThreadPool::isWorkerThread() {
+    return currentPool == this;
+}
+
+void ThreadPool::closePool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        shutdown_ = true;
+    }
+    wakeUp_.notify_all();
+
+    for (std::unique_ptr<Worker> &worker : workers_)
+        worker->thread->join();
+
+    for (std::unique_ptr<Worker> &worker : workers_)
+        delete worker->thread;
+
+    workers_.clear();
+    closed_ = true;
+}
+
+void ThreadPool::workerFunction(int index) {
+    currentPool = this;
+    currentWorker = index;
+    Worker &worker = *workers_[index];
+
+    while (true) {
+        Job *job = findJob(worker);
+        if (job) {
+            run(worker, job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        sleepingWorkers_.fetch_add(1);
+        wakeUp_.wait(lock, [this] { return queuedJobs_.load() > 0 || shutdown_; });
+        sleepingWorkers_.fetch_sub(1);
+        if (shutdown_ && queuedJobs_.load() == 0)
+            return;
+    }
+}
+
+/* Own deque first, then the injection queue, then the other workers. Gives up once nothing is queued anywhere */
+ThreadPool::Job *ThreadPool::findJob(Worker &worker) {
+    Job *job = worker.deque.pop();
+    for (int round = 0; !job && round < STEAL_ROUNDS && queuedJobs_.load(std::memory_order_relaxed) > 0; ++round) {
+        if (round)
+            std::this_thread::yield();
+        job = takeInjected(worker);
+        if (!job)
+            job = steal(worker);
+    }
+
+    if (job)
+        queuedJobs_.fetch_sub(1);
+    return job;
+}
+
+/* Takes a fair share of the injected jobs into the worker's deque, where the others can steal them again */
+ThreadPool::Job *ThreadPool::takeInjected(Worker &worker) {
+    if (!injectedCount_.load(std::memory_order_relaxed))
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(injectionMutex_);
+    if (injection_.empty())
+        return nullptr;
+
+#ifdef THREADPOOL_METRICS
+    worker.metrics.addInjectedTake();
+#endif
+    int count = std::max(1, (int)(injection_.size() / workers_.size()));
+    Job *job = injection_.front();
+    injection_.pop_front();
+    for (int i = 1; i < count; ++i) {
+        worker.deque.push(injection_.front());
+        injection_.pop_front();
+    }
+    injectedCount_.store(injection_.size(), std::memory_order_relaxed);
+    return job;
+}
+
+/* One attempt per other worker, starting at a random one so thieves spread out */
+ThreadPool::Job *ThreadPool::steal(Worker &worker) {
+    worker.random ^= worker.random << 13;
+    worker.random ^= worker.random >> 17;
+    worker.random ^= worker.random << 5;
+
+    int count = workers_.size();
+    int start = worker.random % count;
+    for (int i = 0; i < count; ++i) {
+        Worker &victim = *workers_[(start + i) % count];
+        if (&victim == &worker)
+            continue;
+        if (Job *job = victim.deque.steal()) {
+#ifdef THREADPOOL_METRICS
+            worker.metrics.addSteal();
+#endif
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+void ThreadPool::run(Worker &worker, Job *job) {
+#ifdef THREADPOOL_METRICS
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    job->run();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    worker.metrics.addJob(job->tag, std::chrono::duration_cast<std::chrono::nanoseconds>(start - job->added).count(),
+                          std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+#else
+    (void)worker;
+    job->run();
+#endif
+    delete job;
+}
+
+/* The workers only ever add to their counters, the difference to the last call is what happened since */
+ThreadPoolMetrics ThreadPool::getMetrics() {
+    ThreadPoolMetrics metrics;
+#ifdef THREADPOOL_METRICS
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    metrics.seconds = std::chrono::duration<double>(now - metricsTime_).count();
+    metricsTime_ = now;
+    metrics.queuedJobs = queuedJobs_.load();
+    metrics.maxQueuedJobs = std::max(metrics.queuedJobs, maxQueuedJobs_.exchange(0));
+
+    ThreadPoolMetrics totals;
+    busyTotals_.resize(workers_.size(), 0);
+    for (int i = 0; i < (int)workers_.size(); ++i) {
+        uint64_t busy;
+        workers_[i]->metrics.collect(totals, busy);
+        metrics.busy.push_back(metrics.seconds > 0.0 ? (busy - busyTotals_[i]) * 1e-9 / metrics.seconds : 0.0);
+        busyTotals_[i] = busy;
+    }
+
+    metrics.steals = totals.steals - metricsTotals_.steals;
+    metrics.injectedTakes = totals.injectedTakes - metricsTotals_.injectedTakes;
+    metrics.latency = totals.latency;
+    metrics.latency.subtract(metricsTotals_.latency);
+    metrics.runTimes = totals.runTimes;
+    for (std::pair<const std::string, MetricsHistogram> &tag : metrics.runTimes)
+        tag.second.subtract(metricsTotals_.runTimes[tag.first]);
+    metricsTotals_ = std::move(totals);
+#endif
+    return metrics;
+}
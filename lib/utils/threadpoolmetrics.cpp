@@ -0,0 +1,132 @@
+#include <cstring>
+#include "threadpoolmetrics.hpp"
+
+namespace {
+int getBucket(uint64_t nanoseconds) {
+    uint64_t microseconds = nanoseconds / 1000;
+    int bucket = 0;
+    while (microseconds && bucket < METRICS_HISTOGRAM_BUCKETS - 1) {
+        microseconds >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+/* Single writer, no read-modify-write needed */
+void increase(std::atomic<uint64_t> &counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+} // namespace
+
+void MetricsHistogram::add(const MetricsHistogram &other) {
+    for (int i = 0; i < METRICS_HISTOGRAM_BUCKETS; ++i)
+        counts[i] += other.counts[i];
+    totalNanoseconds += other.totalNanoseconds;
+}
+
+void MetricsHistogram::subtract(const MetricsHistogram &other) {
+    for (int i = 0; i < METRICS_HISTOGRAM_BUCKETS; ++i)
+        counts[i] -= other.counts[i];
+    totalNanoseconds -= other.totalNanoseconds;
+}
+
+uint64_t MetricsHistogram::getCount() const {
+    uint64_t count = 0;
+    for (int i = 0; i < METRICS_HISTOGRAM_BUCKETS; ++i)
+        count += counts[i];
+    return count;
+}
+
+double MetricsHistogram::getMeanMicroseconds() const {
+    uint64_t count = getCount();
+    return count ? totalNanoseconds * 1e-3 / count : 0.0;
+}
+
+double MetricsHistogram::getPercentileMicroseconds(float p) const {
+    uint64_t count = getCount();
+    uint64_t below = 0;
+    for (int i = 0; i < METRICS_HISTOGRAM_BUCKETS; ++i) {
+        below += counts[i];
+        if (count && below >= p * count)
+            return (double)(1ull << i);
+    }
+    return 0.0;
+}
+
+uint64_t ThreadPoolMetrics::getJobCount() const {
+    return latency.getCount();
+}
+
+void ThreadPoolMetrics::print(FILE *file) const {
+    double busySum = 0.0;
+    for (double b : busy)
+        busySum += b;
+    fprintf(file, "[ThreadPool] %llu jobs, queued %i (max %i), latency mean %.1f us p50 %.0f us p99 %.0f us, steals %llu, "
+                  "injected %llu, busy %.0f%%\n",
+            (unsigned long long)getJobCount(), queuedJobs, maxQueuedJobs, latency.getMeanMicroseconds(),
+            latency.getPercentileMicroseconds(0.5f), latency.getPercentileMicroseconds(0.99f), (unsigned long long)steals,
+            (unsigned long long)injectedTakes, busy.empty() ? 0.0 : busySum * 100.0 / busy.size());
+
+    for (const std::pair<const std::string, MetricsHistogram> &tag : runTimes) {
+        if (!tag.second.getCount())
+            continue;
+        fprintf(file, "    %s: %llu jobs, run time mean %.1f us p50 %.0f us p99 %.0f us\n", tag.first.c_str(),
+                (unsigned long long)tag.second.getCount(), tag.second.getMeanMicroseconds(), tag.second.getPercentileMicroseconds(0.5f),
+                tag.second.getPercentileMicroseconds(0.99f));
+    }
+}
+
+void WorkerMetrics::Histogram::add(uint64_t nanoseconds) {
+    increase(counts[getBucket(nanoseconds)], 1);
+    increase(totalNanoseconds, nanoseconds);
+}
+
+void WorkerMetrics::Histogram::read(MetricsHistogram &histogram) {
+    for (int i = 0; i < METRICS_HISTOGRAM_BUCKETS; ++i)
+        histogram.counts[i] += counts[i].load(std::memory_order_relaxed);
+    histogram.totalNanoseconds += totalNanoseconds.load(std::memory_order_relaxed);
+}
+
+/* Tags are usually string literals, the pointer is compared first and the text only for new pointers */
+void WorkerMetrics::addJob(const char *tag, uint64_t latencyNanoseconds, uint64_t runNanoseconds) {
+    if (!tag)
+        tag = "untagged";
+
+    int slot = 0;
+    for (; slot < METRICS_MAX_TAGS - 1; ++slot) {
+        const char *name = tags_[slot].name.load(std::memory_order_relaxed);
+        if (!name) {
+            tags_[slot].name.store(tag, std::memory_order_release);
+            break;
+        }
+        if (name == tag || !strcmp(name, tag))
+            break;
+    }
+    if (slot == METRICS_MAX_TAGS - 1 && !tags_[slot].name.load(std::memory_order_relaxed))
+        tags_[slot].name.store("other", std::memory_order_release);
+
+    latency_.add(latencyNanoseconds);
+    tags_[slot].runTimes.add(runNanoseconds);
+    increase(busyNanoseconds_, runNanoseconds);
+}
+
+void WorkerMetrics::addSteal() {
+    increase(steals_, 1);
+}
+
+void WorkerMetrics::addInjectedTake() {
+    increase(injectedTakes_, 1);
+}
+
+void WorkerMetrics::collect(ThreadPoolMetrics &metrics, uint64_t &busyNanoseconds) {
+    latency_.read(metrics.latency);
+    for (Tag &tag : tags_) {
+        const char *name = tag.name.load(std::memory_order_acquire);
+        if (!name)
+            break;
+        tag.runTimes.read(metrics.runTimes[name]);
+    }
+    busyNanoseconds = busyNanoseconds_.load(std::memory_order_relaxed);
+    metrics.steals += steals_.load(std::memory_order_relaxed);
+    metrics.injectedTakes += injectedTakes_.load(std::memory_order_relaxed);
+}
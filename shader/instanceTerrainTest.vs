@@ -1,7 +1,7 @@
 #version 410 core
 layout (location = 0) in vec3 vertexPosition;
-layout (location = 3) in mat4 aInstanceModelMat;
-layout (location = 7) in vec3 rangeScale;
+layout (location = 3) in vec3 instancePositionScale;
+layout (location = 4) in uint instanceLodFace;
 
 out vec4 fColor;
 out vec3 normal_frag_in;
@@ -24,6 +24,10 @@ uniform float upperBound;
 uniform vec3 cameraPos;
 uniform mat4 cameraMatrix;
 
+uniform float lodRanges[16];
+uniform vec3 bodyOrigin;
+uniform float bodyRadius;
+
 float getMorphFactor(float dist, float low, float high) {
     float delta = high - low;
     float factor = (dist - low) / delta;
@@ -50,6 +54,23 @@ float decodeNormalRange(float inVal) {
     return inVal * 2.0 - 1.0;
 }
 
+/*
+ * Same as the former instance model matrix: rotate the plane mesh onto the cube side, scale it to the node
+ * and move it to the node position. Faces are +x, -x, +y, -y, +z, -z. Without a body radius the terrain is a plane.
+ */
+vec3 getInstanceWorldPos(vec3 v, vec2 pos, float scale, uint face) {
+    if (bodyRadius == 0.0)
+        return vec3(pos.x, 0.0, pos.y) + scale * v;
+
+    float side = (face & 1u) == 0u ? 1.0 : -1.0;
+    uint component = face >> 1;
+    if (component == 0u)
+        return vec3(bodyOrigin.x + side * bodyRadius, pos.y, pos.x) + scale * vec3(-v.y, v.x, v.z);
+    if (component == 1u)
+        return vec3(pos.x, bodyOrigin.y + side * bodyRadius, pos.y) + scale * v;
+    return vec3(pos.x, pos.y, bodyOrigin.z + side * bodyRadius) + scale * vec3(v.x, -v.z, v.y);
+}
+
 vec2 getNormalizedGridCoord(vec2 worldPos) {
     //vec2 p = abs(worldPos - gridOrigin.xz);
     return worldPos / heightMapDimension;
@@ -59,11 +80,12 @@ void main()
 {
     float morphStart = 0.0;
     float morphEnd = 1.0;
-    float range = rangeScale.x;
-    float prevRange = rangeScale.y;
-    float scale = rangeScale.z;
+    uint lod = instanceLodFace & 0xffu;
+    float range = lodRanges[lod];
+    float prevRange = lod == 0u ? 0.0 : lodRanges[lod - 1u];
+    float scale = instancePositionScale.z;
 
-    vec4 vWorldPos = aInstanceModelMat * vec4(vertexPosition, 1.0);
+    vec4 vWorldPos = vec4(getInstanceWorldPos(vertexPosition, instancePositionScale.xy, scale, instanceLodFace >> 8), 1.0);
     
     float h = decodeHeightRange(texture(texture_height1, getNormalizedGridCoord(vWorldPos.xz)).r);
     vWorldPos.y = h;
@@ -95,6 +117,6 @@ void main()
 
     // Debug normal stuff:
     //gl_Position = cameraMatrix * vPos;
-    //mat3 normalMatrix = mat3(transpose(inverse(cameraMatrix * aInstanceModelMat)));
+    //mat3 normalMatrix = mat3(transpose(inverse(cameraMatrix)));
     //vs_out.normal = normalize(vec3(vec4(normalMatrix * normal, 1.0)));
 } 
\ No newline at end of file
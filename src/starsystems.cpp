@@ -116,8 +116,11 @@ Scene *createPlane(Engine *engine) {
     */
 
     /* Terrainmanager EndlessPlane */
-    EndlessPlane *p = new EndlessPlane(terrainGen);
+    /* Nodes refine until their error is below 2 pixels, flat areas stay coarse unless rough neighbours pull them along */
+    EndlessPlane *p = new EndlessPlane(terrainGen, DEFAULT_TERRAIN_MEMORY_BUDGET, 2.0f);
     scene->getTerrainManager()->addTerrainObject((TerrainObject *) p);
+    /* Ranges adapt so the terrain stays around 2M triangles, fewer while frames take longer than 60 FPS */
+    scene->getTerrainManager()->setTriangleBudget(2 << 20, 1.0f / 60.0f);
 
     /* Terrainmanager Planet */
     /*
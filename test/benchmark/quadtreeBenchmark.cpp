@@ -0,0 +1,172 @@
+/*
+ * Compares CDLOD selection on the flat TerrainQuadTree with the old pointer tree layout
+ * (one heap node with four child pointers, float bounds and flags per node),
+ * and the full flat selection with the incremental one for a slowly moving camera.
+ * Usage: quadtreeBenchmark [frames]
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <glm/glm.hpp>
+#include "terrainnode.hpp"
+
+namespace {
+/* Smooth synthetic terrain, the bounds only need to be plausible */
+void getBounds(glm::vec2 &pos, int dimension, float *minHeight, float *maxHeight) {
+    float center = 40.0f * std::sin(pos.x * 0.001f) * std::cos(pos.y * 0.0013f);
+    float spread = 2.0f + 0.05f * dimension;
+    *minHeight = center - spread;
+    *maxHeight = center + spread;
+}
+
+class PointerNode {
+public:
+    PointerNode(int dimension, int lod, glm::vec2 pos) : nodePos_(pos), nodeDimension_(dimension), lodLevel_(lod) {
+        getBounds(nodePos_, nodeDimension_, &nodeMinHeight_, &nodeMaxHeight_);
+        if (lod > 0) {
+            int half = dimension / 2;
+            children_[0] = new PointerNode(half, lod - 1, glm::vec2(pos.x, pos.y));
+            children_[1] = new PointerNode(half, lod - 1, glm::vec2(pos.x + half, pos.y));
+            children_[2] = new PointerNode(half, lod - 1, glm::vec2(pos.x, pos.y + half));
+            children_[3] = new PointerNode(half, lod - 1, glm::vec2(pos.x + half, pos.y + half));
+            childrenCreated_ = true;
+        }
+    }
+
+    ~PointerNode() {
+        for (PointerNode *child : children_)
+            delete child;
+    }
+
+    bool lodSelect(std::vector<float> &ranges, int lodLevel, const glm::vec3 &camera, std::vector<TerrainNodeInfo> &selected) {
+        currentLodRange_ = ranges[lodLevel];
+        BoundingBox box(glm::vec3(nodePos_.x, nodeMinHeight_, nodePos_.y),
+                        glm::vec3(nodePos_.x + nodeDimension_, nodeMaxHeight_, nodePos_.y + nodeDimension_));
+        if (!box.intersectSphereSq(camera, currentLodRange_ * currentLodRange_))
+            return false;
+
+        if (lodLevel == 0 || !box.intersectSphereSq(camera, ranges[lodLevel - 1] * ranges[lodLevel - 1])) {
+            selected.push_back(getInfo());
+        } else if (childrenCreated_) {
+            for (PointerNode *child : children_) {
+                if (!child->lodSelect(ranges, lodLevel - 1, camera, selected))
+                    selected.push_back(child->getInfo());
+            }
+        }
+        return true;
+    }
+
+private:
+    glm::vec2 nodePos_;
+    int nodeDimension_;
+    int lodLevel_;
+    float nodeMaxHeight_;
+    float nodeMinHeight_;
+    int heightMapIndex_ = 0;
+    PointerNode *children_[4] = {nullptr, nullptr, nullptr, nullptr};
+    float currentLodRange_;
+    bool childrenCreationScheduled_ = false;
+    bool childrenCreated_ = false;
+
+    TerrainNodeInfo getInfo() {
+        return {heightMapIndex_, nodePos_, nodeDimension_, lodLevel_, currentLodRange_};
+    }
+};
+
+/* Camera flying diagonally over the terrain, low enough to reach the finest level */
+glm::vec3 getCamera(int frame, int frames, int dimension) {
+    float t = (float)frame / frames;
+    return glm::vec3(t * dimension, 60.0f, (0.2f + 0.6f * t) * dimension);
+}
+
+/* Walking speed, one unit per frame */
+glm::vec3 getSlowCamera(int frame, int dimension) {
+    return glm::vec3(0.3f * dimension + frame, 60.0f, 0.4f * dimension + 0.5f * frame);
+}
+
+/* A frame touches plenty of other memory between two selections, streaming over this pushes the tree out of the caches */
+std::vector<char> evictionBuffer(64 << 20);
+
+void evictCaches() {
+    for (size_t i = 0; i < evictionBuffer.size(); i += 64)
+        evictionBuffer[i]++;
+}
+
+/* Average microseconds per selection, only the selection itself is timed */
+template <typename Select>
+double measure(int frames, bool cold, Select select) {
+    double seconds = 0.0;
+    for (int frame = 0; frame < frames; ++frame) {
+        if (cold)
+            evictCaches();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        select(frame);
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return seconds * 1e6 / frames;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    int frames = argc > 1 ? atoi(argv[1]) : 200;
+    int leafSize = 64;
+
+    fprintf(stdout, "%6s %9s %9s | %11s %10s | %17s | %17s | %17s\n", "levels", "nodes", "selected", "pointer B", "flat B",
+            "warm us ptr/flat", "cold us ptr/flat", "slow us full/incr");
+
+    for (int lodLevelCount = 7; lodLevelCount <= 11; ++lodLevelCount) {
+        int dimension = leafSize << (lodLevelCount - 1);
+        std::vector<float> ranges(lodLevelCount);
+        for (int i = 0; i < lodLevelCount; ++i)
+            ranges[i] = leafSize * 2.0f * std::pow(2.0f, i);
+
+        PointerNode *pointerTree = new PointerNode(dimension, lodLevelCount - 1, glm::vec2(0, 0));
+        TerrainQuadTree flatTree(0, glm::vec2(0, 0), dimension, lodLevelCount, getBounds);
+        int nodeCount = flatTree.getNodeCount();
+
+        std::vector<TerrainNodeInfo> pointerSelection;
+        std::vector<TerrainNodeInfo> creationList;
+        IndexedTerrainNodeListMap flatSelection;
+        std::vector<TerrainNodeInfo> &flatSelected = flatSelection[0];
+
+        auto selectPointer = [&](int frame) {
+            pointerSelection.clear();
+            pointerTree->lodSelect(ranges, lodLevelCount - 1, getCamera(frame, frames, dimension), pointerSelection);
+        };
+        auto selectFlat = [&](int frame) {
+            flatSelected.clear();
+            flatTree.lodSelect(ranges, getCamera(frame, frames, dimension), nullptr, flatSelection, creationList);
+        };
+
+        double pointerWarm = measure(frames, false, selectPointer);
+        double flatWarm = measure(frames, false, selectFlat);
+        double pointerCold = measure(frames, true, selectPointer);
+        double flatCold = measure(frames, true, selectFlat);
+        size_t flatCount = flatSelected.size();
+
+        auto selectSlowFull = [&](int frame) {
+            flatSelected.clear();
+            flatTree.lodSelect(ranges, getSlowCamera(frame, dimension), nullptr, flatSelection, creationList);
+        };
+        auto selectSlowIncremental = [&](int frame) {
+            int first, end;
+            flatTree.updateSelection(ranges, getSlowCamera(frame, dimension), nullptr, creationList, &first, &end);
+        };
+        double slowFull = measure(frames, false, selectSlowFull);
+        double slowIncremental = measure(frames, false, selectSlowIncremental);
+
+        /* Heap nodes plus the allocator header, against 4 bytes per node and one bit per leaf.
+         * The 16 bit bounds are rounded outwards, so the flat tree may refine a few more nodes. */
+        size_t pointerBytes = (sizeof(PointerNode) + 16) * nodeCount;
+        size_t flatBytes = 4 * nodeCount + (size_t)(1 << (lodLevelCount - 1)) * (1 << (lodLevelCount - 1)) / 8;
+        fprintf(stdout, "%6i %9i %4zu/%-4zu | %11zu %10zu | %8.2f %8.2f | %8.2f %8.2f | %8.2f %8.2f\n", lodLevelCount, nodeCount,
+                pointerSelection.size(), flatCount, pointerBytes, flatBytes, pointerWarm, flatWarm, pointerCold, flatCold,
+                slowFull, slowIncremental);
+
+        delete pointerTree;
+    }
+
+    return 0;
+}
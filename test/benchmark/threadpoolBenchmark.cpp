@@ -0,0 +1,142 @@
+/*
+ * Compares the work stealing ThreadPool with the former pool, one std::queue behind a single mutex
+ * and condition variable. Both run many tiny jobs, added from the main thread like the frame jobs,
+ * and added by the jobs themselves like nested terrain work.
+ * Usage: threadpoolBenchmark [threads] [jobs]
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <queue>
+#include "threadpool.hpp"
+
+namespace {
+/* The pool before work stealing, kept as the baseline */
+class MutexThreadPool {
+public:
+    MutexThreadPool(int numThreads) {
+        for (int i = 0; i < numThreads; i++)
+            pool_.push_back(new std::thread(&MutexThreadPool::workerFunction, this));
+    }
+
+    ~MutexThreadPool() {
+        {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+            shutdown_ = true;
+        }
+        cond_.notify_all();
+        for (std::thread *t : pool_) {
+            t->join();
+            delete t;
+        }
+    }
+
+    void workerFunction() {
+        std::function<void()> job;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(queueMutex_);
+                cond_.wait(lock, [this] { return !queue_.empty() || shutdown_; });
+                if (shutdown_ && queue_.empty())
+                    return;
+
+                job = queue_.front();
+                queue_.pop();
+            }
+            job();
+        }
+    }
+
+    void addJob(std::function<void()> job) {
+        {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+            queue_.push(job);
+        }
+        cond_.notify_one();
+    }
+
+private:
+    std::vector<std::thread *> pool_;
+    std::mutex queueMutex_;
+    std::condition_variable cond_;
+    bool shutdown_ = false;
+    std::queue<std::function<void()>> queue_;
+};
+
+/* A few hundred nanoseconds of work, small enough that the queue dominates */
+void work(std::atomic<int> &done) {
+    volatile float x = 1.0f;
+    for (int i = 0; i < 64; ++i)
+        x = x * 1.0001f + 0.5f;
+    done.fetch_add(1, std::memory_order_relaxed);
+}
+
+void waitFor(std::atomic<int> &done, int count) {
+    while (done.load() < count)
+        std::this_thread::yield();
+}
+
+/* Jobs per second, all added by the main thread */
+template <typename Pool>
+double measureExternal(Pool &pool, int jobs) {
+    std::atomic<int> done{0};
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < jobs; ++i)
+        pool.addJob([&done] { work(done); });
+    waitFor(done, jobs);
+    return jobs / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* Jobs per second, a few root jobs that add the rest as a tree with fan out 8 */
+template <typename Pool>
+double measureNested(Pool &pool, int jobs) {
+    std::atomic<int> done{0};
+    std::function<void(int)> spawn = [&](int count) {
+        work(done);
+        int rest = count - 1;
+        for (int i = 0; i < 8 && rest > 0; ++i) {
+            int share = (rest + 7 - i) / (8 - i);
+            rest -= share;
+            pool.addJob([&spawn, share] { spawn(share); });
+        }
+    };
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int roots = 4;
+    for (int i = 0; i < roots; ++i) {
+        int share = jobs / roots + (i < jobs % roots);
+        pool.addJob([&spawn, share] { spawn(share); });
+    }
+    waitFor(done, jobs);
+    return jobs / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    int maxThreads = std::max(1, argc > 1 ? atoi(argv[1]) : (int)std::thread::hardware_concurrency());
+    int jobs = argc > 2 ? atoi(argv[2]) : 500000;
+
+    fprintf(stdout, "%7s | %23s | %23s\n", "threads", "external Mjobs/s mtx/ws", "nested Mjobs/s mtx/ws");
+    for (int threads = 1;; threads = std::min(threads * 2, maxThreads)) {
+        double mutexExternal, mutexNested, stealingExternal, stealingNested;
+        {
+            MutexThreadPool pool(threads);
+            mutexExternal = measureExternal(pool, jobs);
+            mutexNested = measureNested(pool, jobs);
+        }
+        {
+            ThreadPool pool(threads);
+            stealingExternal = measureExternal(pool, jobs);
+            stealingNested = measureNested(pool, jobs);
+        }
+        fprintf(stdout, "%7i | %10.2f %10.2f | %10.2f %10.2f\n", threads, mutexExternal * 1e-6, stealingExternal * 1e-6,
+                mutexNested * 1e-6, stealingNested * 1e-6);
+        if (threads == maxThreads)
+            break;
+    }
+
+    return 0;
+}
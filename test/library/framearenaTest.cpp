@@ -0,0 +1,112 @@
+#include "gtest/gtest.h"
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "framearena.hpp"
+#include "slotarray.hpp"
+#include "terrainnode.hpp"
+
+/* Counts the heap allocations of the current thread while enabled, for the whole test binary */
+static thread_local bool countAllocations = false;
+static thread_local int allocationCount = 0;
+
+void *operator new(size_t size) {
+    if (countAllocations)
+        ++allocationCount;
+    void *p = std::malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+static void getFlatBounds(glm::vec2 &pos, int dimension, float *minHeight, float *maxHeight) {
+    *minHeight = -1.0f;
+    *maxHeight = 1.0f;
+}
+
+/* A frame that outgrew the arena fits into one block after the reset, the same frame again needs no heap */
+TEST(FrameArenaTest, testReusedAfterReset) {
+    FrameArena arena(64);
+    for (int frame = 0; frame < 3; ++frame) {
+        arena.reset();
+        allocationCount = 0;
+        countAllocations = true;
+        for (int i = 1; i < 50; ++i) {
+            double *values = arena.allocate<double>(i);
+            EXPECT_EQ((uintptr_t)values % alignof(double), 0u);
+            values[i - 1] = i;
+            char *c = arena.allocate<char>(1);
+            *c = 1;
+        }
+        glm::vec4 *v = arena.create<glm::vec4>(1.0f, 2.0f, 3.0f, 4.0f);
+        countAllocations = false;
+
+        EXPECT_EQ(v->w, 4.0f);
+        EXPECT_GE(arena.getCapacity(), arena.getUsed());
+        if (frame > 0)
+            EXPECT_EQ(allocationCount, 0);
+    }
+}
+
+/*
+ * The per frame work of CdlodTree::update on its own: incremental selection of a few root trees along a looping
+ * camera path, instance data in slot arrays and job arguments in the frame arena. Once a lap warmed everything up,
+ * the next lap must not allocate.
+ */
+TEST(FrameArenaTest, testSteadyStateSelectionDoesNotAllocate) {
+    std::vector<float> ranges = {16, 32, 64, 128, 256, 2048};
+    std::vector<TerrainQuadTree *> trees;
+    for (int i = 0; i < 4; ++i)
+        trees.push_back(new TerrainQuadTree(i, glm::vec2(i % 2, i / 2) * 512.0f, 512, 6, getFlatBounds));
+
+    FrameArena arena;
+    SlotArray<std::vector<glm::vec3>> instanceData;
+    std::vector<TerrainNodeInfo> creationList;
+    Frustum frustum;
+    struct Job {
+        int tree;
+        glm::vec3 cameraPosition;
+    };
+
+    const int frames = 120;
+    for (int lap = 0; lap < 2; ++lap) {
+        allocationCount = 0;
+        countAllocations = lap == 1;
+        for (int frame = 0; frame < frames; ++frame) {
+            float angle = frame * glm::radians(360.0f) / frames;
+            glm::vec3 camera = glm::vec3(512.0f, 30.0f, 512.0f) + glm::vec3(std::cos(angle), 0.0f, std::sin(angle)) * 300.0f;
+            frustum.extractPlanes(glm::perspective(glm::radians(60.0f), 1.0f, 1.0f, 4000.0f) *
+                                  glm::lookAt(camera, camera + glm::vec3(-std::sin(angle), -0.2f, std::cos(angle)), glm::vec3(0, 1, 0)));
+
+            arena.reset();
+            for (int i = 0; i < (int)trees.size(); ++i) {
+                Job *job = arena.create<Job>(Job{i, camera});
+                int first, end;
+                creationList.clear();
+                if (!trees[job->tree]->updateSelection(ranges, job->cameraPosition, &frustum, creationList, &first, &end))
+                    continue;
+
+                std::vector<glm::vec3> &instances = instanceData[trees[i]->getHeightMapIndex()];
+                instances.resize(trees[i]->getSelection().size());
+                for (int n = first; n < end; ++n)
+                    instances[n] = glm::vec3(trees[i]->getSelection()[n].range, 0.0f, 1.0f);
+            }
+        }
+        countAllocations = false;
+    }
+
+    EXPECT_EQ(allocationCount, 0);
+    for (TerrainQuadTree *tree : trees)
+        delete tree;
+}
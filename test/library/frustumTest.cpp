@@ -0,0 +1,58 @@
+#include "gtest/gtest.h"
+#include <cstdlib>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "frustum.hpp"
+
+static Frustum createFrustum() {
+    Frustum frustum;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1.5f, 1.0f, 1000.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0, 10, 0), glm::vec3(0, 10, -1), glm::vec3(0, 1, 0));
+    frustum.extractPlanes(projection * view);
+    return frustum;
+}
+
+TEST(FrustumTest, testExtractedPlanes) {
+    Frustum frustum = createFrustum();
+
+    /* Near plane looks down -z from z = -1 */
+    glm::vec4 near = frustum.getPlane(4);
+    EXPECT_NEAR(near.z, -1.0f, 1e-4f);
+    EXPECT_NEAR(glm::dot(glm::vec3(near), glm::vec3(0, 10, -1)) + near.w, 0.0f, 1e-3f);
+
+    EXPECT_EQ(frustum.testBox(glm::vec3(-1, 9, -51), glm::vec3(1, 11, -49)), 0);
+    EXPECT_EQ(frustum.testBox(glm::vec3(-1, 9, 49), glm::vec3(1, 11, 51)), FRUSTUM_OUTSIDE);
+    EXPECT_EQ(frustum.testBox(glm::vec3(-1, 9, -1100), glm::vec3(1, 11, -1050)), FRUSTUM_OUTSIDE);
+    EXPECT_EQ(frustum.testBox(glm::vec3(500, 9, -51), glm::vec3(501, 11, -49)), FRUSTUM_OUTSIDE);
+
+    /* Straddles the far plane only */
+    EXPECT_EQ(frustum.testBox(glm::vec3(-1, 9, -1010), glm::vec3(1, 11, -990)), 1 << 5);
+
+    /* Coherency remembers the culling plane */
+    int plane = 0;
+    EXPECT_EQ(frustum.testBox(glm::vec3(500, 9, -51), glm::vec3(501, 11, -49), FRUSTUM_ALL_PLANES, &plane), FRUSTUM_OUTSIDE);
+    EXPECT_EQ(plane, 1);
+}
+
+TEST(FrustumTest, testBatchEqualsSingleBoxes) {
+    Frustum frustum = createFrustum();
+    const int n = 103;
+    float minX[n], minY[n], minZ[n], maxX[n], maxY[n], maxZ[n];
+    unsigned char results[n];
+
+    srand(3);
+    for (int i = 0; i < n; ++i) {
+        minX[i] = rand() % 1200 - 600.0f;
+        minY[i] = rand() % 1200 - 600.0f;
+        minZ[i] = rand() % 1200 - 1100.0f;
+        maxX[i] = minX[i] + rand() % 300;
+        maxY[i] = minY[i] + rand() % 300;
+        maxZ[i] = minZ[i] + rand() % 300;
+    }
+
+    for (unsigned char mask : {FRUSTUM_ALL_PLANES, (unsigned char)0x15, (unsigned char)0}) {
+        frustum.testBoxes(minX, minY, minZ, maxX, maxY, maxZ, n, mask, results);
+        for (int i = 0; i < n; ++i)
+            EXPECT_EQ(results[i], frustum.testBox(glm::vec3(minX[i], minY[i], minZ[i]), glm::vec3(maxX[i], maxY[i], maxZ[i]), mask));
+    }
+}
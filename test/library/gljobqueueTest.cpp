@@ -0,0 +1,33 @@
+#include "gtest/gtest.h"
+#include <thread>
+#include <vector>
+#include "gljobqueue.hpp"
+
+/* Jobs from several threads run in post order per thread, a spent budget leaves the rest for the next run */
+TEST(GlJobQueueTest, testBudgetSpillsToNextRun) {
+    GlJobQueue queue(0.0f);
+    std::vector<int> order[2];
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 2; ++t) {
+        threads.emplace_back([&queue, &order, t] {
+            for (int i = 0; i < 50; ++i)
+                queue.post([&order, t, i] { order[t].push_back(i); });
+        });
+    }
+    for (std::thread &t : threads)
+        t.join();
+
+    EXPECT_EQ(queue.getPendingCount(), 100);
+    EXPECT_EQ(queue.run(), 1);
+    EXPECT_EQ(queue.getPendingCount(), 99);
+
+    queue.setBudget(1000.0f);
+    queue.post([&queue] { queue.post([] {}); });
+    EXPECT_EQ(queue.run(), 100);
+    EXPECT_EQ(queue.getPendingCount(), 1);
+    for (int t = 0; t < 2; ++t) {
+        ASSERT_EQ(order[t].size(), 50u);
+        for (int i = 0; i < 50; ++i)
+            EXPECT_EQ(order[t][i], i);
+    }
+}
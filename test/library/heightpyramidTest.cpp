@@ -0,0 +1,107 @@
+#include "gtest/gtest.h"
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+#include <glm/gtc/constants.hpp>
+#include "heightpyramid.hpp"
+
+/* Non power of two, so the clamped blocks at the border are covered as well */
+TEST(HeightPyramidTest, testMinMaxEqualsFullScan) {
+    int dim = 37;
+    std::vector<unsigned char> heights(dim * dim);
+    srand(7);
+    for (unsigned char &h : heights)
+        h = rand() % 256;
+
+    HeightPyramid pyramid;
+    pyramid.build(heights.data(), dim, -100.0f, 155.0f);
+    EXPECT_EQ(pyramid.getDimension(), dim);
+
+    for (int i = 0; i < 500; ++i) {
+        int x0 = rand() % dim;
+        int y0 = rand() % dim;
+        int x1 = x0 + 1 + rand() % (dim - x0);
+        int y1 = y0 + 1 + rand() % (dim - y0);
+
+        /* Cells include their far border samples */
+        int min = 255, max = 0;
+        for (int y = y0; y <= std::min(y1, dim - 1); ++y) {
+            for (int x = x0; x <= std::min(x1, dim - 1); ++x) {
+                min = std::min(min, (int)heights[y * dim + x]);
+                max = std::max(max, (int)heights[y * dim + x]);
+            }
+        }
+
+        float minHeight, maxHeight;
+        pyramid.getMinMax(x0, y0, x1, y1, &minHeight, &maxHeight);
+        EXPECT_LE(minHeight, -100.0f + min + 1e-3f);
+        EXPECT_GE(maxHeight, -100.0f + max - 1e-3f);
+
+        /* Aligned blocks are exact */
+        if (x1 - x0 == 1 && y1 - y0 == 1) {
+            EXPECT_NEAR(minHeight, -100.0f + min, 1e-3f);
+            EXPECT_NEAR(maxHeight, -100.0f + max, 1e-3f);
+        }
+    }
+}
+
+TEST(HeightPyramidTest, testAlignedNodesAreExact) {
+    int dim = 64;
+    std::vector<unsigned char> heights(dim * dim);
+    for (int i = 0; i < dim * dim; ++i)
+        heights[i] = (i * 31 + i / dim * 17) % 256;
+
+    HeightPyramid pyramid;
+    pyramid.build(heights.data(), dim, 0.0f, 255.0f);
+
+    for (int size = 1; size <= dim; size *= 2) {
+        for (int y0 = 0; y0 < dim; y0 += size) {
+            for (int x0 = 0; x0 < dim; x0 += size) {
+                int min = 255, max = 0;
+                for (int y = y0; y <= std::min(y0 + size, dim - 1); ++y) {
+                    for (int x = x0; x <= std::min(x0 + size, dim - 1); ++x) {
+                        min = std::min(min, (int)heights[y * dim + x]);
+                        max = std::max(max, (int)heights[y * dim + x]);
+                    }
+                }
+
+                float minHeight, maxHeight;
+                pyramid.getMinMax(x0, y0, x0 + size, y0 + size, &minHeight, &maxHeight);
+                EXPECT_NEAR(minHeight, min, 1e-3f);
+                EXPECT_NEAR(maxHeight, max, 1e-3f);
+            }
+        }
+    }
+}
+
+/* Tilt queries never report less than the steepest sample in the area */
+TEST(HeightPyramidTest, testMaxTiltCoversArea) {
+    int dim = 37;
+    std::vector<unsigned char> heights(dim * dim, 0);
+    std::vector<unsigned char> tilts(dim * dim);
+    srand(11);
+    for (unsigned char &t : tilts)
+        t = rand() % 256;
+
+    HeightPyramid pyramid;
+    EXPECT_FLOAT_EQ(pyramid.getMaxTilt(0, 0, 1, 1), glm::half_pi<float>());
+    pyramid.build(heights.data(), dim, 0.0f, 1.0f, tilts.data());
+
+    for (int i = 0; i < 500; ++i) {
+        int x0 = rand() % dim;
+        int y0 = rand() % dim;
+        int x1 = x0 + 1 + rand() % (dim - x0);
+        int y1 = y0 + 1 + rand() % (dim - y0);
+
+        int max = 0;
+        for (int y = y0; y <= std::min(y1, dim - 1); ++y) {
+            for (int x = x0; x <= std::min(x1, dim - 1); ++x)
+                max = std::max(max, (int)tilts[y * dim + x]);
+        }
+
+        float tilt = pyramid.getMaxTilt(x0, y0, x1, y1);
+        EXPECT_GE(tilt, max * glm::half_pi<float>() / 255.0f - 1e-5f);
+        if (x1 - x0 == 1 && y1 - y0 == 1)
+            EXPECT_NEAR(tilt, max * glm::half_pi<float>() / 255.0f, 1e-5f);
+    }
+}
@@ -0,0 +1,39 @@
+#include "gtest/gtest.h"
+#include <thread>
+#include <vector>
+#include "mpscqueue.hpp"
+
+/* Every value arrives exactly once, and in push order per producer */
+TEST(MpscQueueTest, testConcurrentProducers) {
+    const int producerCount = 4;
+    const int valuesPerProducer = 10000;
+    MpscQueue<int> queue;
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < producerCount; ++p) {
+        producers.emplace_back([&queue, p] {
+            for (int i = 0; i < valuesPerProducer; ++i)
+                queue.push(p * valuesPerProducer + i);
+        });
+    }
+
+    std::vector<int> last(producerCount, -1);
+    int received = 0;
+    auto consume = [&](int &value) {
+        int producer = value / valuesPerProducer;
+        EXPECT_GT(value % valuesPerProducer, last[producer]);
+        last[producer] = value % valuesPerProducer;
+        ++received;
+    };
+
+    while (received < producerCount * valuesPerProducer)
+        queue.drain(consume);
+
+    for (std::thread &t : producers)
+        t.join();
+
+    EXPECT_TRUE(queue.empty());
+    EXPECT_EQ(queue.drain(consume), 0);
+    for (int l : last)
+        EXPECT_EQ(l, valuesPerProducer - 1);
+}
@@ -0,0 +1,123 @@
+#include "gtest/gtest.h"
+#include <cmath>
+#include <vector>
+#include "perlinnoise.hpp"
+
+TEST(PerlinNoiseTest, testBatch2dEqualsScalar) {
+    PerlinNoise noise(6, 15.0f, 0.3f, 3);
+    int count = 77; // Not a multiple of the simd width
+    std::vector<float> row(count);
+
+    for (int y = -20; y < 20; y += 3) {
+        noise.getNoise2dRow(-40, y, count, row.data());
+        for (int x = 0; x < count; ++x)
+            EXPECT_EQ(row[x], noise.getNoise2d(-40 + x, y));
+    }
+}
+
+TEST(PerlinNoiseTest, testBatch3dEqualsScalar) {
+    PerlinNoise noise(6, 15.0f, 0.3f, 3, 42);
+    std::vector<float> xs, ys, zs;
+    for (int i = -150; i < 150; ++i) {
+        xs.push_back(i);
+        ys.push_back(i * 7 % 64);
+        zs.push_back(-i * 3);
+    }
+    std::vector<float> out(xs.size());
+
+    noise.getNoise3dBatch(xs.data(), ys.data(), zs.data(), xs.size(), out.data());
+    for (int i = 0; i < xs.size(); ++i)
+        EXPECT_EQ(out[i], noise.getNoise3d(xs[i], ys[i], zs[i]));
+}
+
+TEST(PerlinNoiseTest, testBatchDerivEqualsScalar) {
+    PerlinNoise noise(6, 15.0f, 0.3f, 3, 42);
+    int count = 77;
+    std::vector<float> row(count), dx(count), dy(count);
+
+    for (int y = -20; y < 20; y += 3) {
+        noise.getNoise2dRow(-40, y, count, row.data(), dx.data(), dy.data());
+        for (int x = 0; x < count; ++x) {
+            float sdx, sdy;
+            EXPECT_EQ(row[x], noise.getNoise2dDeriv(-40 + x, y, &sdx, &sdy));
+            EXPECT_FLOAT_EQ(dx[x], sdx);
+            EXPECT_FLOAT_EQ(dy[x], sdy);
+        }
+    }
+
+    std::vector<float> xs, ys, zs;
+    for (int i = -150; i < 150; ++i) {
+        xs.push_back(i);
+        ys.push_back(i * 7 % 64);
+        zs.push_back(-i * 3);
+    }
+    int n = xs.size();
+    std::vector<float> out(n), gx(n), gy(n), gz(n);
+
+    noise.getNoise3dBatch(xs.data(), ys.data(), zs.data(), n, out.data(), gx.data(), gy.data(), gz.data());
+    for (int i = 0; i < n; ++i) {
+        float sdx, sdy, sdz;
+        EXPECT_EQ(out[i], noise.getNoise3dDeriv(xs[i], ys[i], zs[i], &sdx, &sdy, &sdz));
+        EXPECT_FLOAT_EQ(gx[i], sdx);
+        EXPECT_FLOAT_EQ(gy[i], sdy);
+        EXPECT_FLOAT_EQ(gz[i], sdz);
+    }
+}
+
+/* Compares the analytic gradient with central differences at non integer positions */
+TEST(PerlinNoiseTest, testDerivMatchesFiniteDifference) {
+    PerlinNoise noise(6, 15.0f, 0.3f, 3);
+    const float h = 0.01f;
+    const int n = 64;
+    std::vector<float> xs(n), ys(n), zs(n), out(n), dx(n), dy(n), dz(n);
+    for (int i = 0; i < n; ++i) {
+        xs[i] = -30.3f + i * 1.37f;
+        ys[i] = 12.6f - i * 0.71f;
+        zs[i] = 5.2f + i * 0.43f;
+    }
+
+    noise.getNoise2dBatch(xs.data(), ys.data(), n, out.data(), dx.data(), dy.data());
+    for (int i = 0; i < n; ++i) {
+        float p[2], m[2];
+        float px[2] = {xs[i] + h, xs[i]}, py[2] = {ys[i], ys[i] + h};
+        float mx[2] = {xs[i] - h, xs[i]}, my[2] = {ys[i], ys[i] - h};
+        noise.getNoise2dBatch(px, py, 2, p);
+        noise.getNoise2dBatch(mx, my, 2, m);
+        EXPECT_NEAR(dx[i], (p[0] - m[0]) / (2 * h), 0.05f);
+        EXPECT_NEAR(dy[i], (p[1] - m[1]) / (2 * h), 0.05f);
+    }
+
+    noise.getNoise3dBatch(xs.data(), ys.data(), zs.data(), n, out.data(), dx.data(), dy.data(), dz.data());
+    for (int i = 0; i < n; ++i) {
+        float p[3], m[3];
+        float px[3] = {xs[i] + h, xs[i], xs[i]}, py[3] = {ys[i], ys[i] + h, ys[i]}, pz[3] = {zs[i], zs[i], zs[i] + h};
+        float mx[3] = {xs[i] - h, xs[i], xs[i]}, my[3] = {ys[i], ys[i] - h, ys[i]}, mz[3] = {zs[i], zs[i], zs[i] - h};
+        noise.getNoise3dBatch(px, py, pz, 3, p);
+        noise.getNoise3dBatch(mx, my, mz, 3, m);
+        EXPECT_NEAR(dx[i], (p[0] - m[0]) / (2 * h), 0.05f);
+        EXPECT_NEAR(dy[i], (p[1] - m[1]) / (2 * h), 0.05f);
+        EXPECT_NEAR(dz[i], (p[2] - m[2]) / (2 * h), 0.05f);
+    }
+}
+
+TEST(PerlinNoiseTest, testSkippedOctavesStayInsideResidual) {
+    PerlinNoise noise(6, 15.0f, 0.3f, 3);
+    EXPECT_EQ(noise.getOctavesForSpacing(1), 6);
+    EXPECT_EQ(noise.getOctavesForSpacing(2), 5);
+    EXPECT_EQ(noise.getOctavesForSpacing(8), 3);
+    EXPECT_EQ(noise.getOctavesForSpacing(64), 0);
+    EXPECT_FLOAT_EQ(noise.getResidualAmplitude(6), 0.0f);
+
+    int count = 200;
+    std::vector<float> full(count), lod(count);
+    for (int spacing = 2; spacing <= 32; spacing *= 2) {
+        int octaves = noise.getOctavesForSpacing(spacing);
+        float residual = noise.getResidualAmplitude(octaves);
+        for (int y = -40; y < 40; y += 7) {
+            noise.getNoise2dRow(-100, y, count, full.data());
+            noise.getNoise2dRow(-100, y, count, lod.data(), nullptr, nullptr, octaves);
+            for (int x = 0; x < count; ++x)
+                EXPECT_LE(std::abs(full[x] - lod[x]), residual);
+        }
+    }
+}
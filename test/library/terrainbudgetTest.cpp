@@ -0,0 +1,72 @@
+#include "gtest/gtest.h"
+#include <vector>
+#include "terrainbudget.hpp"
+
+/*
+ * Triangles grow with the square of the ranges. The controller settles within the budget
+ * and then holds its scale, noise around the count must not make it step back and forth.
+ */
+TEST(TerrainBudgetTest, testRangeScaleSettlesWithinBudget) {
+    LodRangeController controller;
+    controller.setBudget(100000);
+    const float trianglesAtScaleOne = 300000.0f;
+
+    int changes = 0;
+    int lastChange = 0;
+    for (int frame = 0; frame < 600; ++frame) {
+        float scale = controller.getRangeScale();
+        int noise = (frame % 7) * 1000;
+        if (controller.update((int)(trianglesAtScaleOne * scale * scale) + noise)) {
+            ++changes;
+            lastChange = frame;
+        }
+    }
+
+    float scale = controller.getRangeScale();
+    EXPECT_LT(trianglesAtScaleOne * scale * scale, 100000.0f);
+    EXPECT_GT(trianglesAtScaleOne * scale * scale, 100000.0f * 0.5f);
+    EXPECT_LE(changes, 3);
+    EXPECT_LT(lastChange, 100);
+
+    /* Off again, the ranges go back to the ones of the implementation */
+    controller.setBudget(0);
+    EXPECT_EQ(controller.getRangeScale(), 1.0f);
+}
+
+/* The view distance stays, scaled ranges remain strictly increasing */
+TEST(TerrainBudgetTest, testScaledRanges) {
+    LodRangeController controller;
+    controller.setBudget(1000);
+    std::vector<float> base = {8.0f, 16.0f, 32.0f, 1200.0f};
+    std::vector<float> ranges;
+    for (int frame = 0; frame < 200; ++frame)
+        controller.update(10);
+
+    ASSERT_GT(controller.getRangeScale(), 1.0f);
+    controller.scaleRanges(base, ranges);
+    ASSERT_EQ(ranges.size(), base.size());
+    EXPECT_EQ(ranges.back(), 1200.0f);
+    for (int i = 0; i + 1 < (int)ranges.size(); ++i) {
+        EXPECT_GT(ranges[i], base[i]);
+        EXPECT_LE(ranges[i], ranges[i + 1] * 0.5f);
+    }
+}
+
+/* Shares follow the screen sizes, slow frames shrink the total */
+TEST(TerrainBudgetTest, testSplitAndFrameTime) {
+    std::vector<int> budgets;
+    TerrainBudget::split(1000, {1.0f, 0.25f, 0.0f}, budgets);
+    EXPECT_EQ(budgets, std::vector<int>({800, 200, 0}));
+
+    TerrainBudget budget;
+    budget.setBudget(1000, 1.0f / 60.0f);
+    int triangles = 0;
+    for (int frame = 0; frame < 30; ++frame)
+        triangles = budget.update(1.0f / 30.0f);
+    EXPECT_LT(triangles, 1000);
+
+    int slow = triangles;
+    for (int frame = 0; frame < 600; ++frame)
+        triangles = budget.update(1.0f / 120.0f);
+    EXPECT_GT(triangles, slow);
+}
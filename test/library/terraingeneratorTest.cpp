@@ -0,0 +1,91 @@
+#include "gtest/gtest.h"
+#include <cstdlib>
+#include <vector>
+#include "terraingenerator.hpp"
+#include "global.hpp"
+
+/* Generates the lower right quarter of the parent heightmap, once refined and once from scratch */
+static void expectRefinementMatchesFullGeneration(TerrainGenerator &generator, glm::vec3 axis, glm::vec2 pos, int spacing) {
+    int dim = 64;
+    std::vector<unsigned char> heights(dim * dim), normals(dim * dim * 3);
+    std::vector<unsigned char> fullHeights(dim * dim), fullNormals(dim * dim * 3);
+    LowFrequencyField parentField, childField;
+
+    GenerationAttributes parent;
+    parent.position = pos;
+    parent.axis = axis;
+    parent.dimension = dim;
+    parent.sampleSpacing = spacing;
+    parent.heightData = &heights;
+    parent.normalData = &normals;
+    parent.lowFrequencyData = &parentField;
+    generator.generateTerrainHeightMap(&parent);
+    ASSERT_GT(parentField.octaves, 0);
+
+    GenerationAttributes full = parent;
+    full.position = pos + glm::vec2(dim * spacing / 2);
+    full.sampleSpacing = spacing / 2;
+    full.heightData = &fullHeights;
+    full.normalData = &fullNormals;
+    full.lowFrequencyData = nullptr;
+    generator.generateTerrainHeightMap(&full);
+
+    GenerationAttributes refined = full;
+    refined.heightData = &heights;
+    refined.normalData = &normals;
+    refined.lowFrequencyData = &childField;
+    refined.parentLowFrequencyData = &parentField;
+    generator.generateTerrainHeightMap(&refined);
+    EXPECT_GE(childField.octaves, parentField.octaves);
+
+    for (int i = 0; i < dim * dim; ++i)
+        EXPECT_LE(std::abs(heights[i] - fullHeights[i]), 1);
+    for (int i = 0; i < dim * dim * 3; ++i)
+        EXPECT_LE(std::abs(normals[i] - fullNormals[i]), 8);
+}
+
+TEST(TerrainGeneratorTest, testRefinedPlaneHeightMap) {
+    TerrainGenerator generator(PerlinNoise(12, 400.0f, 0.5f, 3));
+    expectRefinementMatchesFullGeneration(generator, glm::vec3(0, 1, 0), glm::vec2(-256, 128), 8);
+}
+
+TEST(TerrainGeneratorTest, testRefinedSphereHeightMap) {
+    TerrainGenerator generator(PerlinNoise(12, 400.0f, 0.5f, 3));
+    generator.setSphereRadius(4096);
+    expectRefinementMatchesFullGeneration(generator, glm::vec3(1, 0, 0), glm::vec2(-4096, -4096), 64);
+}
+
+TEST(TerrainGeneratorTest, testRowBandsMatchSerialGeneration) {
+    TerrainGenerator generator(PerlinNoise(12, 400.0f, 0.5f, 3));
+    int dim = 128;
+    std::vector<unsigned char> heights(dim * dim), normals(dim * dim * 3);
+    std::vector<unsigned char> serialHeights(dim * dim), serialNormals(dim * dim * 3);
+    LowFrequencyField field, serialField;
+
+    GenerationAttributes attr;
+    attr.position = glm::vec2(-512, 256);
+    attr.axis = glm::vec3(0, 1, 0);
+    attr.dimension = dim;
+    attr.sampleSpacing = 4;
+    attr.heightData = &serialHeights;
+    attr.normalData = &serialNormals;
+    attr.lowFrequencyData = &serialField;
+
+    ThreadPool *previousPool = g_threadPool;
+    g_threadPool = nullptr;
+    generator.generateTerrainHeightMap(&attr);
+
+    g_threadPool = new ThreadPool(3);
+    attr.heightData = &heights;
+    attr.normalData = &normals;
+    attr.lowFrequencyData = &field;
+    generator.generateTerrainHeightMap(&attr);
+    delete g_threadPool;
+    g_threadPool = previousPool;
+
+    EXPECT_EQ(heights, serialHeights);
+    EXPECT_EQ(normals, serialNormals);
+    ASSERT_EQ(field.samples.size(), serialField.samples.size());
+    for (size_t i = 0; i < field.samples.size(); ++i)
+        EXPECT_EQ(field.samples[i], serialField.samples[i]);
+}
@@ -0,0 +1,104 @@
+#include "gtest/gtest.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "terrainjobqueue.hpp"
+#include "global.hpp"
+
+/* Without a pool the jobs run inline, most important first and only maxInFlight per dispatch */
+TEST(TerrainJobQueueTest, testPriorityOrder) {
+    TerrainJobQueue queue(nullptr, 2, 1);
+    std::vector<int> order;
+    float priorities[] = {0.5f, 3.0f, 1.0f, 2.0f};
+    for (int id = 0; id < 4; ++id)
+        queue.push(id, priorities[id], false, [&order, id] { order.push_back(id); });
+
+    queue.dispatch();
+    ASSERT_EQ(order, std::vector<int>({1, 3}));
+    EXPECT_EQ(queue.getQueuedCount(), 2);
+
+    /* Recomputed priorities decide, negative ones cancel */
+    std::vector<int> cancelled;
+    queue.update([](int id, bool &speculative) { return id == 0 ? -1.0f : 1.0f; }, cancelled);
+    EXPECT_EQ(cancelled, std::vector<int>({0}));
+    queue.dispatch();
+    EXPECT_EQ(order, std::vector<int>({1, 3, 2}));
+    EXPECT_EQ(queue.getQueuedCount(), 0);
+}
+
+/* No more than maxInFlight jobs are handed to the pool, the next dispatch fills up again */
+TEST(TerrainJobQueueTest, testInFlightCap) {
+    ThreadPool pool(4);
+    TerrainJobQueue queue(&pool, 2, 1);
+    std::atomic<bool> release{false};
+    std::atomic<int> running{0};
+    std::atomic<int> maxRunning{0};
+    std::atomic<int> finished{0};
+    for (int id = 0; id < 6; ++id) {
+        queue.push(id, (float)id, false, [&] {
+            int now = ++running;
+            int seen = maxRunning;
+            while (now > seen && !maxRunning.compare_exchange_weak(seen, now))
+                ;
+            while (!release)
+                std::this_thread::yield();
+            --running;
+            ++finished;
+        });
+    }
+
+    queue.dispatch();
+    EXPECT_EQ(queue.getInFlightCount(), 2);
+    EXPECT_EQ(queue.getQueuedCount(), 4);
+    queue.dispatch();
+    EXPECT_EQ(queue.getQueuedCount(), 4);
+
+    release = true;
+    while (queue.getQueuedCount() || queue.getInFlightCount()) {
+        queue.dispatch();
+        std::this_thread::yield();
+    }
+    EXPECT_EQ(finished, 6);
+    EXPECT_LE(maxRunning, 2);
+    pool.closePool();
+}
+
+/* Speculative jobs wait for the others and never take more than their share of the slots */
+TEST(TerrainJobQueueTest, testSpeculativeShare) {
+    ThreadPool pool(4);
+    TerrainJobQueue queue(&pool, 3, 1);
+    std::atomic<bool> release{false};
+    std::atomic<int> finished{0};
+    auto job = [&] {
+        while (!release)
+            std::this_thread::yield();
+        ++finished;
+    };
+    for (int id = 0; id < 3; ++id)
+        queue.push(id, 10.0f, true, job);
+    queue.push(3, 1.0f, false, job);
+
+    queue.dispatch();
+    EXPECT_EQ(queue.getInFlightCount(), 2);
+    EXPECT_EQ(queue.getSpeculativeInFlightCount(), 1);
+    EXPECT_EQ(queue.getQueuedCount(), 2);
+
+    /* Turning real lets a job skip the share */
+    std::vector<int> cancelled;
+    queue.update([](int id, bool &speculative) {
+        speculative = id != 2;
+        return 1.0f;
+    }, cancelled);
+    queue.dispatch();
+    EXPECT_EQ(queue.getInFlightCount(), 3);
+    EXPECT_EQ(queue.getSpeculativeInFlightCount(), 1);
+
+    release = true;
+    while (queue.getQueuedCount() || queue.getInFlightCount()) {
+        queue.dispatch();
+        std::this_thread::yield();
+    }
+    EXPECT_EQ(finished, 4);
+    EXPECT_TRUE(cancelled.empty());
+    pool.closePool();
+}
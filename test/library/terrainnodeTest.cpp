@@ -0,0 +1,448 @@
+#include "gtest/gtest.h"
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "terrainnode.hpp"
+#include "global.hpp"
+
+static void getFlatBounds(glm::vec2 &pos, int dimension, float *minHeight, float *maxHeight) {
+    *minHeight = -1.0f;
+    *maxHeight = 1.0f;
+}
+
+/* The selected nodes cover the root exactly once, finer towards the camera */
+TEST(TerrainQuadTreeTest, testSelectionCoversRoot) {
+    int lodLevelCount = 5;
+    int dimension = 1024;
+    std::vector<float> ranges = {128, 256, 512, 1024, 4096};
+    TerrainQuadTree tree(3, glm::vec2(-512, 0), dimension, lodLevelCount, getFlatBounds);
+    EXPECT_EQ(tree.getNodeCount(), 1 + 4 + 16 + 64 + 256);
+
+    IndexedTerrainNodeListMap nodeMap;
+    std::vector<TerrainNodeInfo> creationList;
+    glm::vec3 camera(-400, 10, 100);
+    tree.lodSelect(ranges, camera, nullptr, nodeMap, creationList);
+    ASSERT_EQ(nodeMap.size(), 1u);
+    EXPECT_TRUE(creationList.empty());
+
+    std::vector<int> coverage(dimension * dimension / (64 * 64), 0);
+    bool hasLeaf = false;
+    for (TerrainNodeInfo &node : nodeMap[3]) {
+        EXPECT_EQ(node.heightMapIndex, 3);
+        EXPECT_EQ(node.size, dimension >> (lodLevelCount - 1 - node.lodLevel));
+        EXPECT_EQ(node.range, ranges[node.lodLevel]);
+        hasLeaf |= node.lodLevel == 0;
+        for (int y = 0; y < node.size / 64; ++y) {
+            for (int x = 0; x < node.size / 64; ++x)
+                ++coverage[((int)node.position.y / 64 + y) * 16 + (int)(node.position.x + 512) / 64 + x];
+        }
+    }
+
+    EXPECT_TRUE(hasLeaf);
+    for (int c : coverage)
+        EXPECT_EQ(c, 1);
+}
+
+/* Leaves above lod 0 ask for a more detailed heightmap, once */
+TEST(TerrainQuadTreeTest, testLeavesAreScheduledOnce) {
+    std::vector<float> ranges = {16, 32, 64, 1024};
+    TerrainQuadTree tree(0, glm::vec2(0, 0), 512, 4, getFlatBounds, 2);
+    EXPECT_EQ(tree.getNodeCount(), 5);
+
+    IndexedTerrainNodeListMap nodeMap;
+    std::vector<TerrainNodeInfo> creationList;
+    tree.lodSelect(ranges, glm::vec3(10, 0, 10), nullptr, nodeMap, creationList);
+    ASSERT_EQ(creationList.size(), 1u);
+    EXPECT_EQ(creationList[0].lodLevel, 2);
+    EXPECT_EQ(creationList[0].position, glm::vec2(0, 0));
+
+    tree.lodSelect(ranges, glm::vec3(10, 0, 10), nullptr, nodeMap, creationList);
+    EXPECT_EQ(creationList.size(), 1u);
+}
+
+/* A leaf whose request was cancelled asks again */
+TEST(TerrainQuadTreeTest, testUnscheduledLeafAsksAgain) {
+    std::vector<float> ranges = {16, 32, 64, 1024};
+    glm::vec3 camera(10, 0, 10);
+    TerrainQuadTree tree(0, glm::vec2(0, 0), 512, 4, getFlatBounds, 2);
+    IndexedTerrainNodeListMap nodeMap;
+    std::vector<TerrainNodeInfo> creationList;
+    tree.lodSelect(ranges, camera, nullptr, nodeMap, creationList);
+    ASSERT_EQ(creationList.size(), 1u);
+    EXPECT_FLOAT_EQ(tree.getLeafDistance(creationList[0].position, camera), 0.0f);
+    EXPECT_FLOAT_EQ(tree.getLeafDistance(creationList[0].position, glm::vec3(10, 0, 300)), 44.0f);
+
+    tree.unscheduleLeaf(creationList[0].position);
+    tree.lodSelect(ranges, camera, nullptr, nodeMap, creationList);
+    ASSERT_EQ(creationList.size(), 2u);
+    EXPECT_EQ(creationList[1].position, creationList[0].position);
+}
+
+/* Once a child heightmap is attached, its tree replaces the leaf in both selections */
+TEST(TerrainQuadTreeTest, testAttachedChildReplacesLeaf) {
+    std::vector<float> ranges = {16, 32, 64, 1024};
+    glm::vec3 camera(10, 0, 10);
+    TerrainQuadTree tree(0, glm::vec2(0, 0), 512, 4, getFlatBounds, 2);
+    TerrainQuadTree child(1, glm::vec2(0, 0), 256, 3, getFlatBounds);
+    std::vector<TerrainNodeInfo> creationList;
+    int first, end;
+    tree.updateSelection(ranges, camera, nullptr, creationList, &first, &end);
+    ASSERT_EQ(creationList.size(), 1u);
+    EXPECT_TRUE(tree.getActiveChildren().empty());
+
+    tree.attachChild(creationList[0].position, &child);
+    IndexedTerrainNodeListMap nodeMap;
+    tree.lodSelect(ranges, camera, nullptr, nodeMap, creationList);
+    EXPECT_EQ(creationList.size(), 1u);
+    int area = 0;
+    for (TerrainNodeInfo &node : nodeMap[0]) {
+        EXPECT_FALSE(node.position == glm::vec2(0, 0) && node.size == 256);
+        area += node.size * node.size;
+    }
+    EXPECT_EQ(area, 512 * 512 - 256 * 256);
+
+    int childArea = 0;
+    bool hasLeaf = false;
+    for (TerrainNodeInfo &node : nodeMap[1]) {
+        childArea += node.size * node.size;
+        hasLeaf |= node.lodLevel == 0;
+    }
+    EXPECT_EQ(childArea, 256 * 256);
+    EXPECT_TRUE(hasLeaf);
+
+    EXPECT_TRUE(tree.updateSelection(ranges, camera, nullptr, creationList, &first, &end));
+    ASSERT_EQ(tree.getActiveChildren().size(), 1u);
+    EXPECT_EQ(tree.getActiveChildren()[0], &child);
+    EXPECT_EQ(tree.getSelection().size(), nodeMap[0].size());
+    child.updateSelection(ranges, camera, nullptr, creationList, &first, &end);
+    EXPECT_EQ(child.getSelection().size(), nodeMap[1].size());
+
+    /* Evicted again, the leaf is back and asks for a new child */
+    tree.detachChild(creationList[0].position);
+    creationList.clear();
+    EXPECT_TRUE(tree.updateSelection(ranges, camera, nullptr, creationList, &first, &end));
+    EXPECT_TRUE(tree.getActiveChildren().empty());
+    EXPECT_EQ(creationList.size(), 1u);
+    area = 0;
+    for (TerrainNodeInfo &node : tree.getSelection())
+        area += node.size * node.size;
+    EXPECT_EQ(area, 512 * 512);
+}
+
+/* Looking down -z from the middle of the root, nothing behind the camera is selected */
+TEST(TerrainQuadTreeTest, testFrustumCulling) {
+    std::vector<float> ranges = {128, 256, 512, 1024, 4096};
+    TerrainQuadTree tree(0, glm::vec2(0, 0), 1024, 5, getFlatBounds);
+    glm::vec3 camera(512, 10, 512);
+    Frustum frustum;
+    frustum.extractPlanes(glm::perspective(glm::radians(45.0f), 1.0f, 1.0f, 5000.0f) *
+                          glm::lookAt(camera, camera + glm::vec3(0, 0, -1), glm::vec3(0, 1, 0)));
+
+    IndexedTerrainNodeListMap culledMap, fullMap;
+    std::vector<TerrainNodeInfo> creationList;
+    tree.lodSelect(ranges, camera, &frustum, culledMap, creationList);
+    tree.lodSelect(ranges, camera, nullptr, fullMap, creationList);
+
+    ASSERT_FALSE(culledMap[0].empty());
+    EXPECT_LT(culledMap[0].size(), fullMap[0].size());
+    for (TerrainNodeInfo &node : culledMap[0]) {
+        EXPECT_LT(node.position.y, camera.z);
+        EXPECT_NE(frustum.testBox(glm::vec3(node.position.x, -1, node.position.y),
+                                  glm::vec3(node.position.x + node.size, 1, node.position.y + node.size)), FRUSTUM_OUTSIDE);
+    }
+}
+
+/* Seen from far out on +x, the +x cube side is selected and the -x side is behind the planet */
+TEST(TerrainQuadTreeTest, testSphereHidesFarSide) {
+    float radius = 512.0f;
+    std::vector<float> ranges = {128, 256, 512, 1024, 100000};
+    auto getTilt = [](glm::vec2 &pos, int dimension) { return 0.2f; };
+    TerrainQuadTree nearSide(0, glm::vec2(-radius, -radius), 1024, 5, getFlatBounds);
+    TerrainQuadTree farSide(1, glm::vec2(-radius, -radius), 1024, 5, getFlatBounds);
+    nearSide.setSphere(glm::vec3(1, 0, 0), glm::vec3(0), radius, radius - 1.0f, getTilt);
+    farSide.setSphere(glm::vec3(-1, 0, 0), glm::vec3(0), radius, radius - 1.0f, getTilt);
+
+    IndexedTerrainNodeListMap nodeMap;
+    std::vector<TerrainNodeInfo> creationList;
+    glm::vec3 camera(4 * radius, 0, 0);
+    nearSide.lodSelect(ranges, camera, nullptr, nodeMap, creationList);
+    farSide.lodSelect(ranges, camera, nullptr, nodeMap, creationList);
+    EXPECT_FALSE(nodeMap[0].empty());
+    EXPECT_TRUE(nodeMap[1].empty());
+
+    /* Close above the +x side, the edges of the side are already behind the horizon */
+    IndexedTerrainNodeListMap closeMap;
+    nearSide.lodSelect(ranges, glm::vec3(radius + 20.0f, 0, 0), nullptr, closeMap, creationList);
+    int area = 0;
+    for (TerrainNodeInfo &node : closeMap[0])
+        area += node.size * node.size;
+    EXPECT_GT(area, 0);
+    EXPECT_LT(area, 1024 * 1024);
+}
+
+/* The incremental selection always equals a full selection, while a standing camera changes nothing */
+TEST(TerrainQuadTreeTest, testIncrementalSelectionMatchesFull) {
+    std::vector<float> ranges = {64, 128, 256, 512, 1024, 2048, 8192};
+    TerrainQuadTree tree(0, glm::vec2(0, 0), 4096, 7, getFlatBounds);
+    std::vector<TerrainNodeInfo> creationList;
+    glm::vec3 camera(100, 20, 100);
+    Frustum frustum;
+
+    for (int frame = 0; frame < 200; ++frame) {
+        /* Slow drift with a few jumps, looking along the diagonal */
+        camera += frame % 50 == 49 ? glm::vec3(700, 0, 300) : glm::vec3(3.0f, 0.0f, 2.0f);
+        camera = glm::mod(camera, glm::vec3(4096.0f));
+        frustum.extractPlanes(glm::perspective(glm::radians(60.0f), 1.0f, 1.0f, 10000.0f) *
+                              glm::lookAt(camera, camera + glm::vec3(1, -0.2f, 1), glm::vec3(0, 1, 0)));
+
+        int first = -1, end = -1;
+        std::vector<TerrainNodeInfo> previous = tree.getSelection();
+        bool changed = tree.updateSelection(ranges, camera, &frustum, creationList, &first, &end);
+
+        IndexedTerrainNodeListMap nodeMap;
+        tree.lodSelect(ranges, camera, &frustum, nodeMap, creationList);
+        std::vector<TerrainNodeInfo> &full = nodeMap[0];
+        std::vector<TerrainNodeInfo> &selection = tree.getSelection();
+        ASSERT_EQ(selection.size(), full.size());
+        for (size_t i = 0; i < full.size(); ++i) {
+            EXPECT_EQ(selection[i].position, full[i].position);
+            EXPECT_EQ(selection[i].size, full[i].size);
+            EXPECT_EQ(selection[i].lodLevel, full[i].lodLevel);
+        }
+
+        /* Everything outside [first, end) is untouched */
+        if (changed && previous.size() == selection.size()) {
+            for (int i = 0; i < first; ++i)
+                EXPECT_EQ(previous[i].position, selection[i].position);
+            for (int i = end; i < (int)selection.size(); ++i)
+                EXPECT_EQ(previous[i].position, selection[i].position);
+        } else if (!changed) {
+            ASSERT_EQ(previous.size(), selection.size());
+        }
+
+        EXPECT_FALSE(tree.updateSelection(ranges, camera, &frustum, creationList, &first, &end));
+    }
+}
+
+/* Flat for x below 512, rough above */
+static void getHalfRoughBounds(glm::vec2 &pos, int dimension, float *minHeight, float *maxHeight) {
+    bool rough = pos.x + dimension > 512;
+    *minHeight = rough ? -20.0f : -0.01f;
+    *maxHeight = rough ? 20.0f : 0.01f;
+}
+
+/* Rough in scattered 64 * 64 cells, flat elsewhere */
+static void getPatchyBounds(glm::vec2 &pos, int dimension, float *minHeight, float *maxHeight) {
+    bool rough = false;
+    for (int y = (int)pos.y / 64; y * 64 < pos.y + dimension; ++y) {
+        for (int x = (int)pos.x / 64; x * 64 < pos.x + dimension; ++x)
+            rough |= (x * 7 + y * 13) % 11 == 0;
+    }
+    *minHeight = rough ? -10.0f : -0.01f;
+    *maxHeight = rough ? 10.0f : 0.01f;
+}
+
+/* Every pair of selected nodes that shares an edge or a corner is at most one lod level apart */
+static void expectNeighboursWithinOneLevel(std::vector<TerrainNodeInfo> &nodes) {
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        for (size_t j = i + 1; j < nodes.size(); ++j) {
+            TerrainNodeInfo &a = nodes[i], &b = nodes[j];
+            bool touching = a.position.x <= b.position.x + b.size && b.position.x <= a.position.x + a.size &&
+                            a.position.y <= b.position.y + b.size && b.position.y <= a.position.y + a.size;
+            if (touching)
+                ASSERT_LE(std::abs(a.lodLevel - b.lodLevel), 1) << a.position.x << ", " << a.position.y << " and "
+                                                                << b.position.x << ", " << b.position.y;
+        }
+    }
+}
+
+/*
+ * With screen space error the flat half stays coarse, apart from the nodes its rough neighbours pull along.
+ * The rough half refines like with distance ranges only. The incremental selection agrees.
+ */
+TEST(TerrainQuadTreeTest, testScreenSpaceErrorKeepsFlatAreasCoarse) {
+    std::vector<float> ranges = {128, 256, 512, 1024, 4096};
+    TerrainQuadTree tree(0, glm::vec2(0, 0), 1024, 5, getHalfRoughBounds, 0, 8);
+    EXPECT_LT(tree.getNodeError(0, glm::vec2(0, 0)), 0.1f);
+    EXPECT_GE(tree.getNodeError(0, glm::vec2(768, 0)), 40.0f);
+    /* The root contains the rough half */
+    EXPECT_GE(tree.getNodeError(4, glm::vec2(0, 0)), 40.0f);
+
+    glm::vec3 camera(300, 10, 512);
+    float errorToRange = TerrainQuadTree::getErrorToRange(1.0f / std::tan(glm::radians(30.0f)), 1080, 2.0f);
+    IndexedTerrainNodeListMap distanceNodes, errorNodes;
+    std::vector<TerrainNodeInfo> creationList;
+    tree.lodSelect(ranges, camera, nullptr, distanceNodes, creationList);
+    tree.updateRefineRanges(ranges, errorToRange);
+    EXPECT_LT(tree.getRefineRange(1, glm::vec2(0, 0)), 16.0f);
+    EXPECT_EQ(tree.getRefineRange(1, glm::vec2(768, 0)), ranges[0]);
+    tree.lodSelect(ranges, camera, nullptr, errorNodes, creationList);
+    EXPECT_LT(errorNodes[0].size(), distanceNodes[0].size());
+
+    std::vector<TerrainNodeInfo> roughDistance, roughError;
+    int flatLeaves = 0;
+    for (TerrainNodeInfo &node : distanceNodes[0]) {
+        if (node.position.x >= 512)
+            roughDistance.push_back(node);
+        else if (node.position.x + node.size <= 256 && node.lodLevel == 0)
+            ++flatLeaves;
+    }
+    EXPECT_GT(flatLeaves, 0);
+    for (TerrainNodeInfo &node : errorNodes[0]) {
+        if (node.position.x >= 512)
+            roughError.push_back(node);
+        else if (node.position.x + node.size <= 256)
+            EXPECT_GE(node.lodLevel, 1);
+    }
+    ASSERT_EQ(roughError.size(), roughDistance.size());
+    for (size_t i = 0; i < roughError.size(); ++i) {
+        EXPECT_EQ(roughError[i].position, roughDistance[i].position);
+        EXPECT_EQ(roughError[i].lodLevel, roughDistance[i].lodLevel);
+    }
+
+    int first, end;
+    EXPECT_TRUE(tree.updateSelection(ranges, camera, nullptr, creationList, &first, &end));
+    EXPECT_EQ(tree.getSelection().size(), errorNodes[0].size());
+    /* Same ranges again, the cached selection stays valid */
+    tree.updateRefineRanges(ranges, errorToRange);
+    EXPECT_FALSE(tree.updateSelection(ranges, camera, nullptr, creationList, &first, &end));
+    tree.updateRefineRanges(ranges, 0.0f);
+    EXPECT_TRUE(tree.updateSelection(ranges, camera, nullptr, creationList, &first, &end));
+    EXPECT_EQ(tree.getSelection().size(), distanceNodes[0].size());
+}
+
+/*
+ * Ranges far enough apart keep neighbours within one lod level with distance only, a larger step leaves a crack.
+ * Per node ranges from the screen space error must keep that, for any pixel threshold.
+ */
+TEST(TerrainQuadTreeTest, testScreenSpaceErrorNeighboursWithinOneLevel) {
+    std::vector<float> ranges = {128, 384, 896, 1920, 4096};
+    TerrainQuadTree::BoundsFunction bounds[] = {getHalfRoughBounds, getPatchyBounds};
+    for (TerrainQuadTree::BoundsFunction getBounds : bounds) {
+        TerrainQuadTree tree(0, glm::vec2(0, 0), 1024, 5, getBounds, 0, 8);
+        for (float maxPixelError : {0.5f, 2.0f, 8.0f, 32.0f}) {
+            tree.updateRefineRanges(ranges, TerrainQuadTree::getErrorToRange(1.0f / std::tan(glm::radians(30.0f)), 1080, maxPixelError));
+            for (float x = -200.0f; x <= 1224.0f; x += 97.0f) {
+                for (float z = -200.0f; z <= 1224.0f; z += 89.0f) {
+                    IndexedTerrainNodeListMap nodeMap;
+                    std::vector<TerrainNodeInfo> creationList;
+                    tree.lodSelect(ranges, glm::vec3(x, 2.0f, z), nullptr, nodeMap, creationList);
+                    expectNeighboursWithinOneLevel(nodeMap[0]);
+                }
+            }
+        }
+    }
+}
+
+/* A child below every leaf, the flat children next to the rough ones still refine far enough */
+TEST(TerrainQuadTreeTest, testScreenSpaceErrorNeighboursAcrossChildren) {
+    std::vector<float> ranges = {128, 384, 896, 1920, 4096};
+    TerrainQuadTree tree(0, glm::vec2(0, 0), 1024, 5, getHalfRoughBounds, 2, 8);
+    std::vector<TerrainQuadTree *> children;
+    for (int y = 0; y < 1024; y += 256) {
+        for (int x = 0; x < 1024; x += 256) {
+            children.push_back(new TerrainQuadTree(children.size() + 1, glm::vec2(x, y), 256, 3, getHalfRoughBounds, 0, 8));
+            tree.attachChild(glm::vec2(x, y), children.back());
+        }
+    }
+
+    float errorToRange = TerrainQuadTree::getErrorToRange(1.0f / std::tan(glm::radians(30.0f)), 1080, 2.0f);
+    for (int lodLevel = 1; lodLevel < (int)ranges.size(); ++lodLevel) {
+        for (TerrainQuadTree *child : children)
+            child->updateRefineRanges(lodLevel, ranges, errorToRange, [&tree](int finerLevel, const glm::vec2 &pos) {
+                return tree.getRefineRange(finerLevel, pos);
+            });
+        tree.updateRefineRanges(lodLevel, ranges, errorToRange, nullptr);
+    }
+    /* The flat leaf next to the rough children refines as far as they do, the one beyond stays coarse */
+    EXPECT_EQ(tree.getRefineRange(2, glm::vec2(256, 0)), ranges[1]);
+    EXPECT_LT(tree.getRefineRange(2, glm::vec2(0, 0)), ranges[1]);
+
+    for (float x = -200.0f; x <= 1224.0f; x += 97.0f) {
+        for (float z = -200.0f; z <= 1224.0f; z += 89.0f) {
+            IndexedTerrainNodeListMap nodeMap;
+            std::vector<TerrainNodeInfo> creationList;
+            tree.lodSelect(ranges, glm::vec3(x, 2.0f, z), nullptr, nodeMap, creationList);
+            std::vector<TerrainNodeInfo> nodes;
+            for (auto &kv : nodeMap)
+                nodes.insert(nodes.end(), kv.second.begin(), kv.second.end());
+            expectNeighboursWithinOneLevel(nodes);
+        }
+    }
+
+    for (TerrainQuadTree *child : children)
+        delete child;
+}
+
+static void getSlopedBounds(glm::vec2 &pos, int dimension, float *minHeight, float *maxHeight) {
+    *minHeight = pos.x * 0.1f;
+    *maxHeight = (pos.x + dimension) * 0.1f + 5.0f;
+}
+
+/* A moved tree selects and schedules like a new one at its new position */
+TEST(TerrainQuadTreeTest, testMovedTreeMatchesNew) {
+    std::vector<float> ranges = {16, 32, 64, 128, 1024};
+    TerrainQuadTree tree(0, glm::vec2(0, 0), 256, 5, getSlopedBounds, 1);
+    std::vector<TerrainNodeInfo> creationList;
+    int first, end;
+    tree.updateSelection(ranges, glm::vec3(10, 0, 10), nullptr, creationList, &first, &end);
+    EXPECT_FALSE(creationList.empty());
+
+    tree.moveTo(glm::vec2(512, -256));
+    TerrainQuadTree moved(0, glm::vec2(512, -256), 256, 5, getSlopedBounds, 1);
+    EXPECT_EQ(tree.getMinHeight(), moved.getMinHeight());
+
+    glm::vec3 camera(530, 60, -240);
+    std::vector<TerrainNodeInfo> movedCreationList;
+    creationList.clear();
+    EXPECT_TRUE(tree.updateSelection(ranges, camera, nullptr, creationList, &first, &end));
+    moved.updateSelection(ranges, camera, nullptr, movedCreationList, &first, &end);
+    ASSERT_EQ(tree.getSelection().size(), moved.getSelection().size());
+    for (size_t i = 0; i < moved.getSelection().size(); ++i) {
+        EXPECT_EQ(tree.getSelection()[i].position, moved.getSelection()[i].position);
+        EXPECT_EQ(tree.getSelection()[i].lodLevel, moved.getSelection()[i].lodLevel);
+    }
+    ASSERT_EQ(creationList.size(), movedCreationList.size());
+    EXPECT_FALSE(creationList.empty());
+    EXPECT_EQ(tree.getLeafDistance(creationList[0].position, camera), moved.getLeafDistance(creationList[0].position, camera));
+}
+
+/* Trees only write their own selection, selecting several of them on the pool gives the serial result */
+TEST(TerrainQuadTreeTest, testConcurrentSelection) {
+    std::vector<float> ranges = {64, 128, 256, 512, 1024, 2048, 8192};
+    std::vector<TerrainQuadTree *> trees;
+    for (int i = 0; i < 6; ++i)
+        trees.push_back(new TerrainQuadTree(i, glm::vec2(4096 * (i % 3), 4096 * (i / 3)), 4096, 7, getFlatBounds));
+
+    ThreadPool pool(3);
+    std::vector<std::vector<TerrainNodeInfo>> creationLists(trees.size());
+    for (int frame = 0; frame < 20; ++frame) {
+        glm::vec3 camera(3000.0f + 300.0f * frame, 20.0f, 4000.0f);
+        std::atomic<int> finished{0};
+        for (size_t i = 0; i < trees.size(); ++i) {
+            pool.addJob([&, i] {
+                int first, end;
+                trees[i]->updateSelection(ranges, camera, nullptr, creationLists[i], &first, &end);
+                ++finished;
+            });
+        }
+        while (finished < (int)trees.size())
+            std::this_thread::yield();
+
+        for (size_t i = 0; i < trees.size(); ++i) {
+            IndexedTerrainNodeListMap nodeMap;
+            std::vector<TerrainNodeInfo> creationList;
+            trees[i]->lodSelect(ranges, camera, nullptr, nodeMap, creationList);
+            ASSERT_EQ(trees[i]->getSelection().size(), nodeMap[i].size());
+            for (size_t j = 0; j < nodeMap[i].size(); ++j)
+                EXPECT_EQ(trees[i]->getSelection()[j].position, nodeMap[i][j].position);
+        }
+    }
+
+    pool.closePool();
+    for (TerrainQuadTree *tree : trees)
+        delete tree;
+}
@@ -0,0 +1,204 @@
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "threadpool.hpp"
+#include "task.hpp"
+#include "parallel.hpp"
+#include "workstealingdeque.hpp"
+
+/* The owner pops newest first while thieves take the oldest, every value is taken exactly once */
+TEST(ThreadPoolTest, testDequeOwnerAndThieves) {
+    const int valueCount = 100000;
+    WorkStealingDeque<int> deque(4);
+    std::vector<int> values(valueCount);
+    for (int i = 0; i < valueCount; ++i)
+        values[i] = i;
+    std::vector<std::atomic<int>> taken(valueCount);
+    std::atomic<bool> done{false};
+
+    std::vector<std::thread> thieves;
+    for (int t = 0; t < 3; ++t) {
+        thieves.emplace_back([&] {
+            while (!done || !deque.empty()) {
+                if (int *value = deque.steal())
+                    ++taken[*value];
+            }
+        });
+    }
+
+    for (int i = 0; i < valueCount; ++i) {
+        deque.push(&values[i]);
+        if (i % 3 == 0) {
+            if (int *value = deque.pop())
+                ++taken[*value];
+        }
+    }
+    while (int *value = deque.pop())
+        ++taken[*value];
+    done = true;
+    for (std::thread &t : thieves)
+        t.join();
+
+    for (int i = 0; i < valueCount; ++i)
+        EXPECT_EQ(taken[i].load(), 1);
+}
+
+/* Jobs added from outside and from within jobs all run once, closePool waits for the ones still queued */
+TEST(ThreadPoolTest, testExternalAndNestedJobs) {
+    ThreadPool pool(4);
+    std::atomic<int> leaves{0};
+    std::function<void(int)> spawn = [&](int depth) {
+        if (!depth) {
+            ++leaves;
+            return;
+        }
+        for (int i = 0; i < 4; ++i)
+            pool.addJob([&spawn, depth] { spawn(depth - 1); });
+    };
+
+    const int roots = 50;
+    for (int i = 0; i < roots; ++i)
+        pool.addJob([&spawn] { spawn(4); });
+
+    /* Workers go to sleep and have to be woken again */
+    while (leaves < roots * 256)
+        std::this_thread::yield();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::atomic<bool> late{false};
+    pool.addJob([&late] { late = true; });
+
+    pool.closePool();
+    EXPECT_EQ(leaves.load(), roots * 256);
+    EXPECT_TRUE(late);
+    EXPECT_EQ(pool.getThreadCount(), 0);
+}
+
+/* Continuations run after their task, joins after all of theirs, also when attached to finished tasks */
+TEST(ThreadPoolTest, testTaskContinuationsAndJoins) {
+    ThreadPool pool(4);
+    std::atomic<int> stages{0};
+    std::atomic<bool> ordered{true};
+    std::vector<Task> chains;
+    for (int i = 0; i < 100; ++i) {
+        std::shared_ptr<int> stage = std::make_shared<int>(0);
+        chains.push_back(pool.submit([stage] { *stage = 1; })
+                             .then([stage, &ordered] { ordered = ordered && *stage == 1; *stage = 2; })
+                             .then([stage, &ordered, &stages] {
+                                 ordered = ordered && *stage == 2;
+                                 ++stages;
+                             }));
+    }
+
+    Task all = Task::whenAll(chains);
+    all.wait();
+    EXPECT_TRUE(all.isDone());
+    EXPECT_EQ(stages.load(), 100);
+    EXPECT_TRUE(ordered);
+
+    std::atomic<bool> late{false};
+    all.then([&late] { late = true; }).wait();
+    EXPECT_TRUE(late);
+    EXPECT_TRUE(Task::whenAll(std::vector<Task>()).isDone());
+    EXPECT_FALSE(Task().valid());
+}
+
+/* Every node starts after all of its dependencies finished */
+TEST(ThreadPoolTest, testTaskGraphOrder) {
+    ThreadPool pool(4);
+    const int nodeCount = 500;
+    std::vector<std::atomic<bool>> finished(nodeCount);
+    std::atomic<bool> ordered{true};
+    TaskGraph graph;
+    for (int i = 0; i < nodeCount; ++i) {
+        std::vector<int> dependencies;
+        for (int d = i / 2; d < i; d += std::max(1, i / 5))
+            dependencies.push_back(d);
+        graph.add([&, i, dependencies] {
+            for (int d : dependencies)
+                ordered = ordered && finished[d];
+            finished[i] = true;
+        }, dependencies);
+    }
+    EXPECT_EQ(graph.add([] {}, {nodeCount + 1}), -1);
+
+    graph.submit(&pool).wait();
+    EXPECT_EQ(graph.getNodeCount(), 0);
+    EXPECT_TRUE(ordered);
+    for (int i = 0; i < nodeCount; ++i)
+        EXPECT_TRUE(finished[i]);
+}
+
+/* Every index is visited once, also by loops nested in pool jobs while all workers are busy with them */
+TEST(ThreadPoolTest, testParallelForNested) {
+    ThreadPool pool(3);
+    const int outer = 8, inner = 10000;
+    std::vector<std::atomic<int>> visits(outer * inner);
+    parallelFor(&pool, 0, outer, 1, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            parallelFor(&pool, 0, inner, 64, [&visits, i, inner](int innerBegin, int innerEnd) {
+                for (int j = innerBegin; j < innerEnd; ++j)
+                    ++visits[i * inner + j];
+            });
+        }
+    });
+
+    for (std::atomic<int> &count : visits)
+        EXPECT_EQ(count.load(), 1);
+}
+
+/* Partial results are combined in range order, so the pool gives the same float sum every time */
+TEST(ThreadPoolTest, testParallelReduce) {
+    ThreadPool pool(4);
+    std::vector<float> values(100000);
+    for (int i = 0; i < (int)values.size(); ++i)
+        values[i] = 1.0f / (i + 1);
+
+    auto sum = [&values](int begin, int end) {
+        float partial = 0.0f;
+        for (int i = begin; i < end; ++i)
+            partial += values[i];
+        return partial;
+    };
+    auto add = [](float a, float b) { return a + b; };
+    float first = parallelReduce(&pool, 0, (int)values.size(), 256, 0.0f, sum, add);
+    for (int i = 0; i < 10; ++i)
+        EXPECT_EQ(parallelReduce(&pool, 0, (int)values.size(), 256, 0.0f, sum, add), first);
+    EXPECT_NEAR(first, sum(0, values.size()), 1e-3f);
+    EXPECT_EQ(parallelReduce(nullptr, 0, 0, 1, 7, [](int, int) { return 1; }, add), 7);
+}
+
+/* Counted by tag when built with THREADPOOL_METRICS, all zero otherwise. Each snapshot only covers the time since the last */
+TEST(ThreadPoolTest, testMetrics) {
+    ThreadPool pool(2);
+    std::atomic<int> done{0};
+    for (int i = 0; i < 100; ++i)
+        pool.addJob([&done] { ++done; }, i % 2 ? "odd" : "even");
+    while (done < 100)
+        std::this_thread::yield();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+    ThreadPoolMetrics metrics = pool.getMetrics();
+#ifdef THREADPOOL_METRICS
+    EXPECT_EQ(metrics.getJobCount(), 100u);
+    EXPECT_EQ(metrics.runTimes["odd"].getCount(), 50u);
+    EXPECT_EQ(metrics.runTimes["even"].getCount(), 50u);
+    EXPECT_GE(metrics.maxQueuedJobs, 1);
+    EXPECT_EQ((int)metrics.busy.size(), 2);
+    EXPECT_GT(metrics.seconds, 0.0);
+#else
+    EXPECT_EQ(metrics.getJobCount(), 0u);
+    EXPECT_TRUE(metrics.runTimes.empty());
+#endif
+    EXPECT_EQ(pool.getMetrics().getJobCount(), 0u);
+
+    MetricsHistogram histogram;
+    histogram.counts[0] = 90;
+    histogram.counts[4] = 10;
+    EXPECT_EQ(histogram.getPercentileMicroseconds(0.5f), 1.0);
+    EXPECT_EQ(histogram.getPercentileMicroseconds(0.99f), 16.0);
+}